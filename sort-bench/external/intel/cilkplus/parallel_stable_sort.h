@@ -92,11 +92,26 @@ void parallel_stable_sort_aux( RandomAccessIterator1 xs, RandomAccessIterator1 x
 template<typename RandomAccessIterator, typename Compare>
 void parallel_stable_sort( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp ) {
     typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
-    if( internal::raw_buffer z = internal::raw_buffer( sizeof(T)*(xe-xs) ) )
+    if( internal::raw_buffer z = internal::raw_buffer( sizeof(T)*(xe-xs) ) ) {
+        last_sort_path() = sort_path::buffered;
         internal::parallel_stable_sort_aux( xs, xe, (T*)z.get(), 2, comp );
-    else
+    } else {
         // Not enough memory available - fall back on serial sort
+        last_sort_path() = sort_path::serial_fallback;
         std::stable_sort( xs, xe, comp );
+    }
+}
+
+//! Sort with a caller supplied scratch arena instead of allocating a fresh
+//! buffer. Falls back to the allocating variant if the arena is too small.
+template<typename RandomAccessIterator, typename Compare>
+void parallel_stable_sort( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp, scratch_arena const& arena ) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    if( T* z = arena.get<T>( xe-xs ) ) {
+        last_sort_path() = sort_path::arena;
+        internal::parallel_stable_sort_aux( xs, xe, z, 2, comp );
+    } else
+        parallel_stable_sort( xs, xe, comp );
 }
 
 } // namespace pss
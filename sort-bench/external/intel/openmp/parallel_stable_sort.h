@@ -32,6 +32,8 @@
 #ifndef PARALLEL_STABLE_SORT_H
 #define PARALLEL_STABLE_SORT_H
 #include <algorithm>
+#include <utility>
+#include <vector>
 #include "../pss_common.h"
 #include <omp.h>
 
@@ -72,7 +74,7 @@ void parallel_move_merge(
     Compare               comp)
 {
 #endif
-  const size_t MERGE_CUT_OFF = 2000;
+  const size_t MERGE_CUT_OFF = merge_cut_off<RandomAccessIterator1>();
   while (static_cast<size_t>((xe - xs) + (ye - ys)) > MERGE_CUT_OFF) {
     RandomAccessIterator1 xm;
     RandomAccessIterator2 ym;
@@ -112,7 +114,7 @@ void parallel_stable_sort_aux(
     int                   inplace,
     Compare               comp)
 {
-  const size_t SORT_CUT_OFF = 500;
+  const size_t SORT_CUT_OFF = sort_cut_off<RandomAccessIterator1>();
   if (static_cast<size_t>(xe - xs) <= SORT_CUT_OFF) {
     stable_sort_base_case(xs, xe, zs, inplace, comp);
   }
@@ -133,22 +135,193 @@ void parallel_stable_sort_aux(
 
 }  // namespace internal
 
+namespace internal {
+
+// Sorts [xs,xe) using z[0:xe-xs) as temporary buffer.
+template <typename RandomAccessIterator, typename T, typename Compare>
+void parallel_stable_sort_buffered(
+    RandomAccessIterator xs, RandomAccessIterator xe, T* z, Compare comp)
+{
+  /* It may be the case that we are already in a parallel region */
+  if (omp_get_num_threads() > 1)
+    internal::parallel_stable_sort_aux(xs, xe, z, 2, comp);
+  else
+#pragma omp parallel
+#pragma omp master
+    internal::parallel_stable_sort_aux(xs, xe, z, 2, comp);
+}
+
+// Merges seqs to [zs,zs+n) with one task per exact split of the output.
+// Must be called from within a parallel region.
+template <
+    typename RandomAccessIterator1,
+    typename RandomAccessIterator2,
+    typename Compare>
+void parallel_multiway_merge_aux(
+    std::vector<std::pair<RandomAccessIterator1, RandomAccessIterator1>> const&
+                          seqs,
+    RandomAccessIterator2 zs,
+    size_t                nparts,
+    bool                  destroy,
+    Compare               comp)
+{
+  for (size_t j = 0; j < nparts; ++j) {
+#pragma omp task untied firstprivate(j, zs, nparts, destroy, comp) shared(seqs)
+    multiway_merge_part(seqs, j, nparts, zs, destroy, comp);
+  }
+#pragma omp taskwait
+}
+
+// Sorts the runs of [xs,xe) into z[0:xe-xs), then merges them back to
+// [xs,xe) with a single multiway merge.
+template <typename RandomAccessIterator, typename T, typename Compare>
+void parallel_stable_sort_multiway_aux(
+    RandomAccessIterator                  xs,
+    std::vector<std::pair<T*, T*>> const& runs,
+    T*                                    z,
+    Compare                               comp)
+{
+  for (size_t r = 0; r < runs.size(); ++r) {
+#pragma omp task untied firstprivate(r, xs, z, comp) shared(runs)
+    parallel_stable_sort_aux(
+        xs + (runs[r].first - z),
+        xs + (runs[r].second - z),
+        runs[r].first,
+        0,
+        comp);
+  }
+#pragma omp taskwait
+  parallel_multiway_merge_aux(runs, xs, runs.size(), true, comp);
+}
+
+// Sorts [xs,xe) as nruns runs using z[0:xe-xs) as temporary buffer. Moves
+// the data once for the multiway merge instead of once per level of the top
+// log2(nruns) levels of the merge tree.
+template <typename RandomAccessIterator, typename T, typename Compare>
+void parallel_stable_sort_multiway_buffered(
+    RandomAccessIterator xs,
+    RandomAccessIterator xe,
+    T*                   z,
+    size_t               nruns,
+    Compare              comp)
+{
+  size_t const n = xe - xs;
+
+  std::vector<std::pair<T*, T*>> runs;
+  for (size_t r = 0; r < nruns; ++r) {
+    runs.emplace_back(z + n * r / nruns, z + n * (r + 1) / nruns);
+  }
+
+  /* It may be the case that we are already in a parallel region */
+  if (omp_get_num_threads() > 1)
+    internal::parallel_stable_sort_multiway_aux(xs, runs, z, comp);
+  else
+#pragma omp parallel
+#pragma omp master
+    internal::parallel_stable_sort_multiway_aux(xs, runs, z, comp);
+}
+
+}  // namespace internal
+
+//! Merge the sorted sequences seqs to [zs,zs+n), n the sum of their lengths,
+//! with an exact split of the output across the threads. Keys comparing
+//! equal are taken in sequence order, i.e. the merge is stable.
+template <
+    typename RandomAccessIterator1,
+    typename RandomAccessIterator2,
+    typename Compare>
+void parallel_multiway_merge(
+    std::vector<std::pair<RandomAccessIterator1, RandomAccessIterator1>> const&
+                          seqs,
+    RandomAccessIterator2 zs,
+    Compare               comp)
+{
+  if (seqs.empty()) return;
+  /* It may be the case that we are already in a parallel region */
+  if (omp_get_num_threads() > 1)
+    internal::parallel_multiway_merge_aux(
+        seqs, zs, omp_get_num_threads(), false, comp);
+  else
+#pragma omp parallel
+#pragma omp master
+    internal::parallel_multiway_merge_aux(
+        seqs, zs, omp_get_num_threads(), false, comp);
+}
+
 template <typename RandomAccessIterator, typename Compare>
 void parallel_stable_sort(
     RandomAccessIterator xs, RandomAccessIterator xe, Compare comp)
 {
   typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
-  if (internal::raw_buffer z = internal::raw_buffer(sizeof(T) * (xe - xs)))
-    /* It may be the case that we are already in a parallel region */
-    if (omp_get_num_threads() > 1)
-      internal::parallel_stable_sort_aux(xs, xe, (T*)z.get(), 2, comp);
-    else
-#pragma omp parallel
-#pragma omp master
-      internal::parallel_stable_sort_aux(xs, xe, (T*)z.get(), 2, comp);
-  else
+  if (internal::raw_buffer z = internal::raw_buffer(sizeof(T) * (xe - xs))) {
+    last_sort_path() = sort_path::buffered;
+    internal::parallel_stable_sort_buffered(xs, xe, (T*)z.get(), comp);
+  }
+  else {
     // Not enough memory available - fall back on serial sort
+    last_sort_path() = sort_path::serial_fallback;
+    std::stable_sort(xs, xe, comp);
+  }
+}
+
+//! Sort with a caller supplied scratch arena instead of allocating a fresh
+//! buffer. Falls back to the allocating variant if the arena is too small.
+template <typename RandomAccessIterator, typename Compare>
+void parallel_stable_sort(
+    RandomAccessIterator xs,
+    RandomAccessIterator xe,
+    Compare              comp,
+    scratch_arena const& arena)
+{
+  typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+  if (T* z = arena.get<T>(xe - xs)) {
+    last_sort_path() = sort_path::arena;
+    internal::parallel_stable_sort_buffered(xs, xe, z, comp);
+  }
+  else
+    parallel_stable_sort(xs, xe, comp);
+}
+
+//! Sort with per-thread runs and a single multiway merge instead of the
+//! binary merge tree. Falls back to parallel_stable_sort for small inputs.
+template <typename RandomAccessIterator, typename Compare>
+void parallel_stable_sort_multiway(
+    RandomAccessIterator xs, RandomAccessIterator xe, Compare comp)
+{
+  typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+  size_t const nruns = internal::multiway_runs(xe - xs, omp_get_max_threads());
+  if (nruns == 0) {
+    parallel_stable_sort(xs, xe, comp);
+  }
+  else if (internal::raw_buffer z = internal::raw_buffer(sizeof(T) * (xe - xs))) {
+    last_sort_path() = sort_path::multiway;
+    internal::parallel_stable_sort_multiway_buffered(
+        xs, xe, (T*)z.get(), nruns, comp);
+  }
+  else {
+    last_sort_path() = sort_path::serial_fallback;
     std::stable_sort(xs, xe, comp);
+  }
+}
+
+template <typename RandomAccessIterator, typename Compare>
+void parallel_stable_sort_multiway(
+    RandomAccessIterator xs,
+    RandomAccessIterator xe,
+    Compare              comp,
+    scratch_arena const& arena)
+{
+  typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+  size_t const nruns = internal::multiway_runs(xe - xs, omp_get_max_threads());
+  T*           z     = arena.get<T>(xe - xs);
+  if (nruns != 0 && z) {
+    last_sort_path() = sort_path::multiway_arena;
+    internal::parallel_stable_sort_multiway_buffered(xs, xe, z, nruns, comp);
+  }
+  else if (nruns != 0)
+    parallel_stable_sort_multiway(xs, xe, comp);
+  else
+    parallel_stable_sort(xs, xe, comp, arena);
 }
 
 }  // namespace pss
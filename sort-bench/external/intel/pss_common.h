@@ -29,12 +29,58 @@
   WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
   POSSIBILITY OF SUCH DAMAGE.
 */
+#ifndef PSS_COMMON_H
+#define PSS_COMMON_H
+
 #include <algorithm>
+#include <cstddef>
+#include <functional>
 #include <iterator>
+#include <limits>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+// The bitonic merge kernels are opt-in (make SIMD_MERGE=avx2|avx512): only
+// the functions of the SIMD merge path are compiled for the instruction set
+// (function target attributes), the rest of the build keeps the baseline
+// ISA. The CPU has to support the selected instruction set.
+#if defined(PSS_SIMD_MERGE_AVX512)
+#include <immintrin.h>
+#define PSS_SIMD_TARGET __attribute__((target("avx2,avx512f")))
+#elif defined(PSS_SIMD_MERGE_AVX2)
+#include <immintrin.h>
+#define PSS_SIMD_TARGET __attribute__((target("avx2")))
+#else
+#define PSS_SIMD_TARGET
+#endif
 
 namespace pss {
 
+//! Compile time task granularity of the merge sort for value type T:
+//! ranges of up to sort elements are sorted serially, merges of up to merge
+//! elements are not split further. Specialize to change the defaults.
+template <typename T>
+struct cut_off_traits {
+  static constexpr size_t sort  = 500;
+  static constexpr size_t merge = 2000;
+};
+
+//! Runtime task granularity, see cut_off_traits
+struct cut_offs {
+  size_t sort;
+  size_t merge;
+};
+
+//! Cut-offs used by all sorts of value type T, initialized from
+//! cut_off_traits<T>. Set before sorting, e.g. from a calibration.
+template <typename T>
+inline cut_offs& cut_offs_for()
+{
+  static cut_offs c = {cut_off_traits<T>::sort, cut_off_traits<T>::merge};
+  return c;
+}
+
 namespace internal {
 
 //! Destroy sequence [xs,xe)
@@ -55,7 +101,7 @@ template <
     class RandomAccessIterator2,
     class RandomAccessIterator3,
     class Compare>
-void serial_move_merge(
+void serial_move_merge_scalar(
     RandomAccessIterator1 xs,
     RandomAccessIterator1 xe,
     RandomAccessIterator2 ys,
@@ -85,6 +131,589 @@ movey:
   std::move(ys, ye, zs);
 }
 
+//! Vector register operations for the bitonic merge network. Only
+//! specialized for arithmetic key types where the instruction set supports
+//! lane-wise min/max, everything else takes the scalar path.
+template <typename T>
+struct simd_merge_traits {
+  static constexpr bool enabled = false;
+};
+
+//! Instruction set of the bitonic merge network, "scalar" if disabled
+inline char const* simd_merge_isa()
+{
+#if defined(PSS_SIMD_MERGE_AVX512)
+  return "avx512";
+#elif defined(PSS_SIMD_MERGE_AVX2)
+  return "avx2";
+#else
+  return "scalar";
+#endif
+}
+
+#if defined(PSS_SIMD_MERGE_AVX512)
+
+//! AVX-512: every half-cleaner stage of distance D is a full permute with
+//! index (i ^ D) followed by a masked blend of lanes with (i & D) != 0.
+template <>
+struct simd_merge_traits<double> {
+  static constexpr bool   enabled = true;
+  static constexpr size_t width   = 8;
+  typedef __m512d         vec;
+
+  PSS_SIMD_TARGET static vec load(double const* p)
+  {
+    return _mm512_loadu_pd(p);
+  }
+  PSS_SIMD_TARGET static void store(double* p, vec v)
+  {
+    _mm512_storeu_pd(p, v);
+  }
+  PSS_SIMD_TARGET static vec reverse(vec v)
+  {
+    return _mm512_permutexvar_pd(_mm512_setr_epi64(7, 6, 5, 4, 3, 2, 1, 0), v);
+  }
+  PSS_SIMD_TARGET static void minmax(vec& lo, vec& hi)
+  {
+    vec const mn = _mm512_min_pd(lo, hi);
+    hi           = _mm512_max_pd(lo, hi);
+    lo           = mn;
+  }
+  PSS_SIMD_TARGET static vec sort_bitonic(vec v)
+  {
+    vec t = _mm512_permutexvar_pd(_mm512_setr_epi64(4, 5, 6, 7, 0, 1, 2, 3), v);
+    v = _mm512_mask_blend_pd(0xF0, _mm512_min_pd(v, t), _mm512_max_pd(v, t));
+    t = _mm512_permutexvar_pd(_mm512_setr_epi64(2, 3, 0, 1, 6, 7, 4, 5), v);
+    v = _mm512_mask_blend_pd(0xCC, _mm512_min_pd(v, t), _mm512_max_pd(v, t));
+    t = _mm512_permutexvar_pd(_mm512_setr_epi64(1, 0, 3, 2, 5, 4, 7, 6), v);
+    v = _mm512_mask_blend_pd(0xAA, _mm512_min_pd(v, t), _mm512_max_pd(v, t));
+    return v;
+  }
+};
+
+template <typename I64>
+struct simd_merge_traits_i64 {
+  static constexpr bool   enabled = true;
+  static constexpr size_t width   = 8;
+  typedef __m512i         vec;
+
+  PSS_SIMD_TARGET static vec load(I64 const* p)
+  {
+    return _mm512_loadu_si512(p);
+  }
+  PSS_SIMD_TARGET static void store(I64* p, vec v)
+  {
+    _mm512_storeu_si512(p, v);
+  }
+  PSS_SIMD_TARGET static vec reverse(vec v)
+  {
+    return _mm512_permutexvar_epi64(
+        _mm512_setr_epi64(7, 6, 5, 4, 3, 2, 1, 0), v);
+  }
+  // signed and unsigned 64-bit keys
+  PSS_SIMD_TARGET static vec min(vec a, vec b)
+  {
+    return std::is_signed<I64>::value ? _mm512_min_epi64(a, b)
+                                      : _mm512_min_epu64(a, b);
+  }
+  PSS_SIMD_TARGET static vec max(vec a, vec b)
+  {
+    return std::is_signed<I64>::value ? _mm512_max_epi64(a, b)
+                                      : _mm512_max_epu64(a, b);
+  }
+  PSS_SIMD_TARGET static void minmax(vec& lo, vec& hi)
+  {
+    vec const mn = min(lo, hi);
+    hi           = max(lo, hi);
+    lo           = mn;
+  }
+  PSS_SIMD_TARGET static vec sort_bitonic(vec v)
+  {
+    vec t = _mm512_permutexvar_epi64(
+        _mm512_setr_epi64(4, 5, 6, 7, 0, 1, 2, 3), v);
+    v = _mm512_mask_blend_epi64(0xF0, min(v, t), max(v, t));
+    t = _mm512_permutexvar_epi64(
+        _mm512_setr_epi64(2, 3, 0, 1, 6, 7, 4, 5), v);
+    v = _mm512_mask_blend_epi64(0xCC, min(v, t), max(v, t));
+    t = _mm512_permutexvar_epi64(
+        _mm512_setr_epi64(1, 0, 3, 2, 5, 4, 7, 6), v);
+    v = _mm512_mask_blend_epi64(0xAA, min(v, t), max(v, t));
+    return v;
+  }
+};
+
+template <>
+struct simd_merge_traits<float> {
+  static constexpr bool   enabled = true;
+  static constexpr size_t width   = 16;
+  typedef __m512          vec;
+
+  PSS_SIMD_TARGET static vec load(float const* p)
+  {
+    return _mm512_loadu_ps(p);
+  }
+  PSS_SIMD_TARGET static void store(float* p, vec v)
+  {
+    _mm512_storeu_ps(p, v);
+  }
+  PSS_SIMD_TARGET static vec reverse(vec v)
+  {
+    return _mm512_permutexvar_ps(
+        _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+        v);
+  }
+  PSS_SIMD_TARGET static void minmax(vec& lo, vec& hi)
+  {
+    vec const mn = _mm512_min_ps(lo, hi);
+    hi           = _mm512_max_ps(lo, hi);
+    lo           = mn;
+  }
+  PSS_SIMD_TARGET static vec sort_bitonic(vec v)
+  {
+    vec t = _mm512_permutexvar_ps(
+        _mm512_setr_epi32(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7),
+        v);
+    v = _mm512_mask_blend_ps(0xFF00, _mm512_min_ps(v, t), _mm512_max_ps(v, t));
+    t = _mm512_permutexvar_ps(
+        _mm512_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11),
+        v);
+    v = _mm512_mask_blend_ps(0xF0F0, _mm512_min_ps(v, t), _mm512_max_ps(v, t));
+    t = _mm512_permutexvar_ps(
+        _mm512_setr_epi32(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13),
+        v);
+    v = _mm512_mask_blend_ps(0xCCCC, _mm512_min_ps(v, t), _mm512_max_ps(v, t));
+    t = _mm512_permutexvar_ps(
+        _mm512_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14),
+        v);
+    v = _mm512_mask_blend_ps(0xAAAA, _mm512_min_ps(v, t), _mm512_max_ps(v, t));
+    return v;
+  }
+};
+
+template <>
+struct simd_merge_traits<int> {
+  static constexpr bool   enabled = true;
+  static constexpr size_t width   = 16;
+  typedef __m512i         vec;
+
+  PSS_SIMD_TARGET static vec load(int const* p)
+  {
+    return _mm512_loadu_si512(p);
+  }
+  PSS_SIMD_TARGET static void store(int* p, vec v)
+  {
+    _mm512_storeu_si512(p, v);
+  }
+  PSS_SIMD_TARGET static vec reverse(vec v)
+  {
+    return _mm512_permutexvar_epi32(
+        _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0),
+        v);
+  }
+  PSS_SIMD_TARGET static void minmax(vec& lo, vec& hi)
+  {
+    vec const mn = _mm512_min_epi32(lo, hi);
+    hi           = _mm512_max_epi32(lo, hi);
+    lo           = mn;
+  }
+  PSS_SIMD_TARGET static vec sort_bitonic(vec v)
+  {
+    vec t = _mm512_permutexvar_epi32(
+        _mm512_setr_epi32(8, 9, 10, 11, 12, 13, 14, 15, 0, 1, 2, 3, 4, 5, 6, 7),
+        v);
+    v = _mm512_mask_blend_epi32(
+        0xFF00, _mm512_min_epi32(v, t), _mm512_max_epi32(v, t));
+    t = _mm512_permutexvar_epi32(
+        _mm512_setr_epi32(4, 5, 6, 7, 0, 1, 2, 3, 12, 13, 14, 15, 8, 9, 10, 11),
+        v);
+    v = _mm512_mask_blend_epi32(
+        0xF0F0, _mm512_min_epi32(v, t), _mm512_max_epi32(v, t));
+    t = _mm512_permutexvar_epi32(
+        _mm512_setr_epi32(2, 3, 0, 1, 6, 7, 4, 5, 10, 11, 8, 9, 14, 15, 12, 13),
+        v);
+    v = _mm512_mask_blend_epi32(
+        0xCCCC, _mm512_min_epi32(v, t), _mm512_max_epi32(v, t));
+    t = _mm512_permutexvar_epi32(
+        _mm512_setr_epi32(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14),
+        v);
+    v = _mm512_mask_blend_epi32(
+        0xAAAA, _mm512_min_epi32(v, t), _mm512_max_epi32(v, t));
+    return v;
+  }
+};
+
+#elif defined(PSS_SIMD_MERGE_AVX2)
+
+template <>
+struct simd_merge_traits<double> {
+  static constexpr bool   enabled = true;
+  static constexpr size_t width   = 4;
+  typedef __m256d         vec;
+
+  PSS_SIMD_TARGET static vec load(double const* p)
+  {
+    return _mm256_loadu_pd(p);
+  }
+  PSS_SIMD_TARGET static void store(double* p, vec v)
+  {
+    _mm256_storeu_pd(p, v);
+  }
+  PSS_SIMD_TARGET static vec reverse(vec v)
+  {
+    return _mm256_permute4x64_pd(v, 0x1B);
+  }
+  PSS_SIMD_TARGET static void minmax(vec& lo, vec& hi)
+  {
+    vec const mn = _mm256_min_pd(lo, hi);
+    hi           = _mm256_max_pd(lo, hi);
+    lo           = mn;
+  }
+  PSS_SIMD_TARGET static vec sort_bitonic(vec v)
+  {
+    vec t = _mm256_permute2f128_pd(v, v, 0x01);
+    v     = _mm256_blend_pd(_mm256_min_pd(v, t), _mm256_max_pd(v, t), 0xC);
+    t     = _mm256_permute_pd(v, 0x5);
+    v     = _mm256_blend_pd(_mm256_min_pd(v, t), _mm256_max_pd(v, t), 0xA);
+    return v;
+  }
+};
+
+template <typename I64>
+struct simd_merge_traits_i64 {
+  static constexpr bool   enabled = true;
+  static constexpr size_t width   = 4;
+  typedef __m256i         vec;
+
+  PSS_SIMD_TARGET static vec load(I64 const* p)
+  {
+    return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+  }
+  PSS_SIMD_TARGET static void store(I64* p, vec v)
+  {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+  }
+  PSS_SIMD_TARGET static vec reverse(vec v)
+  {
+    return _mm256_permute4x64_epi64(v, 0x1B);
+  }
+  // AVX2 has no 64-bit min/max, select on a greater-than mask. The compare
+  // is signed, unsigned keys flip their sign bit first.
+  PSS_SIMD_TARGET static vec gt(vec a, vec b)
+  {
+    if (std::is_signed<I64>::value) return _mm256_cmpgt_epi64(a, b);
+    vec const bias = _mm256_set1_epi64x(std::numeric_limits<long long>::min());
+    return _mm256_cmpgt_epi64(
+        _mm256_xor_si256(a, bias), _mm256_xor_si256(b, bias));
+  }
+  PSS_SIMD_TARGET static vec min(vec a, vec b)
+  {
+    return _mm256_blendv_epi8(a, b, gt(a, b));
+  }
+  PSS_SIMD_TARGET static vec max(vec a, vec b)
+  {
+    return _mm256_blendv_epi8(b, a, gt(a, b));
+  }
+  PSS_SIMD_TARGET static void minmax(vec& lo, vec& hi)
+  {
+    vec const gt = simd_merge_traits_i64::gt(lo, hi);
+    vec const mn = _mm256_blendv_epi8(lo, hi, gt);
+    hi           = _mm256_blendv_epi8(hi, lo, gt);
+    lo           = mn;
+  }
+  PSS_SIMD_TARGET static vec sort_bitonic(vec v)
+  {
+    vec t = _mm256_permute4x64_epi64(v, 0x4E);
+    v     = _mm256_blend_epi32(min(v, t), max(v, t), 0xF0);
+    t     = _mm256_permute4x64_epi64(v, 0xB1);
+    v     = _mm256_blend_epi32(min(v, t), max(v, t), 0xCC);
+    return v;
+  }
+};
+
+template <>
+struct simd_merge_traits<float> {
+  static constexpr bool   enabled = true;
+  static constexpr size_t width   = 8;
+  typedef __m256          vec;
+
+  PSS_SIMD_TARGET static vec load(float const* p)
+  {
+    return _mm256_loadu_ps(p);
+  }
+  PSS_SIMD_TARGET static void store(float* p, vec v)
+  {
+    _mm256_storeu_ps(p, v);
+  }
+  PSS_SIMD_TARGET static vec reverse(vec v)
+  {
+    return _mm256_permutevar8x32_ps(
+        v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+  }
+  PSS_SIMD_TARGET static void minmax(vec& lo, vec& hi)
+  {
+    vec const mn = _mm256_min_ps(lo, hi);
+    hi           = _mm256_max_ps(lo, hi);
+    lo           = mn;
+  }
+  PSS_SIMD_TARGET static vec sort_bitonic(vec v)
+  {
+    vec t = _mm256_permute2f128_ps(v, v, 0x01);
+    v     = _mm256_blend_ps(_mm256_min_ps(v, t), _mm256_max_ps(v, t), 0xF0);
+    t     = _mm256_permute_ps(v, 0x4E);
+    v     = _mm256_blend_ps(_mm256_min_ps(v, t), _mm256_max_ps(v, t), 0xCC);
+    t     = _mm256_permute_ps(v, 0xB1);
+    v     = _mm256_blend_ps(_mm256_min_ps(v, t), _mm256_max_ps(v, t), 0xAA);
+    return v;
+  }
+};
+
+template <>
+struct simd_merge_traits<int> {
+  static constexpr bool   enabled = true;
+  static constexpr size_t width   = 8;
+  typedef __m256i         vec;
+
+  PSS_SIMD_TARGET static vec load(int const* p)
+  {
+    return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p));
+  }
+  PSS_SIMD_TARGET static void store(int* p, vec v)
+  {
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v);
+  }
+  PSS_SIMD_TARGET static vec reverse(vec v)
+  {
+    return _mm256_permutevar8x32_epi32(
+        v, _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+  }
+  PSS_SIMD_TARGET static void minmax(vec& lo, vec& hi)
+  {
+    vec const mn = _mm256_min_epi32(lo, hi);
+    hi           = _mm256_max_epi32(lo, hi);
+    lo           = mn;
+  }
+  PSS_SIMD_TARGET static vec sort_bitonic(vec v)
+  {
+    vec t = _mm256_permute2x128_si256(v, v, 0x01);
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xF0);
+    t = _mm256_shuffle_epi32(v, 0x4E);
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xCC);
+    t = _mm256_shuffle_epi32(v, 0xB1);
+    v = _mm256_blend_epi32(_mm256_min_epi32(v, t), _mm256_max_epi32(v, t), 0xAA);
+    return v;
+  }
+};
+
+#endif
+
+#if defined(PSS_SIMD_MERGE_AVX2) || defined(PSS_SIMD_MERGE_AVX512)
+//! long and long long are distinct types even if both are 64-bit wide,
+//! likewise their unsigned counterparts (e.g. uint64_t)
+template <>
+struct simd_merge_traits<long>
+  : std::conditional<
+        sizeof(long) == 8,
+        simd_merge_traits_i64<long>,
+        simd_merge_traits<void>>::type {
+};
+
+template <>
+struct simd_merge_traits<unsigned long>
+  : std::conditional<
+        sizeof(unsigned long) == 8,
+        simd_merge_traits_i64<unsigned long>,
+        simd_merge_traits<void>>::type {
+};
+
+template <>
+struct simd_merge_traits<long long> : simd_merge_traits_i64<long long> {
+};
+
+template <>
+struct simd_merge_traits<unsigned long long>
+  : simd_merge_traits_i64<unsigned long long> {
+};
+#endif
+
+//! Iterators we may safely convert to a raw pointer via &*it
+template <typename It, typename T>
+struct is_contiguous_iterator
+  : std::integral_constant<
+        bool,
+        std::is_same<It, T*>::value ||
+            std::is_same<It, T const*>::value ||
+            std::is_same<It, typename std::vector<T>::iterator>::value ||
+            std::is_same<It, typename std::vector<T>::const_iterator>::value> {
+};
+
+template <typename Compare, typename T>
+struct is_ascending_compare : std::is_same<Compare, std::less<T>> {
+};
+
+//! Compile time selection of the bitonic merge path: all sequences are
+//! contiguous, share an arithmetic value type with a SIMD specialization and
+//! are merged in ascending order.
+template <
+    class RandomAccessIterator1,
+    class RandomAccessIterator2,
+    class RandomAccessIterator3,
+    class Compare>
+struct use_simd_merge {
+  typedef typename std::iterator_traits<RandomAccessIterator1>::value_type T;
+
+  static constexpr bool value =
+      simd_merge_traits<T>::enabled &&
+      std::is_same<
+          T,
+          typename std::iterator_traits<
+              RandomAccessIterator2>::value_type>::value &&
+      std::is_same<
+          T,
+          typename std::iterator_traits<
+              RandomAccessIterator3>::value_type>::value &&
+      is_contiguous_iterator<RandomAccessIterator1, T>::value &&
+      is_contiguous_iterator<RandomAccessIterator2, T>::value &&
+      is_contiguous_iterator<RandomAccessIterator3, T>::value &&
+      is_ascending_compare<Compare, T>::value;
+};
+
+//! Streaming bitonic merge (Inoue et al.): merge two sorted registers with a
+//! bitonic network, emit the lower half and carry the upper half into the
+//! next step which loads from the input with the smaller head. The only
+//! data-dependent decision left is one (cmov-able) select per register width.
+//!
+//! Note that min/max do not preserve the relative order of keys comparing
+//! equal, which is only observable for signed zeros.
+template <typename T>
+PSS_SIMD_TARGET void simd_move_merge(
+    T const* xs, T const* xe, T const* ys, T const* ye, T* zs)
+{
+  typedef simd_merge_traits<T> simd;
+  typedef typename simd::vec   vec;
+
+  constexpr std::ptrdiff_t W = simd::width;
+
+  if (xe - xs < W || ye - ys < W) {
+    serial_move_merge_scalar(xs, xe, ys, ye, zs, std::less<T>());
+    return;
+  }
+
+  vec lo = simd::load(xs);
+  vec hi = simd::reverse(simd::load(ys));
+  xs += W;
+  ys += W;
+
+  for (;;) {
+    simd::minmax(lo, hi);
+    simd::store(zs, simd::sort_bitonic(lo));
+    zs += W;
+    hi = simd::sort_bitonic(hi);
+
+    if (xe - xs < W || ye - ys < W) break;
+
+    bool const     takex = *xs < *ys;
+    T const* const src   = takex ? xs : ys;
+    xs += takex ? W : 0;
+    ys += takex ? 0 : W;
+
+    lo = simd::load(src);
+    hi = simd::reverse(hi);
+  }
+
+  // hi carries W elements which are not less than anything emitted so far.
+  // Merge it with the shorter remainder on the stack, then scalar merge the
+  // result with the longer remainder.
+  T carry[W];
+  simd::store(carry, hi);
+
+  bool const xshort = xe - xs < W;
+
+  T const* ss = xshort ? xs : ys;
+  T const* se = xshort ? xe : ye;
+  T const* ls = xshort ? ys : xs;
+  T const* le = xshort ? ye : xe;
+
+  T tmp[2 * W];
+  serial_move_merge_scalar(carry, carry + W, ss, se, tmp, std::less<T>());
+  serial_move_merge_scalar(
+      tmp, tmp + W + (se - ss), ls, le, zs, std::less<T>());
+}
+
+template <
+    class RandomAccessIterator1,
+    class RandomAccessIterator2,
+    class RandomAccessIterator3,
+    class Compare>
+void serial_move_merge_dispatch(
+    RandomAccessIterator1 xs,
+    RandomAccessIterator1 xe,
+    RandomAccessIterator2 ys,
+    RandomAccessIterator2 ye,
+    RandomAccessIterator3 zs,
+    Compare               comp,
+    std::true_type)
+{
+  if (xs == xe || ys == ye) {
+    serial_move_merge_scalar(xs, xe, ys, ye, zs, comp);
+    return;
+  }
+  simd_move_merge(
+      std::addressof(*xs),
+      std::addressof(*xs) + (xe - xs),
+      std::addressof(*ys),
+      std::addressof(*ys) + (ye - ys),
+      std::addressof(*zs));
+}
+
+template <
+    class RandomAccessIterator1,
+    class RandomAccessIterator2,
+    class RandomAccessIterator3,
+    class Compare>
+void serial_move_merge_dispatch(
+    RandomAccessIterator1 xs,
+    RandomAccessIterator1 xe,
+    RandomAccessIterator2 ys,
+    RandomAccessIterator2 ye,
+    RandomAccessIterator3 zs,
+    Compare               comp,
+    std::false_type)
+{
+  serial_move_merge_scalar(xs, xe, ys, ye, zs, comp);
+}
+
+//! Merge sequences [xs,xe) and [ys,ye) to output sequence
+//! [zs,(xe-xs)+(ye-ys)), using std::move
+template <
+    class RandomAccessIterator1,
+    class RandomAccessIterator2,
+    class RandomAccessIterator3,
+    class Compare>
+void serial_move_merge(
+    RandomAccessIterator1 xs,
+    RandomAccessIterator1 xe,
+    RandomAccessIterator2 ys,
+    RandomAccessIterator2 ye,
+    RandomAccessIterator3 zs,
+    Compare               comp)
+{
+  typedef use_simd_merge<
+      RandomAccessIterator1,
+      RandomAccessIterator2,
+      RandomAccessIterator3,
+      Compare>
+      dispatch;
+
+  serial_move_merge_dispatch(
+      xs,
+      xe,
+      ys,
+      ye,
+      zs,
+      comp,
+      std::integral_constant<bool, dispatch::value>());
+}
+
 template <
     typename RandomAccessIterator1,
     typename RandomAccessIterator2,
@@ -110,14 +739,241 @@ void stable_sort_base_case(
   }
 }
 
+//! Runtime cut-offs for the value type of RandomAccessIterator
+template <typename RandomAccessIterator>
+inline size_t sort_cut_off()
+{
+  typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+  return cut_offs_for<T>().sort;
+}
+
+template <typename RandomAccessIterator>
+inline size_t merge_cut_off()
+{
+  typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+  return cut_offs_for<T>().merge;
+}
+
+//! Exact multi-sequence selection: positions pos[i] into the sorted
+//! sequences seqs[i] such that sum(pos) == rank and the elements in front
+//! of them are the rank smallest. Equal keys are ordered by sequence index,
+//! i.e. a merge of the split parts is stable. Every step halves the largest
+//! candidate window and binary searches the pivot in all windows.
+template <typename RandomAccessIterator, typename Compare>
+void multiway_split(
+    std::vector<std::pair<RandomAccessIterator, RandomAccessIterator>> const&
+                         seqs,
+    size_t               rank,
+    Compare              comp,
+    std::vector<size_t>& pos)
+{
+  size_t const        k = seqs.size();
+  std::vector<size_t> lo(k, 0), hi(k);
+  for (size_t i = 0; i < k; ++i) {
+    hi[i] = static_cast<size_t>(seqs[i].second - seqs[i].first);
+  }
+  pos.assign(k, 0);
+
+  for (;;) {
+    // pivot: middle of the largest window
+    size_t s = 0;
+    for (size_t i = 1; i < k; ++i) {
+      if (hi[i] - lo[i] > hi[s] - lo[s]) s = i;
+    }
+    if (hi[s] == lo[s]) {
+      // all windows are empty
+      pos = lo;
+      return;
+    }
+    size_t const m     = lo[s] + (hi[s] - lo[s]) / 2;
+    auto const&  pivot = *(seqs[s].first + m);
+
+    // rank of the pivot in every window, clamped to the window
+    size_t r = 0;
+    for (size_t i = 0; i < k; ++i) {
+      auto const first = seqs[i].first;
+      if (i == s) {
+        pos[i] = m;
+      }
+      else if (i < s) {
+        pos[i] = static_cast<size_t>(
+            std::upper_bound(first + lo[i], first + hi[i], pivot, comp) -
+            first);
+      }
+      else {
+        pos[i] = static_cast<size_t>(
+            std::lower_bound(first + lo[i], first + hi[i], pivot, comp) -
+            first);
+      }
+      r += pos[i];
+    }
+
+    if (r == rank) return;
+    if (r < rank) {
+      lo = pos;
+      lo[s] = m + 1;
+    }
+    else {
+      hi = pos;
+    }
+  }
+}
+
+//! Merge the sorted sequences seqs to [zs, zs + sum of their lengths) with
+//! a loser tree, equal keys are taken in sequence order. Destroy the input
+//! sequences iff destroy==true.
+template <
+    typename RandomAccessIterator1,
+    typename RandomAccessIterator2,
+    typename Compare>
+void serial_multiway_merge(
+    std::vector<std::pair<RandomAccessIterator1, RandomAccessIterator1>> seqs,
+    RandomAccessIterator2                                                zs,
+    bool    destroy,
+    Compare comp)
+{
+  size_t const k = seqs.size();
+
+  if (k == 1 || k == 2) {
+    if (k == 1)
+      std::move(seqs[0].first, seqs[0].second, zs);
+    else
+      serial_move_merge(
+          seqs[0].first, seqs[0].second, seqs[1].first, seqs[1].second, zs,
+          comp);
+    if (destroy)
+      for (auto const& seq : seqs) serial_destroy(seq.first, seq.second);
+    return;
+  }
+
+  std::vector<RandomAccessIterator1> cur(k);
+  for (size_t i = 0; i < k; ++i) cur[i] = seqs[i].first;
+
+  // leaves padded to a power of two, padding leaves are exhausted
+  size_t leaves = 1;
+  while (leaves < k) leaves *= 2;
+
+  auto const exhausted = [&](size_t i) {
+    return i >= k || cur[i] == seqs[i].second;
+  };
+  // true if the head of sequence a is taken before the head of b
+  auto const wins = [&](size_t a, size_t b) {
+    if (exhausted(a)) return false;
+    if (exhausted(b)) return true;
+    if (comp(*cur[b], *cur[a])) return false;
+    return comp(*cur[a], *cur[b]) || a < b;
+  };
+
+  // tree[0] is the overall winner, tree[1, leaves) the losers of the inner
+  // nodes; built bottom up from the winners of the subtrees
+  std::vector<size_t> tree(leaves), winner(2 * leaves);
+  for (size_t leaf = 0; leaf < leaves; ++leaf) winner[leaves + leaf] = leaf;
+  for (size_t node = leaves - 1; node > 0; --node) {
+    auto const a = winner[2 * node];
+    auto const b = winner[2 * node + 1];
+    bool const w = wins(a, b);
+    winner[node] = w ? a : b;
+    tree[node]   = w ? b : a;
+  }
+  tree[0] = winner[1];
+
+  for (;;) {
+    auto w = tree[0];
+    if (exhausted(w)) break;
+    *zs = std::move(*cur[w]);
+    ++zs;
+    ++cur[w];
+    // replay the matches on the path of the winner
+    for (size_t node = (leaves + w) / 2; node > 0; node /= 2) {
+      if (wins(tree[node], w)) std::swap(tree[node], w);
+    }
+    tree[0] = w;
+  }
+
+  if (destroy)
+    for (auto const& seq : seqs) serial_destroy(seq.first, seq.second);
+}
+
+//! Part j of nparts of a parallel multiway merge: the output range
+//! [n * j / nparts, n * (j + 1) / nparts) is split off all sequences exactly
+//! and merged serially. The parts are independent, the backends run them in
+//! parallel.
+template <
+    typename RandomAccessIterator1,
+    typename RandomAccessIterator2,
+    typename Compare>
+void multiway_merge_part(
+    std::vector<std::pair<RandomAccessIterator1, RandomAccessIterator1>> const&
+                          seqs,
+    size_t                j,
+    size_t                nparts,
+    RandomAccessIterator2 zs,
+    bool                  destroy,
+    Compare               comp)
+{
+  size_t n = 0;
+  for (auto const& seq : seqs) n += seq.second - seq.first;
+
+  size_t const lo = n * j / nparts;
+  size_t const hi = n * (j + 1) / nparts;
+  if (lo == hi) return;
+
+  std::vector<size_t> pos_lo, pos_hi;
+  multiway_split(seqs, lo, comp, pos_lo);
+  multiway_split(seqs, hi, comp, pos_hi);
+
+  std::vector<std::pair<RandomAccessIterator1, RandomAccessIterator1>> part;
+  part.reserve(seqs.size());
+  for (size_t i = 0; i < seqs.size(); ++i) {
+    if (pos_lo[i] == pos_hi[i]) continue;
+    part.emplace_back(seqs[i].first + pos_lo[i], seqs[i].first + pos_hi[i]);
+  }
+  serial_multiway_merge(part, zs + lo, destroy, comp);
+}
+
+//! Number of sorted runs for parallel_stable_sort_multiway: one per thread,
+//! zero (i.e. the binary merge tree) if the runs would be tiny
+inline size_t multiway_runs(size_t n, size_t nthreads)
+{
+  const size_t MIN_RUN = 1 << 14;
+  return (nthreads > 1 && n / nthreads >= MIN_RUN) ? nthreads : 0;
+}
+
 //! Raw memory buffer with automatic cleanup.
+//! Allocation functions of raw_buffer. allocate returns NULL on failure,
+//! deallocate receives the size passed to allocate.
+struct buffer_allocator {
+  void* (*allocate)(size_t bytes);
+  void (*deallocate)(void* ptr, size_t bytes);
+};
+
+inline void* default_allocate(size_t bytes)
+{
+  return operator new(bytes, std::nothrow);
+}
+
+inline void default_deallocate(void* ptr, size_t)
+{
+  operator delete(ptr);
+}
+
+//! Allocator of all raw_buffers, e.g. to back the scratch buffer with huge
+//! pages. Must not be changed while a buffer is alive.
+inline buffer_allocator& raw_buffer_allocator()
+{
+  static buffer_allocator alloc = {&default_allocate, &default_deallocate};
+  return alloc;
+}
+
 class raw_buffer {
-  void* ptr;
+  void*  ptr;
+  size_t nbytes;
 
 public:
   //! Try to obtain buffer of given size.
   raw_buffer(size_t bytes)
-    : ptr(operator new(bytes, std::nothrow))
+    : ptr(raw_buffer_allocator().allocate(bytes))
+    , nbytes(bytes)
   {
   }
   //! True if buffer was successfully obtained, zero otherwise.
@@ -133,12 +989,72 @@ public:
   //! Destroy buffer
   ~raw_buffer()
   {
-    operator delete(ptr);
+    if (ptr) raw_buffer_allocator().deallocate(ptr, nbytes);
   }
 };
 
 }  // namespace internal
 
+//! Code path taken by a top-level parallel_stable_sort
+enum class sort_path {
+  //! parallel merge sort with a freshly allocated buffer
+  buffered,
+  //! parallel merge sort with the caller supplied arena
+  arena,
+  //! the buffer could not be allocated, serial std::stable_sort
+  serial_fallback,
+  //! per-thread runs and a multiway merge with a freshly allocated buffer
+  multiway,
+  //! per-thread runs and a multiway merge with the caller supplied arena
+  multiway_arena
+};
+
+//! Path taken by the last top-level parallel_stable_sort of this process
+inline sort_path& last_sort_path()
+{
+  static sort_path path = sort_path::buffered;
+  return path;
+}
+
+inline char const* to_string(sort_path path)
+{
+  switch (path) {
+    case sort_path::buffered: return "buffered";
+    case sort_path::arena: return "arena";
+    case sort_path::serial_fallback: return "serial_fallback";
+    case sort_path::multiway: return "multiway";
+    case sort_path::multiway_arena: return "multiway_arena";
+  }
+  return "unknown";
+}
+
+//! Caller owned scratch memory for parallel_stable_sort. The arena does not
+//! own the memory, which allows the caller to allocate (and pre-fault) it
+//! once and reuse it across calls.
+class scratch_arena {
+  void*  ptr;
+  size_t nbytes;
+
+public:
+  scratch_arena(void* ptr_, size_t nbytes_)
+    : ptr(ptr_)
+    , nbytes(nbytes_)
+  {
+  }
+  //! Return typed pointer to the arena if it can hold n objects of type T,
+  //! NULL otherwise.
+  template <typename T>
+  T* get(size_t n) const
+  {
+    return (sizeof(T) * n <= nbytes) ? static_cast<T*>(ptr) : NULL;
+  }
+  //! Capacity in bytes
+  size_t size() const
+  {
+    return nbytes;
+  }
+};
+
 //! Wrapper for sorting with default comparator.
 template <class RandomAccessIterator>
 void parallel_stable_sort(RandomAccessIterator xs, RandomAccessIterator xe)
@@ -148,3 +1064,4 @@ void parallel_stable_sort(RandomAccessIterator xs, RandomAccessIterator xe)
 }
 
 }  // namespace pss
+#endif
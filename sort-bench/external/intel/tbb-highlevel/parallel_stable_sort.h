@@ -32,7 +32,11 @@
 #ifndef PARALLEL_STABLE_SORT_H
 #define PARALLEL_STABLE_SORT_H
 #include <algorithm>
+#include <utility>
+#include <vector>
+#include <tbb/parallel_for.h>
 #include <tbb/parallel_invoke.h>
+#include <tbb/task_arena.h>
 
 #include "../pss_common.h"
 
@@ -43,7 +47,7 @@ namespace internal {
 // Merge sequences [xs,xe) and [ys,ye) to output sequence [zs,zs+(xe-xs)+(ye-ys))
 template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename RandomAccessIterator3, typename Compare>
 void parallel_merge( RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomAccessIterator2 ys, RandomAccessIterator2 ye, RandomAccessIterator3 zs, bool destroy, Compare comp ) {
-    const size_t MERGE_CUT_OFF = 2000;
+    const size_t MERGE_CUT_OFF = merge_cut_off<RandomAccessIterator1>();
     auto n = (xe-xs) + (ye-ys);
     if( n <= MERGE_CUT_OFF ) {
         serial_move_merge( xs, xe, ys, ye, zs, comp );
@@ -71,7 +75,7 @@ void parallel_merge( RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomA
 // Result is in [xs,xe) if inplace==true, otherwise in [zs,zs+(xe-xs))
 template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename Compare>
 void parallel_stable_sort_aux( RandomAccessIterator1 xs, RandomAccessIterator1 xe, RandomAccessIterator2 zs, int inplace, Compare comp ) {
-    const size_t SORT_CUT_OFF = 500;
+    const size_t SORT_CUT_OFF = sort_cut_off<RandomAccessIterator1>();
     if( xe-xs<=SORT_CUT_OFF ) {
         stable_sort_base_case(xs, xe, zs, inplace, comp);
     } else {
@@ -87,16 +91,94 @@ void parallel_stable_sort_aux( RandomAccessIterator1 xs, RandomAccessIterator1 x
    }
 }
 
+// Merges seqs to [zs,zs+n) with one task per exact split of the output.
+template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename Compare>
+void parallel_multiway_merge_aux( std::vector<std::pair<RandomAccessIterator1, RandomAccessIterator1>> const& seqs, RandomAccessIterator2 zs, size_t nparts, bool destroy, Compare comp ) {
+    tbb::parallel_for( size_t(0), nparts, [&]( size_t j ) {
+        multiway_merge_part( seqs, j, nparts, zs, destroy, comp );
+    } );
+}
+
+// Sorts [xs,xe) as nruns runs sorted into z[0:xe-xs), which are merged back
+// to [xs,xe) with a single multiway merge. Moves the data once for the merge
+// instead of once per level of the top log2(nruns) levels of the merge tree.
+template<typename RandomAccessIterator, typename T, typename Compare>
+void parallel_stable_sort_multiway_buffered( RandomAccessIterator xs, RandomAccessIterator xe, T* z, size_t nruns, Compare comp ) {
+    size_t const n = xe-xs;
+    std::vector<std::pair<T*, T*>> runs;
+    for( size_t r = 0; r < nruns; ++r )
+        runs.emplace_back( z + n*r/nruns, z + n*(r+1)/nruns );
+    tbb::parallel_for( size_t(0), nruns, [&]( size_t r ) {
+        parallel_stable_sort_aux( xs + (runs[r].first-z), xs + (runs[r].second-z), runs[r].first, 0, comp );
+    } );
+    parallel_multiway_merge_aux( runs, xs, nruns, true, comp );
+}
+
 } // namespace internal
 
 template<typename RandomAccessIterator, typename Compare>
 void parallel_stable_sort( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp ) {
     typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
-    if( internal::raw_buffer z = internal::raw_buffer( sizeof(T)*(xe-xs) ) )
+    if( internal::raw_buffer z = internal::raw_buffer( sizeof(T)*(xe-xs) ) ) {
+        last_sort_path() = sort_path::buffered;
         internal::parallel_stable_sort_aux( xs, xe, (T*)z.get(), 2, comp );
-    else
+    } else {
         // Not enough memory available - fall back on serial sort
+        last_sort_path() = sort_path::serial_fallback;
         std::stable_sort( xs, xe, comp );
+    }
+}
+
+//! Sort with a caller supplied scratch arena instead of allocating a fresh
+//! buffer. Falls back to the allocating variant if the arena is too small.
+template<typename RandomAccessIterator, typename Compare>
+void parallel_stable_sort( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp, scratch_arena const& arena ) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    if( T* z = arena.get<T>( xe-xs ) ) {
+        last_sort_path() = sort_path::arena;
+        internal::parallel_stable_sort_aux( xs, xe, z, 2, comp );
+    } else
+        parallel_stable_sort( xs, xe, comp );
+}
+
+//! Merge the sorted sequences seqs to [zs,zs+n), n the sum of their lengths,
+//! with an exact split of the output across the threads. Keys comparing
+//! equal are taken in sequence order, i.e. the merge is stable.
+template<typename RandomAccessIterator1, typename RandomAccessIterator2, typename Compare>
+void parallel_multiway_merge( std::vector<std::pair<RandomAccessIterator1, RandomAccessIterator1>> const& seqs, RandomAccessIterator2 zs, Compare comp ) {
+    if( seqs.empty() ) return;
+    internal::parallel_multiway_merge_aux( seqs, zs, tbb::this_task_arena::max_concurrency(), false, comp );
+}
+
+//! Sort with per-thread runs and a single multiway merge instead of the
+//! binary merge tree. Falls back to parallel_stable_sort for small inputs.
+template<typename RandomAccessIterator, typename Compare>
+void parallel_stable_sort_multiway( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp ) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    size_t const nruns = internal::multiway_runs( xe-xs, tbb::this_task_arena::max_concurrency() );
+    if( nruns == 0 ) {
+        parallel_stable_sort( xs, xe, comp );
+    } else if( internal::raw_buffer z = internal::raw_buffer( sizeof(T)*(xe-xs) ) ) {
+        last_sort_path() = sort_path::multiway;
+        internal::parallel_stable_sort_multiway_buffered( xs, xe, (T*)z.get(), nruns, comp );
+    } else {
+        last_sort_path() = sort_path::serial_fallback;
+        std::stable_sort( xs, xe, comp );
+    }
+}
+
+template<typename RandomAccessIterator, typename Compare>
+void parallel_stable_sort_multiway( RandomAccessIterator xs, RandomAccessIterator xe, Compare comp, scratch_arena const& arena ) {
+    typedef typename std::iterator_traits<RandomAccessIterator>::value_type T;
+    size_t const nruns = internal::multiway_runs( xe-xs, tbb::this_task_arena::max_concurrency() );
+    T* z = arena.get<T>( xe-xs );
+    if( nruns != 0 && z ) {
+        last_sort_path() = sort_path::multiway_arena;
+        internal::parallel_stable_sort_multiway_buffered( xs, xe, z, nruns, comp );
+    } else if( nruns != 0 )
+        parallel_stable_sort_multiway( xs, xe, comp );
+    else
+        parallel_stable_sort( xs, xe, comp, arena );
 }
 
 } // namespace pss
@@ -1,16 +1,27 @@
 #ifndef SORTBENCH_H__INCLUDED
 #define SORTBENCH_H__INCLUDED
 
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <iostream>
 #include <random>
+#include <vector>
 
 #include <dash/Array.h>
 #include <dash/algorithm/Generate.h>
 #include <dash/algorithm/LocalRange.h>
 #include <dash/algorithm/Sort.h>
 
+#include <util/Bandwidth.h>
+#include <util/Exchange.h>
 #include <util/Logging.h>
+#include <util/Numa.h>
+#include <util/Memory.h>
 #include <util/Random.h>
+#include <util/Timer.h>
+#include <util/Types.h>
+#include <util/Verify.h>
 
 namespace sortbench {
 
@@ -39,6 +50,128 @@ inline void parallel_rand(RandomIt begin, RandomIt end, Gen const g)
   begin.pattern().team().barrier();
 }
 
+//! Apply the page placement to the local partition before it is generated.
+//! Pages are already faulted in by the allocation and get migrated.
+//! Placement::bind binds them to the node this unit runs on.
+template <typename RandomIt>
+inline void parallel_place(
+    RandomIt begin, RandomIt end, numa::Placement placement)
+{
+  assert(!(end < begin));
+
+  using pointer = typename std::iterator_traits<RandomIt>::pointer;
+  using value_t = typename dash::iterator_traits<RandomIt>::value_type;
+
+  auto const l_range = dash::local_index_range(begin, end);
+
+  auto* lbegin = dash::local_begin(
+      static_cast<pointer>(begin), begin.pattern().team().myid());
+  auto const nl = l_range.end - l_range.begin;
+
+  numa::place(lbegin, nl * sizeof(value_t), placement);
+
+  begin.pattern().team().barrier();
+}
+
+template <typename GlobIt>
+inline void sort_impl(GlobIt begin, GlobIt end, std::false_type)
+{
+  dash::sort(begin, end);
+}
+
+template <typename GlobIt>
+inline void sort_impl(GlobIt begin, GlobIt end, std::true_type)
+{
+  using value_t = typename dash::iterator_traits<GlobIt>::value_type;
+
+  dash::sort(begin, end, [](value_t const& v) {
+    return record_traits<value_t>::key(v);
+  });
+}
+
+namespace incremental {
+
+//! True if the last sort was parallel_resort
+inline bool& last_used()
+{
+  static bool used = false;
+  return used;
+}
+
+//! Bytes the last parallel_resort sent to other units
+inline size_t& last_exchanged()
+{
+  static size_t bytes = 0;
+  return bytes;
+}
+
+//! Element type for the exchange, keeps the counts in elements
+template <typename T>
+struct mpi_type {
+  MPI_Datatype type;
+
+  mpi_type()
+  {
+    MPI_Type_contiguous(sizeof(T), MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+  }
+
+  ~mpi_type()
+  {
+    MPI_Type_free(&type);
+  }
+};
+
+//! Rank of this unit in MPI_COMM_WORLD, which addresses the units in the
+//! exchanges of parallel_resort and splitters. DART-MPI builds the units of
+//! dash::Team::All() from MPI_COMM_WORLD in rank order; the first call
+//! checks that and aborts the job otherwise. Collective on the first call.
+inline int world_rank()
+{
+  static int const rank = [] {
+    int nranks, r;
+    MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+    MPI_Comm_rank(MPI_COMM_WORLD, &r);
+    int const match = static_cast<size_t>(nranks) == dash::size() &&
+                      static_cast<int>(dash::myid()) == r;
+    int all;
+    MPI_Allreduce(&match, &all, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+    if (!all) {
+      std::cerr << "incremental sort: DASH unit ids differ from the ranks "
+                   "of MPI_COMM_WORLD\n";
+      MPI_Abort(MPI_COMM_WORLD, 1);
+    }
+    return r;
+  }();
+  return rank;
+}
+
+}  // namespace incremental
+
+//! Code path taken by the last parallel_sort or parallel_resort
+inline char const* sort_path()
+{
+  return incremental::last_used() ? "incremental" : "dash::sort";
+}
+
+//! Bytes moved through memory by parallel_sort of n local keys, the local
+//! sort of dash::sort is std::sort
+template <typename T>
+inline double sort_traffic(size_t n)
+{
+  return traffic::distributed_sort(
+      n,
+      sizeof(T),
+      traffic::quick_sort(n, sizeof(T), traffic::INTROSORT_CUT_OFF));
+}
+
+//! Bytes moved through memory by parallel_resort of n local keys
+template <typename T>
+inline double resort_traffic(size_t n)
+{
+  return traffic::incremental_sort(n, sizeof(T));
+}
+
 template <typename Container, typename Cmp>
 inline void parallel_sort(Container& c, Cmp cmp)
 {
@@ -46,58 +179,281 @@ inline void parallel_sort(Container& c, Cmp cmp)
   auto end   = c.end();
   assert(!(end < begin));
 
-  dash::sort(begin, end);
+  using value_t = typename Container::value_type;
+
+  incremental::last_used() = false;
+
+  // dash::sort takes a projection to an arithmetic key for records
+  sort_impl(
+      begin,
+      end,
+      std::integral_constant<bool, record_traits<value_t>::is_record>{});
 
   // implicit barrier in dash::sort
 }
 
-template <typename RandomIt, typename Cmp>
-inline bool parallel_verify(RandomIt begin, RandomIt end, Cmp cmp)
+//! Sort of the keys by a single unit, i.e. the local sort of dash::sort
+//! only, the baseline of the parallel efficiency (--scaling)
+template <typename Container, typename Cmp>
+inline void baseline_sort(Container& c, Cmp cmp)
 {
-  assert(!(end < begin));
+  std::sort(c.begin(), c.end(), cmp);
+}
 
-  using value_t = typename dash::iterator_traits<RandomIt>::value_type;
+//! Splitters of the sorted keys in c: the first local key of every unit but
+//! unit 0, i.e. unit u holds the keys in [s[u - 1], s[u]] and keys equal to
+//! s[u] also go to unit u + 1. Collective.
+template <typename Container>
+std::vector<typename Container::value_type> splitters(Container& c)
+{
+  using value_t = typename Container::value_type;
 
-  auto const n = static_cast<size_t>(std::distance(begin, end));
+  // unit u is rank u of MPI_COMM_WORLD
+  incremental::world_rank();
 
-  auto const l_range = dash::local_index_range(begin, end);
+  // every unit holds at least one key
+  assert(c.lsize() > 0);
 
-  using pointer = typename std::iterator_traits<RandomIt>::pointer;
+  std::vector<value_t> first(dash::size());
+  MPI_Allgather(
+      c.lbegin(),
+      sizeof(value_t),
+      MPI_BYTE,
+      first.data(),
+      sizeof(value_t),
+      MPI_BYTE,
+      MPI_COMM_WORLD);
+  first.erase(first.begin());
+  return first;
+}
 
-  auto* lbegin = dash::local_begin(
-      static_cast<pointer>(begin), begin.pattern().team().myid());
-  auto*      lend = std::next(lbegin, l_range.end);
-  auto const nl   = l_range.end - l_range.begin;
+//! Changes the fraction of the local keys of c for iteration iter to new
+//! keys of the distribution gen, i.e. the keys at random global indices.
+//! Returns the local positions of the changed keys in ascending order.
+template <typename Container, typename Gen>
+std::vector<size_t> parallel_perturb(
+    Container& c, Gen const g, double fraction, size_t iter)
+{
+  auto const n  = static_cast<size_t>(c.size());
+  auto const nl = static_cast<size_t>(c.lsize());
+  auto*      lbegin = c.lbegin();
+
+  std::vector<size_t> dirty;
+  for (size_t idx = 0; idx < nl; ++idx) {
+    auto const gidx = static_cast<uint64_t>(c.pattern().global(idx));
+    auto const r    = counter_rng(iter * n + gidx, rng_stream::perturb);
+    if (to_unit(r.v[0], r.v[1]) < fraction) {
+      auto const src =
+          ((static_cast<uint64_t>(r.v[2]) << 32) | r.v[3]) % n;
+      lbegin[idx] = g(n, src);
+      dirty.push_back(idx);
+    }
+  }
+
+  c.pattern().team().barrier();
+  return dirty;
+}
+
+//! Incremental re-sort of c after the local keys at the positions dirty
+//! (ascending) changed, c having been sorted with the given splitters
+//! before. The unchanged keys stay on their unit in order: only the changed
+//! keys that now belong to another unit are sent (a single all-to-all), the
+//! units merge the received runs with their unchanged keys and a final
+//! exchange restores the local key counts of the array, which only moves
+//! keys across unit boundaries. The splitters are updated to the new
+//! boundaries. Collective.
+template <typename Container, typename Cmp>
+inline void parallel_resort(
+    Container&                                   c,
+    Cmp                                          cmp,
+    std::vector<typename Container::value_type>& split,
+    std::vector<size_t> const&                   dirty)
+{
+  using value_t = typename Container::value_type;
+
+  incremental::last_used()      = true;
+  incremental::last_exchanged() = 0;
+
+  auto const     me   = incremental::world_rank();
+  auto const     P    = static_cast<size_t>(dash::size());
+  auto const     n    = static_cast<size_t>(c.lsize());
+  value_t* const keys = c.lbegin();
 
-  size_t nerror = 0;
+  assert(split.size() + 1 == P);
 
-  for (size_t idx = 1; idx < nl; ++idx) {
-    auto const it = lbegin + idx;
-    if (cmp(*it, *(it - 1))) {
-      LOG("Failed local order: {prev: " << *(it - 1) << ", cur: " << *it
-                                        << "}");
-      ++nerror;
+  // the changed keys, sorted, and the unchanged keys compacted in place
+  std::vector<value_t> changed(dirty.size());
+  size_t               nclean = 0;
+  {
+    ScopedPhase phase("local_sort");
+    size_t      prev = 0;
+    for (size_t d = 0; d < dirty.size(); ++d) {
+      changed[d] = keys[dirty[d]];
+      nclean     = static_cast<size_t>(
+          std::move(keys + prev, keys + dirty[d], keys + nclean) - keys);
+      prev = dirty[d] + 1;
     }
+    nclean = static_cast<size_t>(
+        std::move(keys + prev, keys + n, keys + nclean) - keys);
+    std::sort(changed.begin(), changed.end(), cmp);
   }
 
-  if (nerror > 0) return false;
+  incremental::mpi_type<value_t> const type;
 
-  auto const myid = begin.pattern().team().myid();
+  Exchange ex(P);
 
-  if (myid > 0) {
-    auto const gidx0    = begin.pattern().global(0);
-    auto const prev_idx = gidx0 - 1;
-    auto const prev     = static_cast<value_t>(*(begin + prev_idx));
-    if (cmp(lbegin[0], prev)) {
-      LOG("Failed global order: {prev: " << prev << ", cur: " << lbegin[0]
-                                         << "}");
-      ++nerror;
+  auto const alltoallv = [&](value_t const* src, value_t* dst) {
+    ex.alltoallv(src, dst, type.type, MPI_COMM_WORLD);
+    for (size_t rank = 0; rank < P; ++rank) {
+      if (rank != static_cast<size_t>(me)) {
+        incremental::last_exchanged() += ex.scounts[rank] * sizeof(value_t);
+      }
+    }
+  };
+
+  // the changed keys of every unit, a sorted run per sender
+  std::vector<value_t> recv;
+  std::vector<size_t>  runs(P + 1, 0);
+  {
+    ScopedPhase phase("exchange");
+    size_t      lo = 0;
+    for (size_t rank = 0; rank < P; ++rank) {
+      auto const hi =
+          rank + 1 < P
+              ? static_cast<size_t>(
+                    std::lower_bound(
+                        changed.begin(), changed.end(), split[rank], cmp) -
+                    changed.begin())
+              : changed.size();
+      ex.sdispls[rank] = lo;
+      ex.scounts[rank] = hi - lo;
+      lo               = hi;
+    }
+    recv.resize(ex.recv_counts(MPI_COMM_WORLD));
+    alltoallv(changed.data(), recv.data());
+    for (size_t rank = 0; rank < P; ++rank) {
+      runs[rank + 1] = runs[rank] + ex.rcounts[rank];
     }
   }
 
-  begin.pattern().team().barrier();
+  // scratch of the merge, mapped as --pages requests
+  std::vector<value_t, default_init_allocator<value_t, page_allocator<value_t>>>
+      merged;
+  {
+    ScopedPhase phase("merge");
+    // the received runs pairwise, then with the unchanged keys
+    std::vector<value_t> tmp(recv.size());
+    while (runs.size() > 2) {
+      std::vector<size_t> next;
+      for (size_t run = 0; run + 1 < runs.size(); run += 2) {
+        auto const lo  = runs[run];
+        auto const mid = runs[run + 1];
+        auto const hi  = run + 2 < runs.size() ? runs[run + 2] : mid;
+        std::merge(
+            recv.begin() + lo,
+            recv.begin() + mid,
+            recv.begin() + mid,
+            recv.begin() + hi,
+            tmp.begin() + lo,
+            cmp);
+        next.push_back(lo);
+      }
+      next.push_back(runs.back());
+      recv.swap(tmp);
+      runs = next;
+    }
+    merged.resize(nclean + recv.size());
+    std::merge(
+        keys,
+        keys + nclean,
+        recv.begin(),
+        recv.end(),
+        merged.begin(),
+        cmp);
+  }
+
+  {
+    ScopedPhase phase("rebalance");
+    // global ranges of the merged keys on this unit and of the local key
+    // counts of the array, keys go to the unit whose range holds them
+    unsigned long long const nmerged = merged.size(), ntarget = n;
+    unsigned long long       merged_off = 0;
+    MPI_Exscan(
+        &nmerged,
+        &merged_off,
+        1,
+        MPI_UNSIGNED_LONG_LONG,
+        MPI_SUM,
+        MPI_COMM_WORLD);
+    if (me == 0) merged_off = 0;
+
+    std::vector<unsigned long long> target_off(P + 1, 0);
+    MPI_Allgather(
+        &ntarget,
+        1,
+        MPI_UNSIGNED_LONG_LONG,
+        target_off.data() + 1,
+        1,
+        MPI_UNSIGNED_LONG_LONG,
+        MPI_COMM_WORLD);
+    for (size_t rank = 0; rank < P; ++rank) {
+      target_off[rank + 1] += target_off[rank];
+    }
+
+    for (size_t rank = 0; rank < P; ++rank) {
+      auto const lo = std::max(merged_off, target_off[rank]);
+      auto const hi =
+          std::min(merged_off + nmerged, target_off[rank + 1]);
+      ex.sdispls[rank] = static_cast<size_t>(hi > lo ? lo - merged_off : 0);
+      ex.scounts[rank] = static_cast<size_t>(hi > lo ? hi - lo : 0);
+    }
+    ex.recv_counts(MPI_COMM_WORLD);
+    alltoallv(merged.data(), keys);
+  }
+
+  split = splitters(c);
+}
+
+//! The local ranges are checked in place, the boundaries between units with
+//! a single allgather instead of a blocking remote read per unit.
+template <typename RandomIt, typename Cmp>
+inline bool parallel_verify(RandomIt begin, RandomIt end, Cmp cmp)
+{
+  assert(!(end < begin));
+
+  auto const l_range = dash::local_index_range(begin, end);
+
+  using pointer = typename std::iterator_traits<RandomIt>::pointer;
+
+  auto* lbegin = dash::local_begin(
+      static_cast<pointer>(begin), begin.pattern().team().myid());
+  auto const nl = static_cast<size_t>(l_range.end - l_range.begin);
+
+  std::atomic<bool> failed{false};
+  auto const        nlocal = verify_chunk(lbegin, 0, nl, cmp, failed);
+
+  // collective
+  auto const nerror = verify_boundaries(lbegin, nl, cmp, nlocal);
+
   LOG("found " << nerror << " errors!");
   return nerror == 0;
 }
+
+//! Global fingerprint of the keys of all units, collective
+template <typename RandomIt>
+inline Fingerprint parallel_fingerprint(RandomIt begin, RandomIt end)
+{
+  assert(!(end < begin));
+
+  auto const l_range = dash::local_index_range(begin, end);
+
+  using pointer = typename std::iterator_traits<RandomIt>::pointer;
+
+  auto* lbegin = dash::local_begin(
+      static_cast<pointer>(begin), begin.pattern().team().myid());
+  auto const nl = static_cast<size_t>(l_range.end - l_range.begin);
+
+  return allreduce(fingerprint(lbegin, 0, nl));
+}
 }  // namespace sortbench
 #endif
@@ -0,0 +1,308 @@
+#ifndef SORTBENCH_H__INCLUDED
+#define SORTBENCH_H__INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdlib>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <util/Bandwidth.h>
+#include <util/Logging.h>
+#include <util/Numa.h>
+#include <util/Verify.h>
+
+#include <openmp/omp.h>
+
+namespace sortbench {
+
+namespace inplace {
+
+// Ranges up to this size are sorted with std::sort by a single task
+constexpr size_t SORT_CUT_OFF = size_t{1} << 14;
+// Minimum number of elements per chunk of a parallel partition
+constexpr size_t PARTITION_CHUNK = size_t{1} << 16;
+// Samples for the pivot selection
+constexpr size_t NSAMPLES = 31;
+
+//! Contiguous index intervals [begin, begin + len) walked as one sequence
+struct interval_cursor {
+  std::vector<size_t> const* begins;
+  std::vector<size_t> const* lens;
+  size_t                     iv;
+  size_t                     pos;
+
+  //! Positions the cursor at offset off of the concatenated intervals
+  interval_cursor(
+      std::vector<size_t> const& b, std::vector<size_t> const& l, size_t off)
+    : begins(&b)
+    , lens(&l)
+    , iv(0)
+  {
+    while (off >= l[iv]) {
+      off -= l[iv++];
+    }
+    pos = b[iv] + off;
+  }
+
+  size_t operator*() const
+  {
+    return pos;
+  }
+
+  interval_cursor& operator++()
+  {
+    if (++pos == (*begins)[iv] + (*lens)[iv]) {
+      // skip to the next non-empty interval
+      while (++iv < lens->size() && (*lens)[iv] == 0) {
+      }
+      if (iv < lens->size()) pos = (*begins)[iv];
+    }
+    return *this;
+  }
+};
+
+//! Parallel in-place partition of first[0, n), returns the number of
+//! elements satisfying pred. Every chunk is partitioned in place first. Then
+//! the elements in front of the global split which fail pred and the
+//! elements behind it which satisfy pred are equally many, they are swapped
+//! pairwise with the work split evenly across the chunks. O(nchunks) extra
+//! memory.
+template <typename T, typename Pred>
+size_t parallel_partition(T* first, size_t n, Pred pred, size_t nchunks)
+{
+  if (nchunks < 2) {
+    return static_cast<size_t>(std::partition(first, first + n, pred) - first);
+  }
+
+  std::vector<size_t> lo(nchunks + 1), mid(nchunks);
+  for (size_t c = 0; c <= nchunks; ++c) {
+    lo[c] = n * c / nchunks;
+  }
+
+#pragma omp taskloop grainsize(1) shared(lo, mid, first, pred)
+  for (size_t c = 0; c < nchunks; ++c) {
+    mid[c] = static_cast<size_t>(
+        std::partition(first + lo[c], first + lo[c + 1], pred) - first);
+  }
+
+  size_t split = 0;
+  for (size_t c = 0; c < nchunks; ++c) {
+    split += mid[c] - lo[c];
+  }
+
+  // misplaced elements: failing pred in [0, split), satisfying it in
+  // [split, n)
+  std::vector<size_t> lbegin(nchunks), llen(nchunks);
+  std::vector<size_t> rbegin(nchunks), rlen(nchunks);
+  size_t              nswap = 0;
+  for (size_t c = 0; c < nchunks; ++c) {
+    lbegin[c] = mid[c];
+    llen[c]   = mid[c] < split ? std::min(lo[c + 1], split) - mid[c] : 0;
+    rbegin[c] = std::max(lo[c], split);
+    rlen[c]   = rbegin[c] < mid[c] ? mid[c] - rbegin[c] : 0;
+    nswap += llen[c];
+  }
+
+  if (nswap == 0) return split;
+
+#pragma omp taskloop grainsize(1) \
+    shared(lbegin, llen, rbegin, rlen, first, nswap)
+  for (size_t c = 0; c < nchunks; ++c) {
+    auto const a = nswap * c / nchunks;
+    auto const b = nswap * (c + 1) / nchunks;
+    if (a == b) continue;
+    interval_cursor l(lbegin, llen, a);
+    interval_cursor r(rbegin, rlen, a);
+    for (size_t k = a; k < b; ++k, ++l, ++r) {
+      std::swap(first[*l], first[*r]);
+    }
+  }
+
+  return split;
+}
+
+//! Median of NSAMPLES equidistant samples. dups is set if another sample
+//! equals the pivot, i.e. the keys equal to it are worth splitting off.
+template <typename T, typename Compare>
+T select_pivot(T const* first, size_t n, Compare cmp, bool& dups)
+{
+  T samples[NSAMPLES];
+  for (size_t s = 0; s < NSAMPLES; ++s) {
+    samples[s] = first[(n - 1) * s / (NSAMPLES - 1)];
+  }
+  auto* const mid = samples + NSAMPLES / 2;
+  std::nth_element(samples, mid, samples + NSAMPLES, cmp);
+
+  dups = false;
+  for (auto* it = samples; it != samples + NSAMPLES; ++it) {
+    dups |= it != mid && !cmp(*it, *mid) && !cmp(*mid, *it);
+  }
+  return *mid;
+}
+
+//! Quicksort with parallel partitions on large ranges and a task per
+//! subrange. If the samples contain duplicates of the pivot or no key is
+//! smaller than the pivot, the keys equal to it are split off as well,
+//! which keeps many duplicate keys from degrading the recursion.
+template <typename T, typename Compare>
+void quick_sort(T* first, size_t n, Compare cmp, int nthreads, int depth)
+{
+  if (n <= SORT_CUT_OFF || depth == 0) {
+    // bounds the recursion depth on adversarial inputs like introsort does
+    std::sort(first, first + n, cmp);
+    return;
+  }
+
+  auto const nchunks = std::min<size_t>(
+      static_cast<size_t>(nthreads), n / PARTITION_CHUNK);
+
+  bool    dups  = false;
+  T const pivot = select_pivot(first, n, cmp, dups);
+
+  auto const split = parallel_partition(
+      first, n, [&](T const& v) { return cmp(v, pivot); }, nchunks);
+
+  size_t nequal = 0;
+  if (dups || split == 0) {
+    // [split, split + nequal) equals the pivot and is in its final position
+    auto const nright = n - split;
+    nequal            = parallel_partition(
+        first + split,
+        nright,
+        [&](T const& v) { return !cmp(pivot, v); },
+        std::min<size_t>(nchunks, nright / PARTITION_CHUNK));
+  }
+
+  auto const upper = split + nequal;
+
+#pragma omp task untied firstprivate(first, split, cmp, nthreads, depth)
+  quick_sort(first, split, cmp, nthreads, depth - 1);
+  quick_sort(first + upper, n - upper, cmp, nthreads, depth - 1);
+#pragma omp taskwait
+}
+
+//! Sorts [first, first + n) without a scratch buffer. Not stable.
+template <typename T, typename Compare>
+void parallel_inplace_sort(T* first, size_t n, Compare cmp)
+{
+  int depth = 0;
+  for (size_t len = n; len > 1; len >>= 1) {
+    depth += 2;
+  }
+
+  int const nthreads = omp_get_max_threads();
+
+#pragma omp parallel num_threads(nthreads)
+#pragma omp single nowait
+  quick_sort(first, n, cmp, nthreads, depth);
+}
+
+}  // namespace inplace
+
+template <typename RandomIt, typename Gen>
+inline void parallel_rand(RandomIt begin, RandomIt end, Gen const g)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  // static chunks, i.e. thread t always touches the same pages
+  parallel_for_static(n, [begin, n, g](size_t lo, size_t hi) {
+    for (size_t idx = lo; idx < hi; ++idx) {
+      *(begin + idx) = g(n, idx);
+    }
+  });
+}
+
+template <typename Container, typename Cmp>
+inline void parallel_sort(Container& c, Cmp cmp)
+{
+  auto const n = static_cast<size_t>(std::distance(c.begin(), c.end()));
+
+  if (n < 2) return;
+
+  inplace::parallel_inplace_sort(std::addressof(*c.begin()), n, cmp);
+}
+
+//! parallel_sort by a single thread, the baseline of the parallel efficiency
+//! (--scaling)
+template <typename Container, typename Cmp>
+inline void baseline_sort(Container& c, Cmp cmp)
+{
+  auto const nthreads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  parallel_sort(c, cmp);
+  omp_set_num_threads(nthreads);
+}
+
+//! Code path taken by the last parallel_sort
+inline char const* sort_path()
+{
+  return "inplace";
+}
+
+//! Bytes moved through memory by parallel_sort of n keys
+template <typename T>
+inline double sort_traffic(size_t n)
+{
+  return traffic::quick_sort(n, sizeof(T), inplace::SORT_CUT_OFF);
+}
+
+//! Every thread checks its static chunk including the boundary to the
+//! previous chunk, all threads stop early once a violation is found.
+template <typename RandomIt, typename Compare>
+inline bool parallel_verify(RandomIt begin, RandomIt end, Compare cmp)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  if (n < 2) return true;
+
+  auto const* first = std::addressof(*begin);
+
+  std::atomic<bool> failed{false};
+  size_t            nerror = 0;
+
+#pragma omp parallel reduction(+ : nerror)
+  {
+    auto const tid   = static_cast<size_t>(omp_get_thread_num());
+    auto const nt    = static_cast<size_t>(omp_get_num_threads());
+    auto const chunk = (n + nt - 1) / nt;
+    auto const lo    = std::min(n, tid * chunk);
+    auto const hi    = std::min(n, lo + chunk);
+    nerror += verify_chunk(first, lo, hi, cmp, failed);
+  }
+
+  return nerror == 0;
+}
+
+template <typename RandomIt>
+inline Fingerprint parallel_fingerprint(RandomIt begin, RandomIt end)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  if (n == 0) return {};
+
+  auto const* first = std::addressof(*begin);
+
+  uint64_t sum = 0;
+
+#pragma omp parallel for schedule(static) reduction(+ : sum)
+  for (size_t idx = 0; idx < n; ++idx) {
+    sum += fingerprint_hash(first[idx]);
+  }
+
+  Fingerprint fp;
+  fp.count = n;
+  fp.sum   = sum;
+  return fp;
+}
+}  // namespace sortbench
+#endif
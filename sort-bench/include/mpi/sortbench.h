@@ -2,9 +2,14 @@
 #define SORTBENCH_H__INCLUDED
 
 #include <mpi.h>
+#include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <iterator>
+#include <memory>
 #include <random>
+#include <vector>
 
 extern "C" {
 #ifndef MPI_COMM_WORLD
@@ -13,21 +18,36 @@ extern "C" {
 #include <MP-sort/mpsort.h>
 }
 
+#include <util/Bandwidth.h>
+#include <util/Exchange.h>
 #include <util/Logging.h>
+#include <util/Memory.h>
+#include <util/Numa.h>
+#include <util/Verify.h>
+#include <util/Timer.h>
+#include <util/Types.h>
+
+#include <intel/openmp/parallel_stable_sort.h>
 
 namespace sortbench {
 
+// MP-sort only looks at the radix, i.e. the key of a record
+
 template <typename T>
 static void radix_value(const void* ptr, void* radix, void* arg)
 {
-  *reinterpret_cast<T*>(radix) = *reinterpret_cast<const T*>(ptr);
+  using key_t = typename record_traits<T>::key_type;
+  *reinterpret_cast<key_t*>(radix) =
+      record_traits<T>::key(*reinterpret_cast<const T*>(ptr));
 }
 
 template <typename T>
 static int compar_value(const void* a, const void* b)
 {
-  T const val_a = *reinterpret_cast<T const*>(a);
-  T const val_b = *reinterpret_cast<T const*>(b);
+  using key_t = typename record_traits<T>::key_type;
+
+  key_t const val_a = *reinterpret_cast<key_t const*>(a);
+  key_t const val_b = *reinterpret_cast<key_t const*>(b);
 
   if (val_a < val_b) return -1;
   if (val_a > val_b) return 1;
@@ -42,23 +62,290 @@ inline void parallel_rand(RandomIt begin, RandomIt end, Gen const g)
 
   auto const n = static_cast<size_t>(std::distance(begin, end));
 
+  // generators are indexed globally, i.e. the keys of rank r follow the
+  // keys of ranks 0..r-1
+  unsigned long long nl = n, offset = 0, total = 0;
+  MPI_Exscan(&nl, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(
+      &nl, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
   int ThisTask;
   MPI_Comm_rank(MPI_COMM_WORLD, &ThisTask);
+  // MPI_Exscan leaves the receive buffer of rank 0 undefined
+  if (ThisTask == 0) offset = 0;
+
+  // static chunks of the threads of this rank (--hybrid), i.e. thread t
+  // always touches the same pages
+  parallel_for_static(n, [begin, g, total, offset](size_t lo, size_t hi) {
+    for (size_t idx = lo; idx < hi; ++idx) {
+      *(begin + idx) = g(total, offset + idx);
+    }
+  });
+}
+
+namespace hybrid {
+
+//! True if the last sort was parallel_sort_hybrid
+inline bool& last_used()
+{
+  static bool used = false;
+  return used;
+}
+
+// Regular samples per rank for the splitter selection
+constexpr size_t SAMPLES_PER_RANK = 64;
+
+//! A key tagged with its rank and position in the locally sorted keys. The
+//! lexicographic order is a total order on all keys, i.e. splitters divide
+//! runs of equal keys instead of sending them to a single rank.
+template <typename T>
+struct sample_t {
+  T        value;
+  int      rank;
+  uint64_t pos;
+};
+
+//! Position of splitter s in the sorted local keys first[0, n) of rank me
+template <typename T, typename Cmp>
+size_t split_position(
+    T const* first, size_t n, int me, sample_t<T> const& s, Cmp cmp)
+{
+  if (s.rank == me) return s.pos;
+  // equal keys of lower ranks precede the splitter, of higher ranks follow it
+  return static_cast<size_t>(
+      (me < s.rank ? std::upper_bound(first, first + n, s.value, cmp)
+                   : std::lower_bound(first, first + n, s.value, cmp)) -
+      first);
+}
+
+//! Element type for the exchange, keeps the counts in elements
+template <typename T>
+struct mpi_type {
+  MPI_Datatype type;
+
+  mpi_type()
+  {
+    MPI_Type_contiguous(sizeof(T), MPI_BYTE, &type);
+    MPI_Type_commit(&type);
+  }
+
+  ~mpi_type()
+  {
+    MPI_Type_free(&type);
+  }
+};
+
+//! Merges the sorted runs src[bounds[i], bounds[i + 1]) pairwise with the
+//! task parallel PSS merge until one run is left. Returns the buffer (src
+//! or dst) which holds the result.
+template <typename T, typename Cmp>
+T* merge_runs(T* src, T* dst, std::vector<size_t> bounds, Cmp cmp)
+{
+#pragma omp parallel
+#pragma omp single
+  while (bounds.size() > 2) {
+    auto const          nruns = bounds.size() - 1;
+    std::vector<size_t> next;
+    for (size_t run = 0; run < nruns; run += 2) {
+      auto const lo  = bounds[run];
+      auto const mid = bounds[run + 1];
+      auto const hi  = run + 2 <= nruns ? bounds[run + 2] : mid;
+#pragma omp task firstprivate(lo, mid, hi) shared(src, dst, cmp)
+      pss::internal::parallel_move_merge(
+          src + lo, src + mid, src + mid, src + hi, dst + lo, false, cmp);
+      next.push_back(lo);
+    }
+    next.push_back(bounds.back());
+#pragma omp taskwait
+    std::swap(src, dst);
+    bounds = next;
+  }
+  return src;
+}
+
+}  // namespace hybrid
+
+//! Hybrid MPI + threads sample sort, meant for one rank per node or NUMA
+//! domain: the local keys are sorted with the threaded PSS kernel, all ranks
+//! pick splitters from regular samples, a single all-to-all exchange sends
+//! every key to its target rank, where the received runs are merged by the
+//! threads. A final exchange restores the local key counts. Collective.
+template <typename Container, typename Cmp>
+inline void parallel_sort_hybrid(Container& c, Cmp cmp)
+{
+  using value_t  = typename Container::value_type;
+  using sample_t = hybrid::sample_t<value_t>;
+
+  hybrid::last_used() = true;
+
+  int nranks, me;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+  auto const P = static_cast<size_t>(nranks);
+  auto const n = c.size();
+
+  value_t* const keys = c.data();
+
+  {
+    ScopedPhase phase("local_sort");
+    pss::parallel_stable_sort(keys, keys + n, cmp);
+  }
+
+  std::vector<size_t> split(P + 1, 0);
+  {
+    ScopedPhase phase("splitters");
+
+    auto const nsamples = std::min(n, hybrid::SAMPLES_PER_RANK);
+
+    std::vector<int> counts(P), displs(P);
+    int const        mycount = static_cast<int>(nsamples * sizeof(sample_t));
+    MPI_Allgather(
+        &mycount, 1, MPI_INT, counts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    int total = 0;
+    for (size_t rank = 0; rank < P; ++rank) {
+      displs[rank] = total;
+      total += counts[rank];
+    }
+
+    std::vector<sample_t> mine(nsamples);
+    for (size_t s = 0; s < nsamples; ++s) {
+      auto const pos = (2 * s + 1) * n / (2 * nsamples);
+      mine[s]        = sample_t{keys[pos], me, pos};
+    }
+
+    std::vector<sample_t> samples(total / sizeof(sample_t));
+    MPI_Allgatherv(
+        mine.data(),
+        mycount,
+        MPI_BYTE,
+        samples.data(),
+        counts.data(),
+        displs.data(),
+        MPI_BYTE,
+        MPI_COMM_WORLD);
+
+    auto const less = [cmp](sample_t const& a, sample_t const& b) {
+      if (cmp(a.value, b.value)) return true;
+      if (cmp(b.value, a.value)) return false;
+      return a.rank < b.rank || (a.rank == b.rank && a.pos < b.pos);
+    };
+    std::sort(samples.begin(), samples.end(), less);
 
-  for (size_t idx = 0; idx < n; ++idx) {
-    auto it = begin + idx;
-    *it     = g(n, idx);
+    split[P] = n;
+    for (size_t rank = 1; rank < P && !samples.empty(); ++rank) {
+      auto const& s = samples[rank * samples.size() / P];
+      split[rank]   = hybrid::split_position(keys, n, me, s, cmp);
+    }
+  }
+
+  hybrid::mpi_type<value_t> const type;
+
+  // counts in keys, beyond the int range of MPI_Alltoallv for node sized
+  // ranks
+  Exchange ex(P);
+
+  // scratch of the exchange and the merge, mapped as --pages requests
+  std::vector<value_t, default_init_allocator<value_t, page_allocator<value_t>>>
+                      recv, buf;
+  std::vector<size_t> runs(P + 1, 0);
+  {
+    ScopedPhase phase("exchange");
+    for (size_t rank = 0; rank < P; ++rank) {
+      ex.sdispls[rank] = split[rank];
+      ex.scounts[rank] = split[rank + 1] - split[rank];
+    }
+    recv.resize(ex.recv_counts(MPI_COMM_WORLD));
+    ex.alltoallv(keys, recv.data(), type.type, MPI_COMM_WORLD);
+    for (size_t rank = 0; rank < P; ++rank) {
+      runs[rank + 1] = runs[rank] + ex.rcounts[rank];
+    }
+  }
+
+  value_t* sorted = nullptr;
+  {
+    ScopedPhase phase("merge");
+    buf.resize(recv.size());
+    sorted = hybrid::merge_runs(recv.data(), buf.data(), runs, cmp);
+  }
+
+  {
+    ScopedPhase phase("rebalance");
+    // global ranges of the sorted keys on this rank and of the original
+    // local key counts, keys go to the rank whose original range holds them
+    unsigned long long const nsorted = recv.size(), ntarget = n;
+    unsigned long long       sorted_off = 0;
+    MPI_Exscan(
+        &nsorted,
+        &sorted_off,
+        1,
+        MPI_UNSIGNED_LONG_LONG,
+        MPI_SUM,
+        MPI_COMM_WORLD);
+    if (me == 0) sorted_off = 0;
+
+    std::vector<unsigned long long> target_off(P + 1, 0);
+    MPI_Allgather(
+        &ntarget,
+        1,
+        MPI_UNSIGNED_LONG_LONG,
+        target_off.data() + 1,
+        1,
+        MPI_UNSIGNED_LONG_LONG,
+        MPI_COMM_WORLD);
+    for (size_t rank = 0; rank < P; ++rank) {
+      target_off[rank + 1] += target_off[rank];
+    }
+
+    for (size_t rank = 0; rank < P; ++rank) {
+      auto const lo = std::max(sorted_off, target_off[rank]);
+      auto const hi = std::min(sorted_off + nsorted, target_off[rank + 1]);
+      ex.scounts[rank] = hi > lo ? static_cast<size_t>(hi - lo) : 0;
+      ex.sdispls[rank] = hi > lo ? static_cast<size_t>(lo - sorted_off) : 0;
+    }
+    auto const nrecv = ex.recv_counts(MPI_COMM_WORLD);
+    assert(nrecv == n);
+    (void)nrecv;
+    ex.alltoallv(sorted, keys, type.type, MPI_COMM_WORLD);
+  }
+}
+
+//! Code path taken by the last parallel_sort
+inline char const* sort_path()
+{
+  return hybrid::last_used() ? "hybrid" : "mpsort";
+}
+
+//! Bytes moved through memory by parallel_sort of n local keys. MP-sort
+//! sorts locally by an LSD radix sort, a pass per byte of the key.
+template <typename T>
+inline double sort_traffic(size_t n)
+{
+  if (!hybrid::last_used()) {
+    using key_t = typename record_traits<T>::key_type;
+    return traffic::distributed_sort(
+        n, sizeof(T), traffic::radix_sort(n, sizeof(T), sizeof(key_t)));
   }
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  // local PSS merge sort with the cut-off in use, exchange, merge levels and
+  // rebalance
+  return traffic::merge_sort(n, sizeof(T), pss::cut_offs_for<T>().sort) +
+         2.0 * n * sizeof(T) *
+             (traffic::merge_levels(static_cast<size_t>(nranks)) + 2);
 }
 
 template <typename Container, typename Cmp>
 inline void parallel_sort(Container& c, Cmp cmp)
 {
+  hybrid::last_used() = false;
+
   auto begin = c.begin();
   auto end   = c.end();
   assert(!(end < begin));
 
   using value_t = typename Container::value_type;
+  using key_t   = typename record_traits<value_t>::key_type;
 
   auto const mysize = static_cast<size_t>(std::distance(begin, end));
 
@@ -70,33 +357,79 @@ inline void parallel_sort(Container& c, Cmp cmp)
       sizeof(value_t),
       radix_value<value_t>,
       compar_value<value_t>,
-      sizeof(value_t),
+      sizeof(key_t),
       NULL,
       MPI_COMM_WORLD);
 
   LOG_TRACE_RANGE("Mp_sort", begin, end);
 }
 
+//! Sort of the keys by a single rank, i.e. the local radix sort of MP-sort
+//! only, the baseline of the parallel efficiency (--scaling)
+template <typename Container, typename Cmp>
+inline void baseline_sort(Container& c, Cmp cmp)
+{
+  using value_t = typename Container::value_type;
+  using key_t   = typename record_traits<value_t>::key_type;
+
+  radix_sort(
+      std::addressof(*c.begin()),
+      static_cast<size_t>(std::distance(c.begin(), c.end())),
+      sizeof(value_t),
+      radix_value<value_t>,
+      sizeof(key_t),
+      NULL);
+}
+
 template <typename RandomIt, typename Cmp>
 inline bool parallel_verify(RandomIt begin, RandomIt end, Cmp cmp)
 {
   assert(!(end < begin));
 
-  auto const n      = static_cast<size_t>(std::distance(begin, end));
-  size_t     nerror = 0;
+  using value_t = typename std::iterator_traits<RandomIt>::value_type;
 
-  for (size_t idx = 1; idx < n; ++idx) {
-    auto it = begin + idx;
-    if (cmp(*it, *(it - 1))) {
-      LOG("Failed sort order: {prev: " << *(it - 1) << ", cur: " << *it
-                                       << "}");
-      ++nerror;
-    }
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  value_t const* first = n ? std::addressof(*begin) : nullptr;
+
+  std::atomic<bool> failed{false};
+  size_t            nlocal = 0;
+
+  // the threads of this rank check their static chunks (--hybrid)
+#pragma omp parallel reduction(+ : nlocal)
+  {
+    auto const tid   = static_cast<size_t>(omp_get_thread_num());
+    auto const nt    = static_cast<size_t>(omp_get_num_threads());
+    auto const chunk = (n + nt - 1) / nt;
+    auto const lo    = std::min(n, tid * chunk);
+    auto const hi    = std::min(n, lo + chunk);
+    nlocal += verify_chunk(first, lo, hi, cmp, failed);
   }
 
-  MPI_Barrier(MPI_COMM_WORLD);
+  // collective
+  return verify_boundaries(first, n, cmp, nlocal) == 0;
+}
 
-  return nerror == 0;
+//! Global fingerprint of the keys of all ranks, collective
+template <typename RandomIt>
+inline Fingerprint parallel_fingerprint(RandomIt begin, RandomIt end)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  Fingerprint local;
+  local.count = n;
+  if (n) {
+    auto const* first = std::addressof(*begin);
+    uint64_t    sum   = 0;
+#pragma omp parallel for schedule(static) reduction(+ : sum)
+    for (size_t idx = 0; idx < n; ++idx) {
+      sum += fingerprint_hash(first[idx]);
+    }
+    local.sum = sum;
+  }
+  return allreduce(local);
 }
 
 }  // namespace sortbench
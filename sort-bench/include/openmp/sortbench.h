@@ -1,6 +1,7 @@
 #ifndef SORTBENCH_H__INCLUDED
 #define SORTBENCH_H__INCLUDED
 
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
@@ -8,7 +9,10 @@
 #include <random>
 #include <type_traits>
 
+#include <util/Bandwidth.h>
 #include <util/Logging.h>
+#include <util/Numa.h>
+#include <util/Verify.h>
 
 #include <intel/openmp/parallel_stable_sort.h>
 #include "omp.h"
@@ -22,23 +26,19 @@ inline void parallel_rand(RandomIt begin, RandomIt end, Gen const g)
 
   auto const n = static_cast<size_t>(std::distance(begin, end));
 
-#pragma omp parallel default(none) shared(begin)
-  {
-    auto const tid = static_cast<unsigned>(omp_get_thread_num());
-
-#pragma omp for
-    for (std::size_t idx = 0; idx < n; ++idx) {
-      auto it = begin + idx;
-      *it     = g(n, idx);
+  // static chunks, i.e. thread t always touches the same pages
+  parallel_for_static(n, [begin, n, g](size_t lo, size_t hi) {
+    for (size_t idx = lo; idx < hi; ++idx) {
+      *(begin + idx) = g(n, idx);
     }
-  }
+  });
 }
 
 template <typename Container, typename Cmp>
 inline void parallel_sort(Container& c, Cmp cmp)
 {
-  auto begin = c.begin();
-  auto end   = c.end();
+  auto* begin = c.data();
+  auto* end   = begin + c.size();
   if (rand() & 0x100) {
 #pragma omp parallel
 #pragma omp master
@@ -50,6 +50,90 @@ inline void parallel_sort(Container& c, Cmp cmp)
   }
 }
 
+//! parallel_sort by a single thread, the baseline of the parallel efficiency
+//! (--scaling)
+template <typename Container, typename Cmp>
+inline void baseline_sort(Container& c, Cmp cmp)
+{
+  auto const nthreads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  parallel_sort(c, cmp);
+  omp_set_num_threads(nthreads);
+}
+
+template <typename Container, typename Cmp>
+inline void parallel_sort(
+    Container& c, Cmp cmp, pss::scratch_arena const& arena)
+{
+  auto* begin = c.data();
+  auto* end   = begin + c.size();
+  if (rand() & 0x100) {
+#pragma omp parallel
+#pragma omp master
+    pss::parallel_stable_sort(begin, end, cmp, arena);
+  }
+  else {
+    pss::parallel_stable_sort(begin, end, cmp, arena);
+  }
+}
+
+//! Per-thread runs and a single pss::parallel_multiway_merge instead of the
+//! binary merge tree, see --merge
+template <typename Container, typename Cmp>
+inline void parallel_sort_multiway(Container& c, Cmp cmp)
+{
+  auto* begin = c.data();
+  auto* end   = begin + c.size();
+  if (rand() & 0x100) {
+#pragma omp parallel
+#pragma omp master
+    pss::parallel_stable_sort_multiway(begin, end, cmp);
+  }
+  else {
+    pss::parallel_stable_sort_multiway(begin, end, cmp);
+  }
+}
+
+template <typename Container, typename Cmp>
+inline void parallel_sort_multiway(
+    Container& c, Cmp cmp, pss::scratch_arena const& arena)
+{
+  auto* begin = c.data();
+  auto* end   = begin + c.size();
+  if (rand() & 0x100) {
+#pragma omp parallel
+#pragma omp master
+    pss::parallel_stable_sort_multiway(begin, end, cmp, arena);
+  }
+  else {
+    pss::parallel_stable_sort_multiway(begin, end, cmp, arena);
+  }
+}
+
+//! Code path taken by the last parallel_sort
+inline char const* sort_path()
+{
+  return pss::to_string(pss::last_sort_path());
+}
+
+//! Bytes moved through memory by the last parallel_sort of n keys
+template <typename T>
+inline double sort_traffic(size_t n)
+{
+  auto const path = pss::last_sort_path();
+  if (path == pss::sort_path::multiway ||
+      path == pss::sort_path::multiway_arena) {
+    return traffic::multiway_merge_sort(
+        n,
+        sizeof(T),
+        pss::internal::multiway_runs(n, omp_get_max_threads()),
+        pss::cut_offs_for<T>().sort);
+  }
+  return traffic::merge_sort(n, sizeof(T), pss::cut_offs_for<T>().sort);
+}
+
+//! Every thread checks its static chunk including the boundary to the
+//! previous chunk, all threads stop early once a violation is found.
 template <typename RandomIt, typename Compare>
 inline bool parallel_verify(RandomIt begin, RandomIt end, Compare cmp)
 {
@@ -57,19 +141,48 @@ inline bool parallel_verify(RandomIt begin, RandomIt end, Compare cmp)
 
   auto const n = static_cast<size_t>(std::distance(begin, end));
 
-  size_t nerror = 0;
+  if (n < 2) return true;
 
-#pragma omp parallel for reduction(+ : nerror)
-  for (std::size_t idx = 1; idx < n; ++idx) {
-    auto it = begin + idx;
-    if (cmp(*it, *(it - 1))) {
-      LOG("Failed sort order: {prev: " << *(it - 1) << ", cur: " << *it
-                                       << "}");
-      ++nerror;
-    }
+  auto const* first = std::addressof(*begin);
+
+  std::atomic<bool> failed{false};
+  size_t            nerror = 0;
+
+#pragma omp parallel reduction(+ : nerror)
+  {
+    auto const tid   = static_cast<size_t>(omp_get_thread_num());
+    auto const nt    = static_cast<size_t>(omp_get_num_threads());
+    auto const chunk = (n + nt - 1) / nt;
+    auto const lo    = std::min(n, tid * chunk);
+    auto const hi    = std::min(n, lo + chunk);
+    nerror += verify_chunk(first, lo, hi, cmp, failed);
   }
 
   return nerror == 0;
 }
+
+template <typename RandomIt>
+inline Fingerprint parallel_fingerprint(RandomIt begin, RandomIt end)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  if (n == 0) return {};
+
+  auto const* first = std::addressof(*begin);
+
+  uint64_t sum = 0;
+
+#pragma omp parallel for schedule(static) reduction(+ : sum)
+  for (size_t idx = 0; idx < n; ++idx) {
+    sum += fingerprint_hash(first[idx]);
+  }
+
+  Fingerprint fp;
+  fp.count = n;
+  fp.sum   = sum;
+  return fp;
+}
 }  // namespace sortbench
 #endif
@@ -0,0 +1,409 @@
+#ifndef SORTBENCH_H__INCLUDED
+#define SORTBENCH_H__INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+#include <util/Bandwidth.h>
+#include <util/Logging.h>
+#include <util/Memory.h>
+#include <util/Numa.h>
+#include <util/Verify.h>
+#include <util/Types.h>
+
+#include <intel/pss_common.h>
+#include <openmp/omp.h>
+
+namespace sortbench {
+
+namespace radix {
+
+//! Maps a key to an unsigned integer such that the unsigned order of the
+//! bits matches the order of the keys under std::less.
+template <typename T, typename = void>
+struct key_traits;
+
+//! Unsigned integers are already in radix order.
+template <typename T>
+struct key_traits<
+    T,
+    typename std::enable_if<
+        std::is_integral<T>::value && std::is_unsigned<T>::value>::type> {
+  using bits_t = T;
+
+  static bits_t to_bits(T const& v)
+  {
+    return v;
+  }
+};
+
+//! Signed integers: flip the sign bit.
+template <typename T>
+struct key_traits<
+    T,
+    typename std::enable_if<
+        std::is_integral<T>::value && std::is_signed<T>::value>::type> {
+  using bits_t = typename std::make_unsigned<T>::type;
+
+  static bits_t to_bits(T const& v)
+  {
+    constexpr bits_t sign = bits_t{1} << (sizeof(bits_t) * 8 - 1);
+    return static_cast<bits_t>(v) ^ sign;
+  }
+};
+
+//! IEEE-754: flip all bits of negative values, only the sign bit of
+//! positive values.
+template <typename T>
+struct key_traits<
+    T,
+    typename std::enable_if<std::is_floating_point<T>::value>::type> {
+  static_assert(
+      sizeof(T) == sizeof(uint32_t) || sizeof(T) == sizeof(uint64_t),
+      "only binary32 and binary64 floating point keys are supported");
+
+  using bits_t = typename std::
+      conditional<sizeof(T) == sizeof(uint32_t), uint32_t, uint64_t>::type;
+
+  static bits_t to_bits(T const& v)
+  {
+    constexpr unsigned nbits = sizeof(bits_t) * 8;
+    constexpr bits_t   sign  = bits_t{1} << (nbits - 1);
+
+    bits_t u;
+    std::memcpy(&u, &v, sizeof(u));
+    // all ones if negative, sign bit only otherwise
+    bits_t const mask = static_cast<bits_t>(-(u >> (nbits - 1))) | sign;
+    return u ^ mask;
+  }
+};
+
+//! Records are sorted by their 64-bit key, the payload is moved along.
+template <size_t NPayload>
+struct key_traits<Record<NPayload>> {
+  using bits_t = uint64_t;
+
+  static bits_t to_bits(Record<NPayload> const& v)
+  {
+    return v.key;
+  }
+};
+
+//! Key / index pairs of --argsort are sorted by their key.
+template <typename K, typename I>
+struct key_traits<KeyIndex<K, I>> {
+  using bits_t = typename key_traits<K>::bits_t;
+
+  static bits_t to_bits(KeyIndex<K, I> const& v)
+  {
+    // by value, the key of a packed pair may be misaligned
+    K const key = v.key;
+    return key_traits<K>::to_bits(key);
+  }
+};
+
+constexpr unsigned RADIX_BITS = 8;
+constexpr size_t   RADIX      = size_t{1} << RADIX_BITS;
+// Bytes per write combining buffer, i.e. one cache line
+constexpr size_t WC_BYTES = 64;
+
+template <typename T>
+inline unsigned digit(T const& v, unsigned pass)
+{
+  using traits = key_traits<T>;
+  return static_cast<unsigned>(
+      (traits::to_bits(v) >> (pass * RADIX_BITS)) & (RADIX - 1));
+}
+
+//! One LSD pass from src to dst: per-thread histograms over a static
+//! chunking, exclusive prefix sum over (digit, thread) and a scatter through
+//! cache-line sized write combining buffers per digit. Each thread owns
+//! [bucket, thread] slots in dst which keeps the sort stable.
+template <typename T>
+void radix_pass(T const* src, T* dst, size_t n, unsigned pass, int nthreads)
+{
+  constexpr size_t WC_ELEMS =
+      std::max<size_t>(1, WC_BYTES / sizeof(T));
+
+  std::vector<size_t> hist(static_cast<size_t>(nthreads) * RADIX, 0);
+
+#pragma omp parallel num_threads(nthreads)
+  {
+    auto const tid = static_cast<size_t>(omp_get_thread_num());
+    auto const nt  = static_cast<size_t>(omp_get_num_threads());
+
+    auto const chunk = (n + nt - 1) / nt;
+    auto const lo    = std::min(n, tid * chunk);
+    auto const hi    = std::min(n, lo + chunk);
+
+    size_t* const myhist = hist.data() + tid * RADIX;
+
+    for (size_t idx = lo; idx < hi; ++idx) {
+      ++myhist[digit(src[idx], pass)];
+    }
+
+#pragma omp barrier
+#pragma omp single
+    {
+      size_t sum = 0;
+      for (size_t d = 0; d < RADIX; ++d) {
+        for (size_t t = 0; t < nt; ++t) {
+          auto const cnt      = hist[t * RADIX + d];
+          hist[t * RADIX + d] = sum;
+          sum += cnt;
+        }
+      }
+    }
+    // implicit barrier
+
+    std::unique_ptr<T[]>     wc(new T[RADIX * WC_ELEMS]);
+    std::unique_ptr<unsigned[]> fill(new unsigned[RADIX]());
+
+    for (size_t idx = lo; idx < hi; ++idx) {
+      auto const d    = digit(src[idx], pass);
+      T* const   line = wc.get() + d * WC_ELEMS;
+      line[fill[d]++] = src[idx];
+      if (fill[d] == WC_ELEMS) {
+        std::copy(line, line + WC_ELEMS, dst + myhist[d]);
+        myhist[d] += WC_ELEMS;
+        fill[d] = 0;
+      }
+    }
+
+    for (size_t d = 0; d < RADIX; ++d) {
+      T* const line = wc.get() + d * WC_ELEMS;
+      std::copy(line, line + fill[d], dst + myhist[d]);
+    }
+  }
+}
+
+//! Scatter buffer of the last parallel_sort, "buffered" or "arena"
+inline char const*& last_path()
+{
+  static char const* path = "buffered";
+  return path;
+}
+
+//! Number of passes the last lsd_radix_sort executed, i.e. not skipped
+inline unsigned& last_passes()
+{
+  static unsigned npasses = 0;
+  return npasses;
+}
+
+//! Sorts [first, first + n) using buf[0, n) as scratch.
+template <typename T>
+void lsd_radix_sort(T* first, size_t n, T* buf)
+{
+  using bits_t = typename key_traits<T>::bits_t;
+
+  constexpr unsigned NPASSES = sizeof(bits_t) * 8 / RADIX_BITS;
+
+  last_passes() = 0;
+
+  if (n < 2) return;
+
+  int const nthreads = omp_get_max_threads();
+
+  // A single read sweep computing global histograms for all passes allows us
+  // to skip passes where every key has the same digit (e.g. the exponent
+  // bytes of narrowly distributed doubles).
+  std::vector<size_t> ghist(NPASSES * RADIX, 0);
+
+#pragma omp parallel num_threads(nthreads)
+  {
+    std::vector<size_t> lhist(NPASSES * RADIX, 0);
+
+#pragma omp for schedule(static) nowait
+    for (size_t idx = 0; idx < n; ++idx) {
+      auto const bits = key_traits<T>::to_bits(first[idx]);
+      for (unsigned p = 0; p < NPASSES; ++p) {
+        ++lhist[p * RADIX + ((bits >> (p * RADIX_BITS)) & (RADIX - 1))];
+      }
+    }
+
+#pragma omp critical
+    for (size_t idx = 0; idx < lhist.size(); ++idx) {
+      ghist[idx] += lhist[idx];
+    }
+  }
+
+  T* src = first;
+  T* dst = buf;
+
+  for (unsigned p = 0; p < NPASSES; ++p) {
+    auto const trivial = std::any_of(
+        ghist.begin() + p * RADIX,
+        ghist.begin() + (p + 1) * RADIX,
+        [n](size_t cnt) { return cnt == n; });
+
+    if (trivial) {
+      LOG("radix: skipping pass " << p);
+      continue;
+    }
+
+    radix_pass(src, dst, n, p, nthreads);
+    std::swap(src, dst);
+    ++last_passes();
+  }
+
+  if (src != first) {
+#pragma omp parallel for num_threads(nthreads) schedule(static)
+    for (size_t idx = 0; idx < n; ++idx) {
+      first[idx] = src[idx];
+    }
+  }
+}
+
+}  // namespace radix
+
+template <typename RandomIt, typename Gen>
+inline void parallel_rand(RandomIt begin, RandomIt end, Gen const g)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  // static chunks, i.e. thread t always touches the same pages
+  parallel_for_static(n, [begin, n, g](size_t lo, size_t hi) {
+    for (size_t idx = lo; idx < hi; ++idx) {
+      *(begin + idx) = g(n, idx);
+    }
+  });
+}
+
+template <typename Container, typename Cmp>
+inline void parallel_sort(Container& c, Cmp)
+{
+  using value_t = typename Container::value_type;
+
+  static_assert(
+      std::is_same<Cmp, std::less<value_t>>::value,
+      "radix sort only supports ascending order (std::less)");
+
+  auto const n = static_cast<size_t>(std::distance(c.begin(), c.end()));
+
+  // default initialized, i.e. no page is touched before the first scatter
+  std::vector<value_t, default_init_allocator<value_t, page_allocator<value_t>>>
+      buf(n);
+
+  radix::last_path() = "buffered";
+  radix::lsd_radix_sort(std::addressof(*c.begin()), n, buf.data());
+}
+
+//! parallel_sort by a single thread, the baseline of the parallel efficiency
+//! (--scaling)
+template <typename Container, typename Cmp>
+inline void baseline_sort(Container& c, Cmp cmp)
+{
+  using value_t = typename Container::value_type;
+
+  static_assert(
+      std::is_same<Cmp, std::less<value_t>>::value,
+      "radix sort only supports ascending order (std::less)");
+
+  auto const nthreads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  parallel_sort(c, cmp);
+  omp_set_num_threads(nthreads);
+}
+
+//! Use the caller supplied arena as scatter buffer if it is large enough.
+template <typename Container, typename Cmp>
+inline void parallel_sort(
+    Container& c, Cmp cmp, pss::scratch_arena const& arena)
+{
+  using value_t = typename Container::value_type;
+
+  static_assert(
+      std::is_same<Cmp, std::less<value_t>>::value,
+      "radix sort only supports ascending order (std::less)");
+
+  auto const n = static_cast<size_t>(std::distance(c.begin(), c.end()));
+
+  if (value_t* buf = arena.get<value_t>(n)) {
+    radix::last_path() = "arena";
+    radix::lsd_radix_sort(std::addressof(*c.begin()), n, buf);
+  }
+  else {
+    parallel_sort(c, cmp);
+  }
+}
+
+//! Code path taken by the last parallel_sort
+inline char const* sort_path()
+{
+  return radix::last_path();
+}
+
+//! Bytes moved through memory by the last parallel_sort of n keys
+template <typename T>
+inline double sort_traffic(size_t n)
+{
+  return traffic::radix_sort(n, sizeof(T), radix::last_passes());
+}
+
+//! Every thread checks its static chunk including the boundary to the
+//! previous chunk, all threads stop early once a violation is found.
+template <typename RandomIt, typename Compare>
+inline bool parallel_verify(RandomIt begin, RandomIt end, Compare cmp)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  if (n < 2) return true;
+
+  auto const* first = std::addressof(*begin);
+
+  std::atomic<bool> failed{false};
+  size_t            nerror = 0;
+
+#pragma omp parallel reduction(+ : nerror)
+  {
+    auto const tid   = static_cast<size_t>(omp_get_thread_num());
+    auto const nt    = static_cast<size_t>(omp_get_num_threads());
+    auto const chunk = (n + nt - 1) / nt;
+    auto const lo    = std::min(n, tid * chunk);
+    auto const hi    = std::min(n, lo + chunk);
+    nerror += verify_chunk(first, lo, hi, cmp, failed);
+  }
+
+  return nerror == 0;
+}
+
+template <typename RandomIt>
+inline Fingerprint parallel_fingerprint(RandomIt begin, RandomIt end)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  if (n == 0) return {};
+
+  auto const* first = std::addressof(*begin);
+
+  uint64_t sum = 0;
+
+#pragma omp parallel for schedule(static) reduction(+ : sum)
+  for (size_t idx = 0; idx < n; ++idx) {
+    sum += fingerprint_hash(first[idx]);
+  }
+
+  Fingerprint fp;
+  fp.count = n;
+  fp.sum   = sum;
+  return fp;
+}
+}  // namespace sortbench
+#endif
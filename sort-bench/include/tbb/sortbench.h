@@ -1,16 +1,25 @@
 #ifndef SORTBENCH_H__INCLUDED
 #define SORTBENCH_H__INCLUDED
 
+#include <atomic>
 #include <cassert>
 #include <cstdlib>
 #include <iostream>
 #include <memory>
+#include <functional>
 #include <random>
 #include <type_traits>
 
 #include <tbb/parallel_for.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/partitioner.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_scheduler_observer.h>
 
+#include <util/Bandwidth.h>
 #include <util/Logging.h>
+#include <util/Numa.h>
+#include <util/Verify.h>
 
 #ifdef USE_TBB_HIGHLEVEL
 #include <intel/tbb-highlevel/parallel_stable_sort.h>
@@ -27,23 +36,155 @@ inline void parallel_rand(RandomIt begin, RandomIt end, Gen const g)
 
   auto const n = static_cast<size_t>(std::distance(begin, end));
 
+  // the static partitioner hands equal chunks to the threads in order, which
+  // parallel_place relies on
   tbb::parallel_for(
       tbb::blocked_range<size_t>(0, n),
       [begin, n, g](const tbb::blocked_range<size_t>& r) {
         for (size_t idx = r.begin(); idx != r.end(); ++idx) {
           *(begin + idx) = g(n, idx);
         }
-      });
+      },
+      tbb::static_partitioner());
+}
+
+//! Apply the page placement before the keys are generated. With
+//! Placement::bind every thread binds the chunk it generates in
+//! parallel_rand to its local node.
+template <typename RandomIt>
+inline void parallel_place(
+    RandomIt begin, RandomIt end, numa::Placement placement)
+{
+  assert(!(end < begin));
+
+  using value_t = typename std::iterator_traits<RandomIt>::value_type;
+
+  auto const n     = static_cast<size_t>(std::distance(begin, end));
+  auto* const data = std::addressof(*begin);
+
+  if (placement != numa::Placement::bind) {
+    numa::place(data, n * sizeof(value_t), placement);
+    return;
+  }
+
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, n),
+      [data](const tbb::blocked_range<size_t>& r) {
+        numa::bind_local(
+            data + r.begin(), (r.end() - r.begin()) * sizeof(value_t));
+      },
+      tbb::static_partitioner());
+}
+
+//! Calls f(lo, hi) for the static chunks of [0, n) also used by
+//! parallel_rand.
+template <typename F>
+inline void parallel_for_static(size_t n, F f)
+{
+  tbb::parallel_for(
+      tbb::blocked_range<size_t>(0, n),
+      [f](const tbb::blocked_range<size_t>& r) { f(r.begin(), r.end()); },
+      tbb::static_partitioner());
+}
+
+//! Pins every thread entering the scheduler to the CPU matching its arena
+//! slot, so generation and sort share a thread layout.
+class ThreadPinning : public tbb::task_scheduler_observer {
+public:
+  ThreadPinning()
+  {
+    observe(true);
+  }
+
+  ~ThreadPinning()
+  {
+    observe(false);
+  }
+
+  void on_scheduler_entry(bool) override
+  {
+    auto const slot = tbb::this_task_arena::current_thread_index();
+    if (slot >= 0) {
+      numa::pin_thread(static_cast<unsigned>(slot));
+    }
+  }
+};
+
+inline void pin_threads()
+{
+  static ThreadPinning pinning{};
 }
 
 template <typename Container, typename Cmp>
 inline void parallel_sort(Container& c, Cmp cmp)
 {
-  auto begin = c.begin();
-  auto end   = c.end();
+  auto* begin = c.data();
+  auto* end   = begin + c.size();
   pss::parallel_stable_sort(begin, end, cmp);
 }
 
+//! parallel_sort by a single thread, the baseline of the parallel efficiency
+//! (--scaling)
+template <typename Container, typename Cmp>
+inline void baseline_sort(Container& c, Cmp cmp)
+{
+  tbb::task_arena single(1);
+  single.execute([&] { parallel_sort(c, cmp); });
+}
+
+template <typename Container, typename Cmp>
+inline void parallel_sort(
+    Container& c, Cmp cmp, pss::scratch_arena const& arena)
+{
+  auto* begin = c.data();
+  auto* end   = begin + c.size();
+  pss::parallel_stable_sort(begin, end, cmp, arena);
+}
+
+//! Per-thread runs and a single pss::parallel_multiway_merge instead of the
+//! binary merge tree, see --merge
+template <typename Container, typename Cmp>
+inline void parallel_sort_multiway(Container& c, Cmp cmp)
+{
+  auto* begin = c.data();
+  auto* end   = begin + c.size();
+  pss::parallel_stable_sort_multiway(begin, end, cmp);
+}
+
+template <typename Container, typename Cmp>
+inline void parallel_sort_multiway(
+    Container& c, Cmp cmp, pss::scratch_arena const& arena)
+{
+  auto* begin = c.data();
+  auto* end   = begin + c.size();
+  pss::parallel_stable_sort_multiway(begin, end, cmp, arena);
+}
+
+//! Code path taken by the last parallel_sort
+inline char const* sort_path()
+{
+  return pss::to_string(pss::last_sort_path());
+}
+
+//! Bytes moved through memory by the last parallel_sort of n keys
+template <typename T>
+inline double sort_traffic(size_t n)
+{
+  auto const path = pss::last_sort_path();
+  if (path == pss::sort_path::multiway ||
+      path == pss::sort_path::multiway_arena) {
+    return traffic::multiway_merge_sort(
+        n,
+        sizeof(T),
+        pss::internal::multiway_runs(
+            n, tbb::this_task_arena::max_concurrency()),
+        pss::cut_offs_for<T>().sort);
+  }
+  return traffic::merge_sort(n, sizeof(T), pss::cut_offs_for<T>().sort);
+}
+
+//! Every range checks its elements including the boundary to the previous
+//! range, all ranges stop early once a violation is found.
 template <typename RandomIt, typename Compare>
 inline bool parallel_verify(RandomIt begin, RandomIt end, Compare cmp)
 {
@@ -51,22 +192,44 @@ inline bool parallel_verify(RandomIt begin, RandomIt end, Compare cmp)
 
   auto const n = static_cast<size_t>(std::distance(begin, end));
 
-  size_t nerror = 0;
+  if (n < 2) return true;
 
-  tbb::parallel_for(
-      tbb::blocked_range<size_t>(1, n),
-      [begin, cmp, &nerror](const tbb::blocked_range<size_t>& r) {
-        for (size_t idx = r.begin(); idx != r.end(); ++idx) {
-          auto it = begin + idx;
-          if (cmp(*it, *(it - 1))) {
-            LOG("Failed sort order: {prev: " << *(it - 1) << ", cur: " << *it
-                                             << "}");
-            ++nerror;
-          }
-        }
-      });
+  auto const* first = std::addressof(*begin);
+
+  std::atomic<bool> failed{false};
+
+  auto const nerror = tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, n),
+      size_t{0},
+      [first, cmp, &failed](
+          const tbb::blocked_range<size_t>& r, size_t init) {
+        return init + verify_chunk(first, r.begin(), r.end(), cmp, failed);
+      },
+      std::plus<size_t>(),
+      tbb::static_partitioner());
 
   return nerror == 0;
 }
+
+template <typename RandomIt>
+inline Fingerprint parallel_fingerprint(RandomIt begin, RandomIt end)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  if (n == 0) return {};
+
+  auto const* first = std::addressof(*begin);
+
+  return tbb::parallel_reduce(
+      tbb::blocked_range<size_t>(0, n),
+      Fingerprint{},
+      [first](const tbb::blocked_range<size_t>& r, Fingerprint init) {
+        return init += fingerprint(first, r.begin(), r.end());
+      },
+      [](Fingerprint lhs, Fingerprint const& rhs) { return lhs += rhs; },
+      tbb::static_partitioner());
+}
 }  // namespace sortbench
 #endif
@@ -1,15 +1,21 @@
 #ifndef SORTBENCH_H__INCLUDED
 #define SORTBENCH_H__INCLUDED
 #include <mpi.h>
+#include <atomic>
 #include <cassert>
 #include <iterator>
+#include <memory>
 #include <random>
 
 #include <usort/include/binUtils.h>
 #include <usort/include/ompUtils.h>
 #include <usort/include/parUtils.h>
 
+#include <util/Bandwidth.h>
 #include <util/Logging.h>
+#include <util/Numa.h>
+#include <util/Verify.h>
+#include <util/Timer.h>
 
 namespace sortbench {
 template <typename RandomIt, typename Gen>
@@ -19,12 +25,44 @@ inline void parallel_rand(RandomIt begin, RandomIt end, Gen const g)
 
   auto const n = static_cast<size_t>(std::distance(begin, end));
 
+  // generators are indexed globally, i.e. the keys of rank r follow the
+  // keys of ranks 0..r-1
+  unsigned long long nl = n, offset = 0, total = 0;
+  MPI_Exscan(&nl, &offset, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(
+      &nl, &total, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+
+  int ThisTask;
+  MPI_Comm_rank(MPI_COMM_WORLD, &ThisTask);
+  // MPI_Exscan leaves the receive buffer of rank 0 undefined
+  if (ThisTask == 0) offset = 0;
+
   for (size_t idx = 0; idx < n; ++idx) {
     auto it = begin + idx;
-    *it     = g(n, idx);
+    *it     = g(total, offset + idx);
   }
 }
 
+//! Code path taken by the last parallel_sort
+inline char const* sort_path()
+{
+  return "hyperquicksort";
+}
+
+//! Bytes moved through memory by parallel_sort of n local keys. The local
+//! omp_par::merge_sort sorts a block per thread with std::sort and merges
+//! the blocks pairwise.
+template <typename T>
+inline double sort_traffic(size_t n)
+{
+  auto const threads = static_cast<size_t>(omp_get_max_threads());
+  return traffic::distributed_sort(
+      n,
+      sizeof(T),
+      traffic::quick_sort(n, sizeof(T), traffic::INTROSORT_CUT_OFF) +
+          2.0 * n * sizeof(T) * traffic::merge_levels(threads));
+}
+
 template <typename Container, typename Cmp>
 inline void parallel_sort(Container& c, Cmp cmp)
 {
@@ -39,26 +77,44 @@ inline void parallel_sort(Container& c, Cmp cmp)
   ::par::HyperQuickSort_kway(c, MPI_COMM_WORLD);
 }
 
+//! Sort of the keys by a single rank, i.e. the local merge sort of
+//! HyperQuickSort only, the baseline of the parallel efficiency (--scaling)
+template <typename Container, typename Cmp>
+inline void baseline_sort(Container& c, Cmp cmp)
+{
+  if (!c.empty()) {
+    omp_par::merge_sort(&c[0], &c[0] + c.size());
+  }
+}
+
 template <typename RandomIt, typename Cmp>
 inline bool parallel_verify(RandomIt begin, RandomIt end, Cmp cmp)
 {
   assert(!(end < begin));
 
-  auto const n      = static_cast<size_t>(std::distance(begin, end));
-  size_t     nerror = 0;
+  using value_t = typename std::iterator_traits<RandomIt>::value_type;
 
-  for (size_t idx = 1; idx < n; ++idx) {
-    auto it = begin + idx;
-    if (cmp(*it, *(it - 1))) {
-      LOG("Failed sort order: {prev: " << *(it - 1) << ", cur: " << *it
-                                       << "}");
-      ++nerror;
-    }
-  }
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  value_t const* first = n ? std::addressof(*begin) : nullptr;
+
+  std::atomic<bool> failed{false};
+  auto const        nlocal = verify_chunk(first, 0, n, cmp, failed);
 
-  MPI_Barrier(MPI_COMM_WORLD);
+  // collective
+  return verify_boundaries(first, n, cmp, nlocal) == 0;
+}
+
+//! Global fingerprint of the keys of all ranks, collective
+template <typename RandomIt>
+inline Fingerprint parallel_fingerprint(RandomIt begin, RandomIt end)
+{
+  assert(!(end < begin));
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
 
-  return nerror == 0;
+  return allreduce(n ? fingerprint(std::addressof(*begin), 0, n)
+                     : Fingerprint{});
 }
 }  // namespace sortbench
 #endif
@@ -0,0 +1,93 @@
+#ifndef ARGSORT_H__INCLUDED
+#define ARGSORT_H__INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+
+#include <util/Types.h>
+
+namespace sortbench {
+
+namespace argsort {
+
+// Sorting key / index pairs instead of the records and applying the sorted
+// permutation once: the merge or scatter passes move 8-16 bytes per record
+// instead of the whole record. The kernels are parallelized by the caller's
+// parallel_for(n, f), which calls f(lo, hi) on disjoint static chunks
+// covering [0, n).
+
+//! Pair of a value type T and index type I
+template <typename T, typename I>
+using pair_t = KeyIndex<typename record_traits<T>::key_type, I>;
+
+//! True if the positions of n values fit into 32 bits
+inline bool index32(size_t n)
+{
+  return n <= std::numeric_limits<uint32_t>::max();
+}
+
+//! pairs[i] = (key(src[i]), i)
+template <typename T, typename I, typename ParallelFor>
+void extract(T const* src, pair_t<T, I>* pairs, size_t n, ParallelFor pfor)
+{
+  pfor(n, [=](size_t lo, size_t hi) {
+    for (size_t idx = lo; idx < hi; ++idx) {
+      pairs[idx].key   = record_traits<T>::key(src[idx]);
+      pairs[idx].index = static_cast<I>(idx);
+    }
+  });
+}
+
+//! Records per block of the gather, the prefetched records of a block stay
+//! in L1 until they are copied
+template <typename T>
+constexpr size_t gather_block()
+{
+  return std::max<size_t>(8, (16 << 10) / sizeof(T));
+}
+
+//! dst[i] = src[pairs[i].index]. Every thread gathers its chunk of dst in
+//! blocks: all (random) source records of a block are prefetched before the
+//! first is copied, so their cache misses overlap instead of serializing on
+//! the copy loop. Reads of pairs and writes of dst are sequential.
+template <typename T, typename I, typename ParallelFor>
+void gather(
+    T const* src, pair_t<T, I> const* pairs, T* dst, size_t n, ParallelFor pfor)
+{
+  constexpr size_t block = gather_block<T>();
+  constexpr size_t line  = 64;
+
+  pfor(n, [=](size_t lo, size_t hi) {
+    for (size_t b = lo; b < hi; b += block) {
+      auto const be = std::min(hi, b + block);
+#if defined(__GNUC__)
+      for (size_t idx = b; idx < be; ++idx) {
+        auto const* rec = reinterpret_cast<char const*>(src + pairs[idx].index);
+        for (size_t off = 0; off < sizeof(T); off += line) {
+          __builtin_prefetch(rec + off);
+        }
+      }
+#endif
+      for (size_t idx = b; idx < be; ++idx) {
+        dst[idx] = src[pairs[idx].index];
+      }
+    }
+  });
+}
+
+//! dst[0, n) = src[0, n)
+template <typename T, typename ParallelFor>
+void copy(T const* src, T* dst, size_t n, ParallelFor pfor)
+{
+  pfor(n, [=](size_t lo, size_t hi) {
+    std::copy(src + lo, src + hi, dst + lo);
+  });
+}
+
+}  // namespace argsort
+
+}  // namespace sortbench
+
+#endif
@@ -0,0 +1,215 @@
+#ifndef BANDWIDTH_H__INCLUDED
+#define BANDWIDTH_H__INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+
+#include <util/Timer.h>
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+#include <mpi.h>
+#endif
+
+namespace sortbench {
+
+//! Sustained memory bandwidth in bytes / s of all nodes the job runs on.
+//! Zero if not measured.
+struct StreamBandwidth {
+  double copy   = 0;
+  double triad  = 0;
+  size_t nnodes = 1;
+};
+
+//! STREAM style copy and triad kernels over three arrays of nbytes / 3
+//! doubles each per node. par_for(n, f) has to call f(lo, hi) for static
+//! chunks of [0, n), using the thread layout of the sort. The best of ntimes
+//! runs is reported, bytes are counted as in STREAM (no write allocate).
+//! Collective for the distributed backends: the ranks of a node split the
+//! working set, run the kernels at the same time and the bandwidths of all
+//! ranks are summed.
+template <typename ParFor>
+StreamBandwidth stream_probe(size_t nbytes, ParFor par_for, int ntimes = 5)
+{
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  MPI_Comm node_comm;
+  MPI_Comm_split_type(
+      MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &node_comm);
+
+  int node_rank, node_size;
+  MPI_Comm_rank(node_comm, &node_rank);
+  MPI_Comm_size(node_comm, &node_size);
+  nbytes /= static_cast<size_t>(node_size);
+#endif
+
+  auto const n = std::max<size_t>(1, nbytes / (3 * sizeof(double)));
+
+  using vec_t = std::unique_ptr<double[]>;
+  // default initialized, the first touch happens in the chunks below
+  vec_t a(new double[n]), b(new double[n]), c(new double[n]);
+
+  double* const pa = a.get();
+  double* const pb = b.get();
+  double* const pc = c.get();
+
+  par_for(n, [=](size_t lo, size_t hi) {
+    for (size_t idx = lo; idx < hi; ++idx) {
+      pa[idx] = 1.0;
+      pb[idx] = 2.0;
+      pc[idx] = 0.0;
+    }
+  });
+
+  double constexpr scalar = 3.0;
+
+  double best_copy  = std::numeric_limits<double>::max();
+  double best_triad = std::numeric_limits<double>::max();
+
+  for (int iter = 0; iter < ntimes; ++iter) {
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+    MPI_Barrier(node_comm);
+#endif
+    auto start = ChronoClockNow();
+    par_for(n, [=](size_t lo, size_t hi) {
+      for (size_t idx = lo; idx < hi; ++idx) {
+        pc[idx] = pa[idx];
+      }
+    });
+    best_copy = std::min(best_copy, ChronoClockNow() - start);
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+    MPI_Barrier(node_comm);
+#endif
+    start = ChronoClockNow();
+    par_for(n, [=](size_t lo, size_t hi) {
+      for (size_t idx = lo; idx < hi; ++idx) {
+        pa[idx] = pb[idx] + scalar * pc[idx];
+      }
+    });
+    best_triad = std::min(best_triad, ChronoClockNow() - start);
+  }
+
+  StreamBandwidth bw;
+  bw.copy  = 2 * sizeof(double) * n / best_copy;
+  bw.triad = 3 * sizeof(double) * n / best_triad;
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  MPI_Comm_free(&node_comm);
+
+  double local[3] = {bw.copy, bw.triad, node_rank == 0 ? 1.0 : 0.0};
+  double total[3];
+  MPI_Allreduce(local, total, 3, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  bw.copy   = total[0];
+  bw.triad  = total[1];
+  bw.nnodes = static_cast<size_t>(total[2]);
+#endif
+
+  return bw;
+}
+
+namespace traffic {
+
+// Models of the bytes a sort moves through memory (read + write), used to
+// relate the sort time to the memory roofline. Passes over cache resident
+// blocks count as a single pass.
+
+//! Parallel stable merge sort (PSS): recursive halving down to cutoff
+//! elements, every merge level streams all records between keys and
+//! scratch buffer. The leaves are sorted in cache and moved to the scratch
+//! buffer if the recursion depth is odd. cutoff is the sort cut-off in use,
+//! i.e. pss::cut_offs_for<T>().sort.
+inline double merge_sort(size_t n, size_t elem_size, size_t cutoff)
+{
+  size_t depth = 0;
+  for (size_t len = n; len > cutoff; len = (len + 1) / 2) {
+    ++depth;
+  }
+  auto const passes = depth + 1 + (depth % 2);
+  return 2.0 * n * elem_size * passes;
+}
+
+//! PSS with per-thread runs (--merge=multiway): every run is merge sorted
+//! into the scratch buffer, a single multiway merge moves all records back.
+inline double multiway_merge_sort(
+    size_t n, size_t elem_size, size_t nruns, size_t cutoff)
+{
+  size_t depth = 0;
+  for (size_t len = n / nruns; len > cutoff; len = (len + 1) / 2) {
+    ++depth;
+  }
+  // the leaves move their records to the buffer if the depth is even
+  auto const passes = depth + 1 + (1 - depth % 2) + 1;
+  return 2.0 * n * elem_size * passes;
+}
+
+//! LSD radix sort: one read for the histograms, a read and a scattered write
+//! per executed pass and a final copy if the result ends up in the buffer.
+inline double radix_sort(size_t n, size_t elem_size, unsigned passes)
+{
+  return static_cast<double>(n) * elem_size *
+         (1 + 2 * passes + 2 * (passes % 2));
+}
+
+//! std::sort (libstdc++) finishes ranges of 16 elements by insertion sort
+constexpr size_t INTROSORT_CUT_OFF = 16;
+
+//! In-place quicksort: every partition level reads all records and swaps
+//! (at most) all of them, ranges below cutoff are sorted in cache.
+inline double quick_sort(size_t n, size_t elem_size, size_t cutoff)
+{
+  size_t depth = 0;
+  for (size_t len = n; len > cutoff; len = (len + 1) / 2) {
+    ++depth;
+  }
+  return 2.0 * n * elem_size * (depth + 1);
+}
+
+//! Argsort (--argsort): extracting the key / index pairs, sorting them
+//! (pair_sort_bytes), a gather reading the pairs and the records in sorted
+//! order (whole cache lines) and writing them to a buffer, which is copied
+//! back.
+inline double argsort(
+    size_t n, size_t elem_size, size_t pair_size, double pair_sort_bytes)
+{
+  constexpr size_t line = 64;
+  auto const       lines = (elem_size + line - 1) / line * line;
+  return static_cast<double>(n) *
+             (elem_size + pair_size + pair_size + lines + elem_size +
+              2 * elem_size) +
+         pair_sort_bytes;
+}
+
+//! Sample / splitter based distributed sorts: the local sort, whose bytes
+//! (local_sort_bytes) come from the model of the local kernel of the
+//! backend, packing the send buffer, receive and the final merge of the
+//! received runs.
+inline double distributed_sort(
+    size_t nlocal, size_t elem_size, double local_sort_bytes)
+{
+  return local_sort_bytes + 2.0 * nlocal * elem_size * 3;
+}
+
+//! Merge levels of a pairwise merge of nruns runs
+inline unsigned merge_levels(size_t nruns)
+{
+  unsigned levels = 0;
+  for (size_t runs = 1; runs < nruns; runs *= 2) {
+    ++levels;
+  }
+  return levels;
+}
+
+//! Incremental re-sort (--incremental): compacting the unchanged keys, the
+//! merge with the received changed keys into a buffer and the rebalance
+//! back into the keys. Sorting the few changed keys is not counted.
+inline double incremental_sort(size_t nlocal, size_t elem_size)
+{
+  return 2.0 * nlocal * elem_size * 3;
+}
+
+}  // namespace traffic
+
+}  // namespace sortbench
+
+#endif
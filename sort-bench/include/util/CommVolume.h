@@ -0,0 +1,111 @@
+#ifndef COMMVOLUME_H__INCLUDED
+#define COMMVOLUME_H__INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace sortbench {
+
+namespace comm {
+
+// Bytes the ranks send each other during the sort (--comm). The MPI calls
+// are intercepted through the PMPI profiling interface (src/CommVolume.cc),
+// which also counts the exchange inside the libraries we cannot modify
+// (DART, MP-sort, usort). Point-to-point sends and collectives count their
+// payload at the sender, one-sided gets at the origin on behalf of the
+// target. Copies the libraries do without MPI calls, e.g. through shared
+// memory windows, are not seen. No-ops for the shared memory backends.
+
+//! Clears the counts and counts the MPI calls of this rank until stop()
+void start();
+
+//! Stops counting
+void stop();
+
+//! Clears the timer and times the intercepted MPI calls of this rank until
+//! stop_timer(). These are the calls the sorts exchange keys and reduce
+//! counts with, receives, waits and barriers included.
+void start_timer();
+
+//! Stops timing, returns the wall time spent inside the intercepted calls
+//! since start_timer()
+double stop_timer();
+
+//! Bytes rank i sent to rank j between start() and stop() at [i * P + j] on
+//! rank 0, empty on all other ranks. Collective.
+std::vector<unsigned long long> gather_matrix();
+
+//! Totals and imbalance of a P x P matrix, the diagonal (copies to self)
+//! excluded
+struct Volume {
+  //! bytes sent between different ranks
+  unsigned long long total = 0;
+  //! max / mean of the bytes the ranks send, 0 if nothing was sent
+  double send_imbalance = 0;
+  //! max / mean of the bytes the ranks receive, 0 if nothing was sent
+  double recv_imbalance = 0;
+};
+
+inline Volume volume(std::vector<unsigned long long> const& m, size_t P)
+{
+  std::vector<unsigned long long> sent(P, 0), recv(P, 0);
+  Volume                          v;
+  for (size_t from = 0; from < P; ++from) {
+    for (size_t to = 0; to < P; ++to) {
+      if (from == to) continue;
+      auto const bytes = m[from * P + to];
+      sent[from] += bytes;
+      recv[to] += bytes;
+      v.total += bytes;
+    }
+  }
+  if (v.total > 0) {
+    auto const mean = static_cast<double>(v.total) / static_cast<double>(P);
+    v.send_imbalance =
+        static_cast<double>(*std::max_element(sent.begin(), sent.end())) /
+        mean;
+    v.recv_imbalance =
+        static_cast<double>(*std::max_element(recv.begin(), recv.end())) /
+        mean;
+  }
+  return v;
+}
+
+//! Header of the matrix CSV: one row per iteration and sending rank, one
+//! column per receiving rank
+inline void write_csv_header(std::ostream& os, size_t P)
+{
+  os << "Test Case,Type,Dist,Iter,From";
+  for (size_t to = 0; to < P; ++to) {
+    os << "," << to;
+  }
+  os << "\n";
+}
+
+inline void write_csv(
+    std::ostream&                          os,
+    std::vector<unsigned long long> const& m,
+    size_t                                 P,
+    std::string const&                     test_case,
+    std::string const&                     type,
+    std::string const&                     dist,
+    size_t                                 iter)
+{
+  for (size_t from = 0; from < P; ++from) {
+    os << test_case << "," << type << "," << dist << "," << iter << ","
+       << from;
+    for (size_t to = 0; to < P; ++to) {
+      os << "," << m[from * P + to];
+    }
+    os << "\n";
+  }
+}
+
+}  // namespace comm
+
+}  // namespace sortbench
+
+#endif
@@ -0,0 +1,73 @@
+#ifndef COMMANDLINE_H__INCLUDED
+#define COMMANDLINE_H__INCLUDED
+
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace sortbench {
+
+//! Splits the command line into positional arguments and flags of the form
+//! --name=value (or --name, which is equivalent to --name=1).
+class CommandLine {
+public:
+  CommandLine(int argc, char* argv[])
+  {
+    for (int idx = 1; idx < argc; ++idx) {
+      std::string const arg(argv[idx]);
+      if (arg.compare(0, 2, "--") != 0) {
+        positional_.push_back(arg);
+        continue;
+      }
+      auto const eq = arg.find('=');
+      if (eq == std::string::npos) {
+        flags_[arg.substr(2)] = "1";
+      }
+      else {
+        flags_[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+      }
+    }
+  }
+
+  std::vector<std::string> const& positional() const
+  {
+    return positional_;
+  }
+
+  bool has(std::string const& name) const
+  {
+    return flags_.count(name) > 0;
+  }
+
+  std::string get(std::string const& name, std::string const& def) const
+  {
+    auto const it = flags_.find(name);
+    return it == flags_.end() ? def : it->second;
+  }
+
+  long long get(std::string const& name, long long def) const
+  {
+    auto const it = flags_.find(name);
+    return it == flags_.end() ? def : std::atoll(it->second.c_str());
+  }
+
+  double get(std::string const& name, double def) const
+  {
+    auto const it = flags_.find(name);
+    return it == flags_.end() ? def : std::atof(it->second.c_str());
+  }
+
+  std::map<std::string, std::string> const& flags() const
+  {
+    return flags_;
+  }
+
+private:
+  std::vector<std::string>           positional_;
+  std::map<std::string, std::string> flags_;
+};
+
+}  // namespace sortbench
+
+#endif
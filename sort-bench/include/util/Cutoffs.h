@@ -0,0 +1,87 @@
+#ifndef CUTOFFS_H__INCLUDED
+#define CUTOFFS_H__INCLUDED
+
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace sortbench {
+
+//! Calibrated merge sort cut-offs of a backend for a key type and thread
+//! count, see --calibrate
+struct CutoffEntry {
+  std::string backend;
+  std::string type;
+  size_t      threads;
+  size_t      sort_cut_off;
+  size_t      merge_cut_off;
+};
+
+//! Reads a cut-off file with one entry per line:
+//!   <backend> <type> <threads> <sort cut-off> <merge cut-off>
+//! Empty lines and lines starting with '#' are skipped. A missing file
+//! yields no entries.
+inline std::vector<CutoffEntry> load_cutoffs(std::string const& path)
+{
+  std::vector<CutoffEntry> entries;
+  std::ifstream            is(path);
+  for (std::string line; std::getline(is, line);) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream ls(line);
+    CutoffEntry        e;
+    if (ls >> e.backend >> e.type >> e.threads >> e.sort_cut_off >>
+        e.merge_cut_off) {
+      entries.push_back(e);
+    }
+  }
+  return entries;
+}
+
+//! Entry for backend, type and threads, nullptr if there is none
+inline CutoffEntry const* find_cutoffs(
+    std::vector<CutoffEntry> const& entries,
+    std::string const&              backend,
+    std::string const&              type,
+    size_t                          threads)
+{
+  for (auto const& e : entries) {
+    if (e.backend == backend && e.type == type && e.threads == threads) {
+      return &e;
+    }
+  }
+  return nullptr;
+}
+
+//! Merges updates into the cut-off file, replacing the entries with the same
+//! backend, type and thread count. Returns false if the file cannot be
+//! written.
+inline bool save_cutoffs(
+    std::string const& path, std::vector<CutoffEntry> const& updates)
+{
+  auto entries = load_cutoffs(path);
+  for (auto const& u : updates) {
+    bool found = false;
+    for (auto& e : entries) {
+      if (e.backend == u.backend && e.type == u.type &&
+          e.threads == u.threads) {
+        e     = u;
+        found = true;
+      }
+    }
+    if (!found) entries.push_back(u);
+  }
+
+  std::ofstream os(path, std::ios::trunc);
+  os << "# <backend> <type> <threads> <sort cut-off> <merge cut-off>\n";
+  for (auto const& e : entries) {
+    os << e.backend << ' ' << e.type << ' ' << e.threads << ' '
+       << e.sort_cut_off << ' ' << e.merge_cut_off << '\n';
+  }
+  return os.good();
+}
+
+}  // namespace sortbench
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef EXCHANGE_H__INCLUDED
+#define EXCHANGE_H__INCLUDED
+
+#include <climits>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#include <mpi.h>
+
+namespace sortbench {
+
+//! Counts and displacements of an all-to-all exchange, in elements of the
+//! exchanged type. They are kept as size_t since a node sized rank (e.g.
+//! --hybrid) easily holds more than 2^31 keys. MPI 4 takes them as they are
+//! (MPI_Alltoallv_c), with an older MPI library a count or displacement
+//! beyond INT_MAX aborts the job instead of silently wrapping around.
+struct Exchange {
+  std::vector<size_t> scounts, sdispls, rcounts, rdispls;
+
+  explicit Exchange(size_t nranks)
+    : scounts(nranks)
+    , sdispls(nranks)
+    , rcounts(nranks)
+    , rdispls(nranks)
+  {
+  }
+
+  //! Receive counts and displacements for the send counts, returns the
+  //! number of elements to receive. Collective.
+  size_t recv_counts(MPI_Comm comm)
+  {
+    auto const                      P = scounts.size();
+    std::vector<unsigned long long> s(scounts.begin(), scounts.end()), r(P);
+    MPI_Alltoall(
+        s.data(),
+        1,
+        MPI_UNSIGNED_LONG_LONG,
+        r.data(),
+        1,
+        MPI_UNSIGNED_LONG_LONG,
+        comm);
+    size_t nrecv = 0;
+    for (size_t rank = 0; rank < P; ++rank) {
+      rcounts[rank] = static_cast<size_t>(r[rank]);
+      rdispls[rank] = nrecv;
+      nrecv += rcounts[rank];
+    }
+    return nrecv;
+  }
+
+  //! Sends scounts[i] elements at src + sdispls[i] to rank i, which
+  //! receives them at dst + rdispls[j] of the sending rank j. Collective.
+  void alltoallv(
+      void const* src, void* dst, MPI_Datatype type, MPI_Comm comm) const
+  {
+#if MPI_VERSION >= 4
+    std::vector<MPI_Count> sc(scounts.begin(), scounts.end());
+    std::vector<MPI_Count> rc(rcounts.begin(), rcounts.end());
+    std::vector<MPI_Aint>  sd(sdispls.begin(), sdispls.end());
+    std::vector<MPI_Aint>  rd(rdispls.begin(), rdispls.end());
+    MPI_Alltoallv_c(
+        src,
+        sc.data(),
+        sd.data(),
+        type,
+        dst,
+        rc.data(),
+        rd.data(),
+        type,
+        comm);
+#else
+    auto const sc = to_int(scounts, comm);
+    auto const sd = to_int(sdispls, comm);
+    auto const rc = to_int(rcounts, comm);
+    auto const rd = to_int(rdispls, comm);
+    MPI_Alltoallv(
+        src,
+        sc.data(),
+        sd.data(),
+        type,
+        dst,
+        rc.data(),
+        rd.data(),
+        type,
+        comm);
+#endif
+  }
+
+private:
+  static std::vector<int> to_int(
+      std::vector<size_t> const& values, MPI_Comm comm)
+  {
+    std::vector<int> out(values.size());
+    for (size_t idx = 0; idx < values.size(); ++idx) {
+      if (values[idx] > static_cast<size_t>(INT_MAX)) {
+        std::cerr << "all-to-all of " << values[idx]
+                  << " elements exceeds the int counts of MPI "
+                  << MPI_VERSION << ", use fewer keys per rank or MPI 4\n";
+        MPI_Abort(comm, 1);
+      }
+      out[idx] = static_cast<int>(values[idx]);
+    }
+    return out;
+  }
+};
+
+}  // namespace sortbench
+
+#endif
@@ -0,0 +1,597 @@
+#ifndef EXTERNAL_H__INCLUDED
+#define EXTERNAL_H__INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <util/Memory.h>
+#include <util/Timer.h>
+#include <util/Verify.h>
+
+namespace sortbench {
+
+namespace external {
+
+//! Local file accessed with positional I/O, throws std::system_error.
+class File {
+public:
+  File(std::string const& path, int flags)
+    : path_(path)
+    , fd_(::open(path.c_str(), flags, 0644))
+  {
+    if (fd_ < 0) {
+      throw std::system_error(errno, std::generic_category(), path);
+    }
+  }
+
+  File(File const&) = delete;
+  File& operator=(File const&) = delete;
+
+  ~File()
+  {
+    ::close(fd_);
+  }
+
+  size_t size() const
+  {
+    struct stat st;
+    if (::fstat(fd_, &st) != 0) {
+      throw std::system_error(errno, std::generic_category(), path_);
+    }
+    return static_cast<size_t>(st.st_size);
+  }
+
+  void truncate(size_t nbytes) const
+  {
+    if (::ftruncate(fd_, static_cast<off_t>(nbytes)) != 0) {
+      throw std::system_error(errno, std::generic_category(), path_);
+    }
+  }
+
+  void read(void* buf, size_t nbytes, size_t offset) const
+  {
+    auto* bytes = static_cast<char*>(buf);
+    while (nbytes > 0) {
+      auto const ret = ::pread(fd_, bytes, nbytes, static_cast<off_t>(offset));
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret <= 0) {
+        throw std::system_error(
+            ret < 0 ? errno : EIO, std::generic_category(), path_);
+      }
+      bytes += ret;
+      offset += static_cast<size_t>(ret);
+      nbytes -= static_cast<size_t>(ret);
+    }
+  }
+
+  void write(void const* buf, size_t nbytes, size_t offset) const
+  {
+    auto const* bytes = static_cast<char const*>(buf);
+    while (nbytes > 0) {
+      auto const ret =
+          ::pwrite(fd_, bytes, nbytes, static_cast<off_t>(offset));
+      if (ret < 0 && errno == EINTR) continue;
+      if (ret <= 0) {
+        throw std::system_error(
+            ret < 0 ? errno : EIO, std::generic_category(), path_);
+      }
+      bytes += ret;
+      offset += static_cast<size_t>(ret);
+      nbytes -= static_cast<size_t>(ret);
+    }
+  }
+
+  //! Hint for the kernel read-ahead, e.g. POSIX_FADV_WILLNEED starts an
+  //! asynchronous read of the range.
+  void advise(size_t offset, size_t nbytes, int advice) const
+  {
+    ::posix_fadvise(
+        fd_, static_cast<off_t>(offset), static_cast<off_t>(nbytes), advice);
+  }
+
+  std::string const& path() const
+  {
+    return path_;
+  }
+
+private:
+  std::string path_;
+  int         fd_;
+};
+
+//! Typed read of n values at element index idx
+template <typename T>
+inline void read_values(File const& f, T* buf, size_t n, size_t idx)
+{
+  f.read(buf, n * sizeof(T), idx * sizeof(T));
+}
+
+template <typename T>
+inline void write_values(File const& f, T const* buf, size_t n, size_t idx)
+{
+  f.write(buf, n * sizeof(T), idx * sizeof(T));
+}
+
+//! Time in seconds of an I/O or compute phase. The I/O phases overlap with
+//! the others, their time is the time spent in I/O calls, summed over all
+//! threads issuing them for the merge.
+struct Stats {
+  size_t bytes     = 0;
+  size_t nruns     = 0;
+  size_t nthreads  = 1;
+  double run_read  = 0;
+  double run_sort  = 0;
+  double run_write = 0;
+  double runs      = 0;
+  double merge_read  = 0;
+  double merge_write = 0;
+  double merge       = 0;
+};
+
+//! Accumulates the time spent in I/O calls across threads
+class IoClock {
+public:
+  template <typename F>
+  void time(F&& f)
+  {
+    auto const start = ChronoClockNow();
+    f();
+    auto const elapsed = ChronoClockNow() - start;
+    std::lock_guard<std::mutex> lock(mutex_);
+    seconds_ += elapsed;
+  }
+
+  double seconds() const
+  {
+    return seconds_;
+  }
+
+private:
+  std::mutex mutex_;
+  double     seconds_ = 0;
+};
+
+//! Phase 1: reads the input in runs of run_elems values, sorts every run
+//! with sort(std::vector<T>&) and writes it to the same offset of the run
+//! file. Reading run i + 1 and writing run i - 1 overlap with sorting run i
+//! (two run buffers).
+template <typename T, typename Sort>
+void form_runs(
+    File const& in, File const& runs, size_t run_elems, Sort sort, Stats& st)
+{
+  using buffer_t = std::vector<T, default_init_allocator<T>>;
+
+  auto const n     = in.size() / sizeof(T);
+  auto const nruns = (n + run_elems - 1) / run_elems;
+
+  st.nruns = nruns;
+
+  IoClock read_clock, write_clock;
+
+  buffer_t buf[2];
+  buf[0].resize(std::min(n, run_elems));
+  buf[1].resize(std::min(n, run_elems));
+
+  auto const run_lo  = [=](size_t run) { return run * run_elems; };
+  auto const run_len = [=](size_t run) {
+    return std::min(n, (run + 1) * run_elems) - run * run_elems;
+  };
+
+  auto const read_run = [&](size_t run, int b) {
+    buf[b].resize(run_len(run));
+    read_clock.time(
+        [&] { read_values(in, buf[b].data(), buf[b].size(), run_lo(run)); });
+  };
+  auto const write_run = [&](size_t run, int b) {
+    write_clock.time(
+        [&] { write_values(runs, buf[b].data(), buf[b].size(), run_lo(run)); });
+  };
+
+  std::future<void> pending_read, pending_write[2];
+
+  auto const start = ChronoClockNow();
+
+  if (nruns > 0) {
+    pending_read = std::async(std::launch::async, read_run, 0, 0);
+  }
+
+  for (size_t run = 0; run < nruns; ++run) {
+    int const b = static_cast<int>(run % 2);
+    pending_read.get();
+
+    if (run + 1 < nruns) {
+      // the other buffer is free once its last write completed
+      if (pending_write[1 - b].valid()) pending_write[1 - b].get();
+      pending_read =
+          std::async(std::launch::async, read_run, run + 1, 1 - b);
+    }
+
+    auto const sort_start = ChronoClockNow();
+    sort(buf[b]);
+    st.run_sort += ChronoClockNow() - sort_start;
+
+    pending_write[b] = std::async(std::launch::async, write_run, run, b);
+  }
+
+  for (auto& w : pending_write) {
+    if (w.valid()) w.get();
+  }
+
+  st.runs      = ChronoClockNow() - start;
+  st.run_read  = read_clock.seconds();
+  st.run_write = write_clock.seconds();
+}
+
+//! A key tagged with its run and position. The lexicographic order is a
+//! total order on all keys, i.e. partitions split runs of equal keys.
+template <typename T>
+struct tagged_t {
+  T      value;
+  size_t run;
+  size_t pos;
+};
+
+//! Position of the splitter s in run [lo, hi) of the run file
+template <typename T, typename Cmp>
+size_t split_position(
+    File const& f, size_t run, size_t lo, size_t hi, tagged_t<T> const& s,
+    Cmp cmp)
+{
+  if (s.run == run) return s.pos;
+  // equal keys of lower runs precede the splitter, of higher runs follow it
+  bool const upper = run < s.run;
+  while (lo < hi) {
+    auto const mid = lo + (hi - lo) / 2;
+    T          v;
+    read_values(f, &v, 1, mid);
+    bool const left = upper ? !cmp(s.value, v) : cmp(v, s.value);
+    if (left) {
+      lo = mid + 1;
+    }
+    else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+//! Sequential reader of a run segment with a block buffer, the next block
+//! is requested from the kernel read-ahead while the current one is merged.
+template <typename T>
+class RunReader {
+public:
+  RunReader(File const& f, size_t lo, size_t hi, size_t block, IoClock& clock)
+    : file_(&f)
+    , next_(lo)
+    , end_(hi)
+    , block_(block)
+    , clock_(&clock)
+    , buf_(block)
+  {
+    refill();
+  }
+
+  bool empty() const
+  {
+    return pos_ == len_;
+  }
+
+  T const& head() const
+  {
+    return buf_[pos_];
+  }
+
+  void pop()
+  {
+    if (++pos_ == len_) refill();
+  }
+
+private:
+  void refill()
+  {
+    pos_ = 0;
+    len_ = std::min(block_, end_ - next_);
+    if (len_ == 0) return;
+    clock_->time([&] { read_values(*file_, buf_.data(), len_, next_); });
+    next_ += len_;
+    auto const ahead = std::min(block_, end_ - next_);
+    if (ahead) {
+      file_->advise(
+          next_ * sizeof(T), ahead * sizeof(T), POSIX_FADV_WILLNEED);
+    }
+  }
+
+  File const*                               file_;
+  size_t                                    next_;
+  size_t                                    end_;
+  size_t                                    block_;
+  IoClock*                                  clock_;
+  std::vector<T, default_init_allocator<T>> buf_;
+  size_t                                    pos_ = 0;
+  size_t                                    len_ = 0;
+};
+
+//! Output of a merge partition, double buffered: a full block is written
+//! asynchronously while the other one is filled.
+template <typename T>
+class BlockWriter {
+public:
+  BlockWriter(File const& f, size_t offset, size_t block, IoClock& clock)
+    : file_(&f)
+    , offset_(offset)
+    , clock_(&clock)
+  {
+    buf_[0].reserve(block);
+    buf_[1].reserve(block);
+  }
+
+  ~BlockWriter()
+  {
+    for (auto& w : pending_) {
+      if (w.valid()) w.wait();
+    }
+  }
+
+  void push(T const& v)
+  {
+    buf_[cur_].push_back(v);
+    if (buf_[cur_].size() == buf_[cur_].capacity()) flush();
+  }
+
+  void flush()
+  {
+    if (buf_[cur_].empty()) return;
+    auto const b   = cur_;
+    auto const off = offset_;
+    offset_ += buf_[b].size();
+    pending_[b] = std::async(std::launch::async, [this, b, off] {
+      clock_->time([&] {
+        write_values(*file_, buf_[b].data(), buf_[b].size(), off);
+      });
+    });
+    cur_ = 1 - cur_;
+    if (pending_[cur_].valid()) pending_[cur_].get();
+    buf_[cur_].clear();
+  }
+
+  void finish()
+  {
+    flush();
+    for (auto& w : pending_) {
+      if (w.valid()) w.get();
+    }
+  }
+
+private:
+  File const*       file_;
+  size_t            offset_;
+  IoClock*          clock_;
+  std::vector<T>    buf_[2];
+  std::future<void> pending_[2];
+  int               cur_ = 0;
+};
+
+//! Phase 2: parallel k-way merge of the sorted runs [bounds[r],
+//! bounds[r + 1]) of the run file. The key range is split into partitions
+//! with exact boundaries in every run (from regular samples, ties broken by
+//! run and position), the threads merge whole partitions with a binary heap
+//! over the run heads and write them to their final offset in out.
+template <typename T, typename Cmp>
+void merge_runs(
+    File const&                runs,
+    std::vector<size_t> const& bounds,
+    File const&                out,
+    size_t                     nthreads,
+    size_t                     block_elems,
+    Cmp                        cmp,
+    Stats&                     st)
+{
+  auto const k = bounds.size() - 1;
+  auto const n = bounds.back();
+
+  auto const start = ChronoClockNow();
+
+  // partitions per thread for load balance
+  auto const nparts = std::max<size_t>(
+      1, std::min(4 * nthreads, n / std::max<size_t>(1, block_elems)));
+
+  std::vector<tagged_t<T>> samples;
+  for (size_t r = 0; r < k; ++r) {
+    auto const len = bounds[r + 1] - bounds[r];
+    auto const ns  = std::min<size_t>(len, 16 * nparts);
+    for (size_t s = 0; s < ns; ++s) {
+      auto const pos = bounds[r] + (2 * s + 1) * len / (2 * ns);
+      T          v;
+      read_values(runs, &v, 1, pos);
+      samples.push_back(tagged_t<T>{v, r, pos});
+    }
+  }
+  std::sort(
+      samples.begin(),
+      samples.end(),
+      [cmp](tagged_t<T> const& a, tagged_t<T> const& b) {
+        if (cmp(a.value, b.value)) return true;
+        if (cmp(b.value, a.value)) return false;
+        return a.run < b.run || (a.run == b.run && a.pos < b.pos);
+      });
+
+  // split[p * (k + 1) + r]: first position of partition p in run r
+  std::vector<size_t> split((nparts + 1) * k);
+  for (size_t r = 0; r < k; ++r) {
+    split[r]              = bounds[r];
+    split[nparts * k + r] = bounds[r + 1];
+  }
+  for (size_t p = 1; p < nparts; ++p) {
+    auto const& s = samples[p * samples.size() / nparts];
+    for (size_t r = 0; r < k; ++r) {
+      split[p * k + r] =
+          split_position(runs, r, bounds[r], bounds[r + 1], s, cmp);
+    }
+  }
+
+  IoClock             read_clock, write_clock;
+  std::atomic<size_t> next_part{0};
+  std::exception_ptr  error;
+  std::mutex          error_mutex;
+
+  auto const worker = [&]() {
+    try {
+      for (size_t p; (p = next_part++) < nparts;) {
+        // output offset: all keys of the previous partitions
+        size_t offset = 0;
+        for (size_t r = 0; r < k; ++r) {
+          offset += split[p * k + r] - bounds[r];
+        }
+
+        std::vector<RunReader<T>> readers;
+        readers.reserve(k);
+        for (size_t r = 0; r < k; ++r) {
+          readers.emplace_back(
+              runs,
+              split[p * k + r],
+              split[(p + 1) * k + r],
+              block_elems,
+              read_clock);
+        }
+
+        // min heap of the non-empty readers
+        std::vector<size_t> heap;
+        for (size_t r = 0; r < k; ++r) {
+          if (!readers[r].empty()) heap.push_back(r);
+        }
+        auto const heap_cmp = [&](size_t a, size_t b) {
+          return cmp(readers[b].head(), readers[a].head());
+        };
+        std::make_heap(heap.begin(), heap.end(), heap_cmp);
+
+        BlockWriter<T> writer(out, offset, block_elems, write_clock);
+        while (!heap.empty()) {
+          std::pop_heap(heap.begin(), heap.end(), heap_cmp);
+          auto& reader = readers[heap.back()];
+          writer.push(reader.head());
+          reader.pop();
+          if (reader.empty()) {
+            heap.pop_back();
+          }
+          else {
+            std::push_heap(heap.begin(), heap.end(), heap_cmp);
+          }
+        }
+        writer.finish();
+      }
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      error = std::current_exception();
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < nthreads; ++t) {
+    threads.emplace_back(worker);
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+  if (error) std::rethrow_exception(error);
+
+  st.merge       = ChronoClockNow() - start;
+  st.merge_read  = read_clock.seconds();
+  st.merge_write = write_clock.seconds();
+}
+
+//! Sorts the values of type T in the file input into output, using a run
+//! file output + ".runs" of the same size. run_elems values are sorted in
+//! memory at a time with sort(std::vector<T>&).
+template <typename T, typename Sort, typename Cmp>
+Stats external_sort(
+    std::string const& input,
+    std::string const& output,
+    size_t             run_elems,
+    size_t             nthreads,
+    size_t             block_elems,
+    Sort               sort,
+    Cmp                cmp)
+{
+  Stats st;
+  st.nthreads = nthreads;
+
+  File const in(input, O_RDONLY);
+  st.bytes = in.size() / sizeof(T) * sizeof(T);
+
+  auto const n        = st.bytes / sizeof(T);
+  auto const run_path = output + ".runs";
+  {
+    File const runs(run_path, O_RDWR | O_CREAT | O_TRUNC);
+    runs.truncate(st.bytes);
+    in.advise(0, st.bytes, POSIX_FADV_SEQUENTIAL);
+
+    form_runs<T>(in, runs, run_elems, sort, st);
+
+    std::vector<size_t> bounds;
+    for (size_t lo = 0; lo < n; lo += run_elems) {
+      bounds.push_back(lo);
+    }
+    bounds.push_back(n);
+
+    File const out(output, O_RDWR | O_CREAT | O_TRUNC);
+    out.truncate(st.bytes);
+
+    if (n > 0) {
+      merge_runs<T>(runs, bounds, out, nthreads, block_elems, cmp, st);
+    }
+  }
+  ::unlink(run_path.c_str());
+
+  return st;
+}
+
+//! Streams the file through memory in blocks, returns the number of order
+//! violations and sets fp to the fingerprint of the values.
+template <typename T, typename Cmp>
+size_t verify_file(
+    std::string const& path, size_t block_elems, Cmp cmp, Fingerprint& fp)
+{
+  File const f(path, O_RDONLY);
+  auto const n = f.size() / sizeof(T);
+
+  f.advise(0, n * sizeof(T), POSIX_FADV_SEQUENTIAL);
+
+  std::vector<T, default_init_allocator<T>> buf(block_elems + 1);
+  std::atomic<bool>                         failed{false};
+
+  size_t nerror = 0;
+  fp            = Fingerprint{};
+
+  for (size_t lo = 0; lo < n; lo += block_elems) {
+    auto const len = std::min(block_elems, n - lo);
+    // buf[0] holds the last value of the previous block
+    read_values(f, buf.data() + 1, len, lo);
+    nerror += verify_chunk(buf.data(), lo ? 1 : 2, len + 1, cmp, failed);
+    fp += fingerprint(buf.data(), 1, len + 1);
+    buf[0] = buf[len];
+  }
+
+  return nerror;
+}
+
+}  // namespace external
+
+}  // namespace sortbench
+
+#endif
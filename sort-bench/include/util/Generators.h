@@ -2,25 +2,51 @@
 #define GENERATORS_H__INCLUDED
 
 #include <util/Random.h>
-#include <random>
+#include <util/Types.h>
+
+#include <algorithm>
+#include <cmath>
+#include <string>
 #include <type_traits>
+#include <vector>
 
 namespace sortbench {
 
 constexpr double min = -1E6;
 constexpr double max = 1E6;
 
-static thread_local std::mt19937_64 generator(
-    sortbench::random_seed_seq::get_instance());
+//! Runtime parameters of the skewed distributions, set before generation
+struct DistParams {
+  // number of blocks for ranksorted, staggered and bucket, i.e. the number
+  // of ranks (distributed) or threads (shared memory)
+  size_t nblocks = 1;
+  // number of distinct keys of fewunique
+  size_t nunique = 16;
+  // exponent s of zipf, P(k) ~ 1 / k^s
+  double zipf_s = 1.0;
+  // number of distinct keys of zipf
+  size_t zipf_n = 1 << 20;
+};
+
+inline DistParams& dist_params()
+{
+  static DistParams params;
+  return params;
+}
+
+// All generators draw the sort key and build the value (key or record)
+// through record_traits. Random keys come from the counter-based generators
+// in Random.h, i.e. the data only depends on (rng_seed(), total, index) and
+// not on the number of threads or ranks generating it.
 
 template <typename key_t>
 key_t normal(size_t total, size_t index)
 {
-  using dist_t = NormalDistribution<key_t>;
-  static thread_local dist_t dist{};
+  using traits = record_traits<key_t>;
   // return index;
   // return total - index;
-  return dist(generator) * max;
+  return traits::make(
+      to_key<typename traits::key_type>(counter_normal(index) * max), index);
   // return static_cast<key_t>(std::round(dist(generator) * SIZE_FACTOR));
   // return std::rand();
 }
@@ -28,11 +54,13 @@ key_t normal(size_t total, size_t index)
 template <typename key_t>
 key_t uniform(size_t total, size_t index)
 {
-  using dist_t = UniformDistribution<key_t>;
-  static thread_local dist_t dist{key_t{min}, key_t{max}};
+  using traits = record_traits<key_t>;
   // return index;
   // return total - index;
-  return dist(generator);
+  return traits::make(
+      to_key<typename traits::key_type>(
+          min + (max - min) * counter_uniform(index)),
+      index);
   // return static_cast<key_t>(std::round(dist(generator) * SIZE_FACTOR));
   // return std::rand();
 }
@@ -40,51 +68,240 @@ key_t uniform(size_t total, size_t index)
 template <typename key_t>
 key_t sorted(size_t total, size_t index)
 {
-  return static_cast<key_t>(index);
+  using traits = record_traits<key_t>;
+  return traits::make(static_cast<typename traits::key_type>(index), index);
 }
 
 template <typename key_t>
 key_t reverse(size_t total, size_t index)
 {
-  return static_cast<key_t>(total - index);
+  using traits = record_traits<key_t>;
+  return traits::make(
+      static_cast<typename traits::key_type>(total - index), index);
 }
 
 template <typename key_t>
 key_t partial_sorted(size_t total, size_t index)
 {
-  using dist_t = NormalDistribution<key_t>;
-  static thread_local dist_t dist{};
-
+  using traits = record_traits<key_t>;
+  using k_t    = typename traits::key_type;
   const double OFFS   = 0.2;
   const double THRESH = 0.5;
 
   if (index > total * OFFS && index < total * (OFFS + THRESH)) {
-    return static_cast<key_t>(index);
+    return traits::make(static_cast<k_t>(index), index);
   }
   else {
-    return dist(generator) * max;
+    return traits::make(to_key<k_t>(counter_normal(index) * max), index);
   }
 }
 
 template <typename key_t>
 key_t partial_sorted_in_place(size_t total, size_t index)
 {
-  using dist_t        = UniformDistribution<key_t>;
+  using traits        = record_traits<key_t>;
+  using k_t           = typename traits::key_type;
   const double OFFS   = 0.2;
   const double THRESH = 0.5;
 
   if (index <= total * OFFS) {
-    static thread_local dist_t dist_low{key_t{0}, key_t{total * OFFS}};
-    return dist_low(generator);
+    auto const low = total * OFFS * counter_uniform(index);
+    return traits::make(static_cast<k_t>(low), index);
   }
   else if (index > total * OFFS && index < total * (OFFS + THRESH)) {
-    return static_cast<key_t>(index);
+    return traits::make(static_cast<k_t>(index), index);
+  }
+  else {
+    auto const high = total * (OFFS + THRESH) +
+                      total * (1 - OFFS - THRESH) * counter_uniform(index);
+    return traits::make(static_cast<k_t>(high), index);
+  }
+}
+
+//! Zipf distributed ranks in [1, zipf_n], most frequent key is 1. Inverse
+//! transform of the continuous bounded power law, which is close enough to
+//! the discrete distribution for the skew we are after.
+template <typename key_t>
+key_t zipf(size_t total, size_t index)
+{
+  using traits = record_traits<key_t>;
+  using k_t    = typename traits::key_type;
+
+  auto const& p = dist_params();
+  auto const  u = counter_uniform(index);
+  auto const  n = static_cast<double>(p.zipf_n);
+
+  double k;
+  if (std::fabs(p.zipf_s - 1.0) < 1e-9) {
+    k = std::pow(n + 1, u);
   }
   else {
-    static thread_local dist_t dist_high(
-        key_t{total * (OFFS + THRESH)}, key_t{total});
-    return dist_high(generator);
+    auto const e = 1.0 - p.zipf_s;
+    k            = std::pow((std::pow(n + 1, e) - 1.0) * u + 1.0, 1.0 / e);
+  }
+  auto const rank = std::min(n, std::floor(k));
+  return traits::make(static_cast<k_t>(rank), index);
+}
+
+//! Only nunique distinct keys, uniformly distributed
+template <typename key_t>
+key_t fewunique(size_t total, size_t index)
+{
+  using traits = record_traits<key_t>;
+  using k_t    = typename traits::key_type;
+
+  auto const nunique = dist_params().nunique;
+  auto const k       = std::min(
+      nunique - 1,
+      static_cast<size_t>(counter_uniform(index) * nunique));
+  return traits::make(static_cast<k_t>(k), index);
+}
+
+//! All keys are equal
+template <typename key_t>
+key_t equal(size_t total, size_t index)
+{
+  using traits = record_traits<key_t>;
+  return traits::make(to_key<typename traits::key_type>(0.0), index);
+}
+
+namespace detail {
+
+//! Block (rank or thread) of index, with total / nblocks elements per block
+inline size_t block_of(size_t total, size_t index, size_t nblocks)
+{
+  auto const bsize = (total + nblocks - 1) / nblocks;
+  return bsize ? std::min(nblocks - 1, index / bsize) : 0;
+}
+
+//! Bijection on [0, n): b -> (a * b + c) mod n with a coprime to n. The
+//! coefficients are derived from the seed once per thread.
+inline size_t shuffle_block(size_t b, size_t n)
+{
+  struct coeffs_t {
+    size_t   n    = 0;
+    uint64_t seed = 0;
+    size_t   a    = 1;
+    size_t   c    = 0;
+  };
+  static thread_local coeffs_t coeffs;
+
+  if (n < 2) return b;
+
+  if (coeffs.n != n || coeffs.seed != rng_seed()) {
+    auto const r = counter_rng(n, rng_stream::uniform);
+    auto       a = static_cast<size_t>(r.v[0]) % n;
+    auto       gcd = [](size_t x, size_t y) {
+      while (y) {
+        auto const t = x % y;
+        x            = y;
+        y            = t;
+      }
+      return x;
+    };
+    while (gcd(a, n) != 1) {
+      a = (a + 1) % n;
+    }
+    coeffs = {n, rng_seed(), a, static_cast<size_t>(r.v[1]) % n};
+  }
+  // a, b < n, i.e. the product does not overflow for any sensible n
+  return (coeffs.a * b + coeffs.c) % n;
+}
+
+}  // namespace detail
+
+//! Every block is a sorted run, but the key ranges of the blocks are
+//! shuffled, i.e. each rank holds sorted keys which all belong to another
+//! rank after the sort.
+template <typename key_t>
+key_t ranksorted(size_t total, size_t index)
+{
+  using traits = record_traits<key_t>;
+  using k_t    = typename traits::key_type;
+
+  auto const nblocks = dist_params().nblocks;
+  auto const bsize   = (total + nblocks - 1) / nblocks;
+  auto const b       = detail::block_of(total, index, nblocks);
+  auto const k =
+      detail::shuffle_block(b, nblocks) * bsize + (index - b * bsize);
+  return traits::make(static_cast<k_t>(k), index);
+}
+
+//! Staggered (Helman, Bader, JaJa): the key range is split into P slots of
+//! width R / P, block i < P/2 draws uniformly from slot 2i + 1, block
+//! i >= P/2 from slot 2 (i - P/2), which is 2i - P for even P. Every block
+//! has to send all its keys to a single other block. For odd P the slots
+//! are still a permutation, the last block keeps its keys (slot P - 1).
+template <typename key_t>
+key_t staggered(size_t total, size_t index)
+{
+  using traits = record_traits<key_t>;
+  using k_t    = typename traits::key_type;
+
+  auto const P     = dist_params().nblocks;
+  auto const i     = detail::block_of(total, index, P);
+  auto const range = (max - min) / P;
+
+  // the P/2 odd slots first, then the (P + 1) / 2 even ones
+  auto const half = P / 2;
+  auto const slot = i < half ? 2 * i + 1 : 2 * (i - half);
+  return traits::make(
+      to_key<k_t>(min + slot * range + range * counter_uniform(index)),
+      index);
+}
+
+//! Bucket sorted (Helman, Bader, JaJa): every block consists of P sorted
+//! buckets, bucket j holds uniform keys from [j R / P, (j + 1) R / P).
+template <typename key_t>
+key_t bucket(size_t total, size_t index)
+{
+  using traits = record_traits<key_t>;
+  using k_t    = typename traits::key_type;
+
+  auto const P     = dist_params().nblocks;
+  auto const bsize = (total + P - 1) / P;
+  auto const b     = detail::block_of(total, index, P);
+  auto const off   = index - b * bsize;
+  auto const j = std::min(P - 1, bsize ? off * P / bsize : size_t{0});
+  auto const range = (max - min) / P;
+  return traits::make(
+      to_key<k_t>(min + j * range + range * counter_uniform(index)), index);
+}
+
+//! Generator by name, selected with --dist
+template <typename key_t>
+struct Distribution {
+  char const* name;
+  key_t (*gen)(size_t, size_t);
+};
+
+template <typename key_t>
+inline std::vector<Distribution<key_t>> const& distributions()
+{
+  static std::vector<Distribution<key_t>> const dists{
+      {"normal", normal<key_t>},
+      {"uniform", uniform<key_t>},
+      {"sorted", sorted<key_t>},
+      {"reverse", reverse<key_t>},
+      {"partial_sorted", partial_sorted<key_t>},
+      {"partial_sorted_in_place", partial_sorted_in_place<key_t>},
+      {"zipf", zipf<key_t>},
+      {"fewunique", fewunique<key_t>},
+      {"equal", equal<key_t>},
+      {"ranksorted", ranksorted<key_t>},
+      {"staggered", staggered<key_t>},
+      {"bucket", bucket<key_t>}};
+  return dists;
+}
+
+//! Generator for name, nullptr if there is none
+template <typename key_t>
+inline key_t (*find_distribution(std::string const& name))(size_t, size_t)
+{
+  for (auto const& d : distributions<key_t>()) {
+    if (name == d.name) return d.gen;
   }
+  return nullptr;
 }
 
 }  // namespace sortbench
@@ -0,0 +1,414 @@
+#ifndef MEMORY_H__INCLUDED
+#define MEMORY_H__INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/resource.h>
+#endif
+
+#include <util/Numa.h>
+
+namespace sortbench {
+
+//! Allocator which default-initializes elements, i.e. a vector of
+//! trivial types does not touch its pages on construction. This leaves page
+//! placement to the NUMA policy and the threads generating the keys.
+template <typename T, typename A = std::allocator<T>>
+class default_init_allocator : public A {
+  using traits = std::allocator_traits<A>;
+
+public:
+  template <typename U>
+  struct rebind {
+    using other =
+        default_init_allocator<U, typename traits::template rebind_alloc<U>>;
+  };
+
+  using A::A;
+
+  template <typename U>
+  void construct(U* ptr) noexcept(
+      std::is_nothrow_default_constructible<U>::value)
+  {
+    ::new (static_cast<void*>(ptr)) U;
+  }
+
+  template <typename U, typename... Args>
+  void construct(U* ptr, Args&&... args)
+  {
+    traits::construct(
+        static_cast<A&>(*this), ptr, std::forward<Args>(args)...);
+  }
+};
+
+//! Pages backing the keys and the scratch buffers, see --pages
+enum class Pages {
+  //! base pages (4 KB on x86)
+  base,
+  //! transparent huge pages, madvise(MADV_HUGEPAGE)
+  thp,
+  //! explicit 2 MB pages from the hugetlbfs pool, MAP_HUGETLB
+  hugetlb
+};
+
+inline char const* to_string(Pages pages)
+{
+  switch (pages) {
+    case Pages::base: return "4k";
+    case Pages::thp: return "thp";
+    case Pages::hugetlb: return "hugetlb";
+    default: return "unknown";
+  }
+}
+
+//! Parses 4k, thp or hugetlb, returns false for anything else
+inline bool parse_pages(std::string const& name, Pages& pages)
+{
+  for (auto const p : {Pages::base, Pages::thp, Pages::hugetlb}) {
+    if (name == to_string(p)) {
+      pages = p;
+      return true;
+    }
+  }
+  return false;
+}
+
+//! Requested backing of large allocations, set once at startup before any
+//! allocation through page_allocate
+inline Pages& page_mode()
+{
+  static Pages mode = Pages::base;
+  return mode;
+}
+
+//! Backing obtained by the last large allocation through page_allocate or
+//! ScratchArena
+inline Pages& last_page_backing()
+{
+  static Pages backing = Pages::base;
+  return backing;
+}
+
+//! Number of large allocations page_allocate has mapped so far
+inline size_t& page_mappings()
+{
+  static size_t n = 0;
+  return n;
+}
+
+constexpr size_t huge_page_size = size_t(2) << 20;
+
+//! Allocations below one huge page are never backed by huge pages
+inline bool page_mapped(size_t nbytes)
+{
+#ifdef __linux__
+  return page_mode() != Pages::base && nbytes >= huge_page_size;
+#else
+  return false;
+#endif
+}
+
+#ifdef __linux__
+
+namespace detail {
+
+inline size_t huge_page_round(size_t nbytes)
+{
+  return (nbytes + huge_page_size - 1) & ~(huge_page_size - 1);
+}
+
+//! Anonymous mapping of nbytes backed as requested. Explicit huge pages fall
+//! back to transparent ones if the pool cannot serve the mapping, transparent
+//! huge pages fall back to base pages if THP is disabled. Returns nullptr if
+//! no memory could be mapped at all.
+inline void* map_pages(size_t nbytes, Pages requested, Pages& obtained)
+{
+  int const prot  = PROT_READ | PROT_WRITE;
+  int const flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+  obtained = Pages::base;
+  if (requested == Pages::base) {
+    void* ptr = mmap(nullptr, nbytes, prot, flags, -1, 0);
+    return ptr == MAP_FAILED ? nullptr : ptr;
+  }
+
+  auto const len = huge_page_round(nbytes);
+#ifdef MAP_HUGETLB
+  if (requested == Pages::hugetlb) {
+    void* ptr = mmap(nullptr, len, prot, flags | MAP_HUGETLB, -1, 0);
+    if (ptr != MAP_FAILED) {
+      obtained = Pages::hugetlb;
+      return ptr;
+    }
+  }
+#endif
+
+  // over-allocate by one huge page and trim, so that the kernel can back
+  // the mapping with aligned huge pages from its first byte
+  void* raw = mmap(nullptr, len + huge_page_size, prot, flags, -1, 0);
+  if (raw == MAP_FAILED) return nullptr;
+  auto const addr    = reinterpret_cast<uintptr_t>(raw);
+  auto const aligned = huge_page_round(addr);
+  if (aligned > addr) {
+    munmap(raw, aligned - addr);
+  }
+  munmap(
+      reinterpret_cast<void*>(aligned + len), addr + huge_page_size - aligned);
+  void* ptr = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+  if (madvise(ptr, len, MADV_HUGEPAGE) == 0) {
+    obtained = Pages::thp;
+  }
+#endif
+  return ptr;
+}
+
+//! Releases a mapping of map_pages(nbytes, requested, ...)
+inline void unmap_pages(void* ptr, size_t nbytes, Pages requested)
+{
+  munmap(ptr, requested == Pages::base ? nbytes : huge_page_round(nbytes));
+}
+
+}  // namespace detail
+
+#endif
+
+//! Allocates nbytes with the backing of page_mode(), returns nullptr on
+//! failure. Small allocations and the 4k mode use operator new.
+inline void* page_allocate(size_t nbytes)
+{
+#ifdef __linux__
+  if (page_mapped(nbytes)) {
+    Pages obtained;
+    void* ptr = detail::map_pages(nbytes, page_mode(), obtained);
+    if (ptr) {
+      last_page_backing() = obtained;
+      ++page_mappings();
+    }
+    return ptr;
+  }
+#endif
+  return ::operator new(nbytes, std::nothrow);
+}
+
+//! Releases memory obtained from page_allocate(nbytes)
+inline void page_deallocate(void* ptr, size_t nbytes)
+{
+  if (!ptr) return;
+#ifdef __linux__
+  if (page_mapped(nbytes)) {
+    detail::unmap_pages(ptr, nbytes, page_mode());
+    return;
+  }
+#endif
+  ::operator delete(ptr);
+}
+
+//! Allocator backed by page_allocate, e.g. for the key array
+template <typename T>
+class page_allocator {
+public:
+  using value_type = T;
+
+  page_allocator() = default;
+
+  template <typename U>
+  page_allocator(page_allocator<U> const&) noexcept
+  {
+  }
+
+  T* allocate(size_t n)
+  {
+    if (void* ptr = page_allocate(n * sizeof(T))) {
+      return static_cast<T*>(ptr);
+    }
+    throw std::bad_alloc{};
+  }
+
+  void deallocate(T* ptr, size_t n) noexcept
+  {
+    page_deallocate(ptr, n * sizeof(T));
+  }
+
+  template <typename U>
+  bool operator==(page_allocator<U> const&) const noexcept
+  {
+    return true;
+  }
+
+  template <typename U>
+  bool operator!=(page_allocator<U> const&) const noexcept
+  {
+    return false;
+  }
+};
+
+//! Bytes of [ptr, ptr + nbytes) currently backed by huge pages according to
+//! /proc/self/smaps. Transparent huge pages are counted per mapping, i.e.
+//! the range should cover its mapping. Returns 0 if unknown.
+inline size_t huge_page_bytes(void const* ptr, size_t nbytes)
+{
+  size_t huge = 0;
+#ifdef __linux__
+  auto const lo = reinterpret_cast<uintptr_t>(ptr);
+  auto const hi = lo + nbytes;
+
+  std::ifstream smaps("/proc/self/smaps");
+  bool          inside = false;
+  size_t        len    = 0;
+  for (std::string line; std::getline(smaps, line);) {
+    uintptr_t          start, end;
+    char               dash;
+    std::istringstream ls(line);
+    if (ls >> std::hex >> start >> dash >> end && dash == '-') {
+      // mapping header: 7f0000000000-7f0000200000 rw-p ...
+      inside = start < hi && end > lo;
+      len    = std::min(end, hi) - std::max(start, lo);
+      continue;
+    }
+    if (!inside) continue;
+    if (line.compare(0, 15, "KernelPageSize:") == 0) {
+      // hugetlbfs mapping, all of it is huge
+      if (std::stoull(line.substr(15)) == huge_page_size / 1024) {
+        huge += len;
+        inside = false;
+      }
+    }
+    else if (line.compare(0, 14, "AnonHugePages:") == 0) {
+      huge += std::min<size_t>(len, std::stoull(line.substr(14)) * 1024);
+    }
+  }
+#endif
+  (void)ptr;
+  (void)nbytes;
+  return huge;
+}
+
+//! Resets the peak resident set size of the process to the current one
+//! (Linux >= 4.0), returns false if not supported.
+inline bool reset_peak_rss()
+{
+#ifdef __linux__
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  clear_refs << "5" << std::flush;
+  return clear_refs.good();
+#else
+  return false;
+#endif
+}
+
+//! Peak resident set size in bytes since the start of the process or the
+//! last reset_peak_rss, 0 if unknown.
+inline size_t peak_rss()
+{
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  for (std::string line; std::getline(status, line);) {
+    // VmHWM:   123456 kB
+    if (line.compare(0, 6, "VmHWM:") == 0) {
+      return std::stoull(line.substr(6)) * 1024;
+    }
+  }
+  // no procfs, ru_maxrss is in kB and cannot be reset
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+  }
+#endif
+  return 0;
+}
+
+//! Scratch memory which is allocated once, interleaved across NUMA nodes and
+//! pre-faulted, so that sorts reusing it do not pay for page faults.
+class ScratchArena {
+public:
+  explicit ScratchArena(size_t nbytes)
+    : nbytes_(nbytes)
+    , requested_(page_mode())
+  {
+#ifdef __linux__
+    ptr_ = detail::map_pages(nbytes_, requested_, backing_);
+    if (!ptr_) {
+      throw std::bad_alloc{};
+    }
+    last_page_backing() = backing_;
+    interleaved_        = numa::interleave(ptr_, nbytes_);
+#else
+    ptr_ = ::operator new(nbytes_);
+#endif
+    prefault();
+  }
+
+  ScratchArena(ScratchArena const&) = delete;
+  ScratchArena& operator=(ScratchArena const&) = delete;
+
+  ~ScratchArena()
+  {
+#ifdef __linux__
+    detail::unmap_pages(ptr_, nbytes_, requested_);
+#else
+    ::operator delete(ptr_);
+#endif
+  }
+
+  void* get() const
+  {
+    return ptr_;
+  }
+
+  size_t size() const
+  {
+    return nbytes_;
+  }
+
+  //! True if the NUMA interleave policy was applied
+  bool interleaved() const
+  {
+    return interleaved_;
+  }
+
+  //! Pages actually backing the arena
+  Pages backing() const
+  {
+    return backing_;
+  }
+
+private:
+  void prefault()
+  {
+    constexpr size_t page  = 4096;
+    auto* const      bytes = static_cast<unsigned char*>(ptr_);
+    auto const       n     = static_cast<long long>(nbytes_ / page);
+
+    // placement follows the interleave policy, threads only speed it up
+#pragma omp parallel for schedule(static)
+    for (long long idx = 0; idx < n; ++idx) {
+      bytes[idx * page] = 0;
+    }
+    if (nbytes_ % page) {
+      bytes[nbytes_ - 1] = 0;
+    }
+  }
+
+  void*  ptr_{nullptr};
+  size_t nbytes_{0};
+  bool   interleaved_{false};
+  Pages  requested_{Pages::base};
+  Pages  backing_{Pages::base};
+};
+
+}  // namespace sortbench
+
+#endif
@@ -0,0 +1,352 @@
+#ifndef NUMA_H__INCLUDED
+#define NUMA_H__INCLUDED
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(USE_OPENMP) || defined(USE_RADIX) || defined(USE_INPLACE) || \
+    defined(USE_MPI)
+#include <openmp/omp.h>
+#endif
+
+namespace sortbench {
+namespace numa {
+
+// We call the syscalls directly to avoid a dependency on libnuma.
+constexpr unsigned long MAX_NODES = 64;
+
+//! Page placement of the keys array
+enum class Placement {
+  // default policy, pages go wherever they are touched first
+  firsttouch,
+  // round robin across all nodes
+  interleave,
+  // everything on node 0
+  node0,
+  // every thread binds its chunk to its local node
+  bind
+};
+
+inline bool parse_placement(std::string const& s, Placement& p)
+{
+  if (s == "firsttouch")
+    p = Placement::firsttouch;
+  else if (s == "interleave")
+    p = Placement::interleave;
+  else if (s == "node0")
+    p = Placement::node0;
+  else if (s == "bind")
+    p = Placement::bind;
+  else
+    return false;
+  return true;
+}
+
+inline char const* to_string(Placement p)
+{
+  switch (p) {
+    case Placement::interleave:
+      return "interleave";
+    case Placement::node0:
+      return "node0";
+    case Placement::bind:
+      return "bind";
+    default:
+      return "firsttouch";
+  }
+}
+
+inline size_t page_size()
+{
+#ifdef __linux__
+  static size_t const sz = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  return sz;
+#else
+  return 4096;
+#endif
+}
+
+//! Shrink [addr, addr + nbytes) to the pages fully contained in it, such
+//! that neighbouring chunks never rebind each other's pages.
+inline void page_align(void*& addr, size_t& nbytes)
+{
+  auto const page  = page_size();
+  auto const first = reinterpret_cast<uintptr_t>(addr);
+  auto const lo    = (first + page - 1) / page * page;
+  auto const hi    = (first + nbytes) / page * page;
+  addr             = reinterpret_cast<void*>(lo);
+  nbytes           = hi > lo ? hi - lo : 0;
+}
+
+inline bool mbind(
+    void* addr, size_t nbytes, int mode, unsigned long mask, unsigned flags)
+{
+#ifdef __linux__
+  page_align(addr, nbytes);
+  if (nbytes == 0) return true;
+  // the kernel intersects the mask with the allowed nodes
+  return syscall(SYS_mbind, addr, nbytes, mode, &mask, MAX_NODES, flags) == 0;
+#else
+  return false;
+#endif
+}
+
+//! Interleave the pages of [addr, addr + nbytes) across all nodes with
+//! memory. Has to be called before the pages are touched, returns false if
+//! the policy could not be applied.
+inline bool interleave(void* addr, size_t nbytes)
+{
+#ifdef __linux__
+  return mbind(addr, nbytes, MPOL_INTERLEAVE, ~0UL, 0);
+#else
+  return false;
+#endif
+}
+
+//! NUMA node of the CPU the calling thread currently runs on
+inline int current_node()
+{
+#ifdef __linux__
+  unsigned cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+    return static_cast<int>(node);
+  }
+#endif
+  return 0;
+}
+
+//! Bind [addr, addr + nbytes) to the node of the calling thread, migrating
+//! pages which are already faulted in.
+inline bool bind_local(void* addr, size_t nbytes)
+{
+#ifdef __linux__
+  return mbind(
+      addr,
+      nbytes,
+      MPOL_BIND,
+      1UL << current_node(),
+      MPOL_MF_MOVE | MPOL_MF_STRICT);
+#else
+  return false;
+#endif
+}
+
+//! Apply a placement to a whole range from a single thread. Pages already
+//! faulted in are migrated. Placement::bind binds to the node of the calling
+//! thread, shared memory backends bind chunk-wise in parallel instead.
+inline bool place(void* addr, size_t nbytes, Placement p)
+{
+#ifdef __linux__
+  switch (p) {
+    case Placement::interleave:
+      return mbind(addr, nbytes, MPOL_INTERLEAVE, ~0UL, MPOL_MF_MOVE);
+    case Placement::node0:
+      return mbind(
+          addr, nbytes, MPOL_BIND, 1UL, MPOL_MF_MOVE | MPOL_MF_STRICT);
+    case Placement::bind:
+      return bind_local(addr, nbytes);
+    default:
+      return mbind(addr, nbytes, MPOL_DEFAULT, 0UL, 0);
+  }
+#else
+  return p == Placement::firsttouch;
+#endif
+}
+
+//! Pin the calling thread to a single CPU. CPUs are taken from the affinity
+//! mask of the process in order, i.e. thread t gets the t-th allowed CPU.
+inline bool pin_thread(unsigned idx)
+{
+#ifdef __linux__
+  static cpu_set_t const allowed = [] {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    sched_getaffinity(0, sizeof(set), &set);
+    return set;
+  }();
+
+  auto const ncpus = static_cast<unsigned>(CPU_COUNT(&allowed));
+  if (ncpus == 0) return false;
+
+  idx %= ncpus;
+  for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &allowed) && idx-- == 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      return sched_setaffinity(0, sizeof(set), &set) == 0;
+    }
+  }
+#endif
+  return false;
+}
+
+//! Number of pages per NUMA node in [addr, addr + nbytes). At most
+//! max_samples pages are queried, evenly strided across the range; the
+//! counts are scaled up accordingly. Pages not yet faulted in are ignored.
+inline std::vector<size_t> page_distribution(
+    void const* addr, size_t nbytes, size_t max_samples = 1 << 16)
+{
+  std::vector<size_t> counts;
+#ifdef __linux__
+  auto const page  = page_size();
+  auto const first = reinterpret_cast<uintptr_t>(addr) / page * page;
+  auto const npages =
+      (reinterpret_cast<uintptr_t>(addr) + nbytes - first + page - 1) / page;
+  if (npages == 0) return counts;
+
+  auto const stride = std::max<size_t>(1, npages / max_samples);
+
+  std::vector<void*> pages;
+  pages.reserve(npages / stride + 1);
+  for (size_t idx = 0; idx < npages; idx += stride) {
+    pages.push_back(reinterpret_cast<void*>(first + idx * page));
+  }
+
+  std::vector<int> status(pages.size(), -1);
+  // nodes == nullptr only queries the node of each page
+  if (syscall(
+          SYS_move_pages,
+          0,
+          pages.size(),
+          pages.data(),
+          nullptr,
+          status.data(),
+          0) != 0) {
+    return counts;
+  }
+
+  for (auto const node : status) {
+    if (node < 0) continue;
+    if (static_cast<size_t>(node) >= counts.size()) {
+      counts.resize(node + 1, 0);
+    }
+    counts[node] += stride;
+  }
+#endif
+  return counts;
+}
+
+}  // namespace numa
+
+// Placement and pinning of the backends that share them. The OpenMP
+// backends split [0, n) into the same static chunks for generation,
+// placement, verification and the bandwidth probes. So does mpi.x, whose
+// ranks run T threads with --hybrid and a single one otherwise. dash.x and
+// usort.x run a single thread per rank outside of their local sort. TBB and
+// the DASH placement are in their backend headers.
+
+#if defined(USE_OPENMP) || defined(USE_RADIX) || defined(USE_INPLACE) || \
+    defined(USE_MPI)
+
+//! Calls f(lo, hi) once per thread with its static chunk of [0, n). Thread
+//! t always gets the same chunk, parallel_rand generates the keys through
+//! it, i.e. every page is touched first by the thread owning its chunk.
+template <typename F>
+inline void parallel_for_static(size_t n, F f)
+{
+#pragma omp parallel
+  {
+    auto const tid   = static_cast<size_t>(omp_get_thread_num());
+    auto const nt    = static_cast<size_t>(omp_get_num_threads());
+    auto const chunk = (n + nt - 1) / nt;
+    auto const lo    = std::min(n, tid * chunk);
+    auto const hi    = std::min(n, lo + chunk);
+    f(lo, hi);
+  }
+}
+
+//! Apply the page placement before the keys are generated. With
+//! Placement::bind every thread binds the chunk it generates in
+//! parallel_rand to its local node.
+template <typename RandomIt>
+inline void parallel_place(
+    RandomIt begin, RandomIt end, numa::Placement placement)
+{
+  assert(!(end < begin));
+
+  using value_t = typename std::iterator_traits<RandomIt>::value_type;
+
+  auto const n     = static_cast<size_t>(std::distance(begin, end));
+  auto* const data = std::addressof(*begin);
+
+  if (placement != numa::Placement::bind) {
+    numa::place(data, n * sizeof(value_t), placement);
+    return;
+  }
+
+  parallel_for_static(n, [data](size_t lo, size_t hi) {
+    numa::bind_local(data + lo, (hi - lo) * sizeof(value_t));
+  });
+}
+
+#endif
+
+#if defined(USE_OPENMP) || defined(USE_RADIX) || defined(USE_INPLACE)
+
+//! Pin thread t to the t-th CPU unless the OpenMP runtime binds threads
+//! already (OMP_PROC_BIND), so generation and sort share a thread layout.
+inline void pin_threads()
+{
+#if defined(_OPENMP)
+  if (omp_get_proc_bind() != omp_proc_bind_false) return;
+#endif
+#pragma omp parallel
+  numa::pin_thread(static_cast<unsigned>(omp_get_thread_num()));
+}
+
+#elif defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+
+//! Ranks are pinned by the MPI launcher
+inline void pin_threads()
+{
+}
+
+#endif
+
+#if defined(USE_DASH) || defined(USE_USORT)
+
+//! Ranks are single threaded, the whole range is a single chunk.
+template <typename F>
+inline void parallel_for_static(size_t n, F f)
+{
+  f(0, n);
+}
+
+#endif
+
+#if defined(USE_USORT)
+
+//! Apply the page placement to the local keys before they are generated.
+//! Placement::bind binds them to the node this rank runs on.
+template <typename RandomIt>
+inline void parallel_place(
+    RandomIt begin, RandomIt end, numa::Placement placement)
+{
+  assert(!(end < begin));
+
+  using value_t = typename std::iterator_traits<RandomIt>::value_type;
+
+  auto const n = static_cast<size_t>(std::distance(begin, end));
+
+  numa::place(std::addressof(*begin), n * sizeof(value_t), placement);
+}
+
+#endif
+
+}  // namespace sortbench
+
+#endif
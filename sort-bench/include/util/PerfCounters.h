@@ -0,0 +1,283 @@
+#ifndef PERFCOUNTERS_H__INCLUDED
+#define PERFCOUNTERS_H__INCLUDED
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+#include <mpi.h>
+#endif
+
+namespace sortbench {
+
+namespace perf {
+
+//! Hardware events counted around the sort
+enum Event {
+  cycles,
+  instructions,
+  llc_misses,
+  dtlb_misses,
+  branch_misses,
+  nevents
+};
+
+inline char const* to_string(Event e)
+{
+  switch (e) {
+    case cycles: return "cycles";
+    case instructions: return "instructions";
+    case llc_misses: return "llc_misses";
+    case dtlb_misses: return "dtlb_misses";
+    case branch_misses: return "branch_misses";
+    default: return "unknown";
+  }
+}
+
+//! Event counts summed over all threads (and ranks). An event is valid if it
+//! could be opened on every thread, counts are scaled up if the kernel had
+//! to multiplex the counters.
+struct Counts {
+  double value[nevents] = {};
+  bool   valid[nevents] = {};
+
+  bool any() const
+  {
+    for (int e = 0; e < nevents; ++e) {
+      if (valid[e]) return true;
+    }
+    return false;
+  }
+};
+
+#ifdef __linux__
+
+namespace detail {
+
+inline void event_attr(Event e, perf_event_attr& attr)
+{
+  std::memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  switch (e) {
+    case cycles: attr.config = PERF_COUNT_HW_CPU_CYCLES; break;
+    case instructions: attr.config = PERF_COUNT_HW_INSTRUCTIONS; break;
+    case llc_misses: attr.config = PERF_COUNT_HW_CACHE_MISSES; break;
+    case dtlb_misses:
+      attr.type   = PERF_TYPE_HW_CACHE;
+      attr.config = PERF_COUNT_HW_CACHE_DTLB |
+                    (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                    (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+      break;
+    case branch_misses: attr.config = PERF_COUNT_HW_BRANCH_MISSES; break;
+    default: break;
+  }
+  attr.disabled = 1;
+  // threads spawned by a counted thread are counted as well
+  attr.inherit     = 1;
+  attr.read_format =
+      PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+}
+
+inline int open_event(perf_event_attr& attr, pid_t tid)
+{
+  return static_cast<int>(
+      syscall(__NR_perf_event_open, &attr, tid, -1, -1, 0));
+}
+
+//! Thread ids of this process
+inline std::vector<pid_t> threads()
+{
+  std::vector<pid_t> tids;
+  if (DIR* dir = opendir("/proc/self/task")) {
+    while (dirent* entry = readdir(dir)) {
+      if (entry->d_name[0] == '.') continue;
+      tids.push_back(static_cast<pid_t>(std::atoi(entry->d_name)));
+    }
+    closedir(dir);
+  }
+  return tids;
+}
+
+}  // namespace detail
+
+//! Counts the events on all threads of the process between start() and
+//! stop(). Without the permission to count kernel events (see
+//! perf_event_paranoid, EACCES / EPERM) only user space is counted, events
+//! which cannot be opened for any other reason are reported invalid.
+//! Threads must not be created or exit between start() and stop() except as
+//! children of counted threads, e.g. the persistent OpenMP and TBB worker
+//! pools.
+class Counters {
+public:
+  Counters() = default;
+
+  Counters(Counters const&) = delete;
+  Counters& operator=(Counters const&) = delete;
+
+  ~Counters()
+  {
+    close_all();
+  }
+
+  //! Opens and enables the counters, returns false if no event is available
+  bool start()
+  {
+    close_all();
+    auto const tids = detail::threads();
+    bool       any  = false;
+    for (int e = 0; e < nevents; ++e) {
+      auto& fds = fds_[e];
+      for (auto const tid : tids) {
+        perf_event_attr attr;
+        detail::event_attr(static_cast<Event>(e), attr);
+        attr.exclude_kernel = user_only_;
+        attr.exclude_hv     = user_only_;
+        int const fd        = detail::open_event(attr, tid);
+        if (fd < 0 && !user_only_ && (errno == EACCES || errno == EPERM)) {
+          // not permitted to count kernel events, start over counting user
+          // space only such that no event includes the kernel
+          user_only_ = true;
+          return start();
+        }
+        if (fd < 0) {
+          // e.g. not supported by the PMU, only this event is invalid
+          close_event(e);
+          break;
+        }
+        fds.push_back(fd);
+      }
+      any |= !fds.empty();
+    }
+    for (auto const& fds : fds_) {
+      for (auto const fd : fds) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+    return any;
+  }
+
+  //! Disables the counters and returns the counts summed over all threads
+  Counts stop()
+  {
+    for (auto const& fds : fds_) {
+      for (auto const fd : fds) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+      }
+    }
+    Counts counts;
+    for (int e = 0; e < nevents; ++e) {
+      if (fds_[e].empty()) continue;
+      counts.valid[e] = true;
+      for (auto const fd : fds_[e]) {
+        // value, time enabled, time running
+        uint64_t buf[3] = {};
+        if (read(fd, buf, sizeof(buf)) != sizeof(buf)) {
+          counts.valid[e] = false;
+          break;
+        }
+        if (buf[2] > 0) {
+          counts.value[e] += static_cast<double>(buf[0]) *
+                             static_cast<double>(buf[1]) /
+                             static_cast<double>(buf[2]);
+        }
+      }
+    }
+    close_all();
+    return counts;
+  }
+
+  //! True if kernel events are excluded
+  bool user_only() const
+  {
+    return user_only_;
+  }
+
+private:
+  void close_event(int e)
+  {
+    for (auto const fd : fds_[e]) {
+      close(fd);
+    }
+    fds_[e].clear();
+  }
+
+  void close_all()
+  {
+    for (int e = 0; e < nevents; ++e) {
+      close_event(e);
+    }
+  }
+
+  std::vector<int> fds_[nevents];
+  bool             user_only_ = false;
+};
+
+#else
+
+//! No-op on platforms without perf_event_open
+class Counters {
+public:
+  bool start()
+  {
+    return false;
+  }
+
+  Counts stop()
+  {
+    return {};
+  }
+
+  bool user_only() const
+  {
+    return false;
+  }
+};
+
+#endif
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+
+//! Sum of the counts of all ranks, an event is valid if it is valid on all
+//! ranks. Collective.
+inline Counts allreduce(Counts const& local)
+{
+  double values[nevents];
+  int    valid[nevents];
+  for (int e = 0; e < nevents; ++e) {
+    values[e] = local.value[e];
+    valid[e]  = local.valid[e];
+  }
+  MPI_Allreduce(
+      MPI_IN_PLACE, values, nevents, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+  MPI_Allreduce(
+      MPI_IN_PLACE, valid, nevents, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+  Counts global;
+  for (int e = 0; e < nevents; ++e) {
+    global.value[e] = values[e];
+    global.valid[e] = valid[e] != 0;
+  }
+  return global;
+}
+
+#endif
+
+}  // namespace perf
+
+}  // namespace sortbench
+
+#endif
@@ -1,6 +1,10 @@
 #ifndef RANDOM_H
 #define RANDOM_H
 
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <random>
 #include <type_traits>
 
@@ -93,6 +97,8 @@ private:
 
 
 struct random_seed_seq {
+  using result_type = std::random_device::result_type;
+
   template <typename It>
   void generate(It begin, It end)
   {
@@ -111,6 +117,217 @@ private:
   std::random_device device;
 };
 
+//! Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2,
+//! 3", SC'11). A counter-based generator: the output is a pure function of
+//! (key, counter), so any element can be generated independently of the
+//! thread or rank generating it.
+struct philox4x32 {
+  uint32_t v[4];
+};
+
+inline philox4x32 philox(philox4x32 ctr, uint32_t k0, uint32_t k1)
+{
+  constexpr uint32_t M0 = 0xD2511F53;
+  constexpr uint32_t M1 = 0xCD9E8D57;
+  constexpr uint32_t W0 = 0x9E3779B9;
+  constexpr uint32_t W1 = 0xBB67AE85;
+
+  for (int round = 0; round < 10; ++round) {
+    uint64_t const p0 = static_cast<uint64_t>(M0) * ctr.v[0];
+    uint64_t const p1 = static_cast<uint64_t>(M1) * ctr.v[2];
+
+    ctr = {{static_cast<uint32_t>(p1 >> 32) ^ ctr.v[1] ^ k0,
+            static_cast<uint32_t>(p1),
+            static_cast<uint32_t>(p0 >> 32) ^ ctr.v[3] ^ k1,
+            static_cast<uint32_t>(p0)}};
+
+    k0 += W0;
+    k1 += W1;
+  }
+  return ctr;
+}
+
+//! Seed of all counter-based generators, fixed by default such that runs are
+//! reproducible. Set it before the keys are generated.
+inline uint64_t& rng_seed()
+{
+  static uint64_t seed = 0x5EED5EED;
+  return seed;
+}
+
+//! Independent streams of the same seed, e.g. one per distribution and one
+//! for the keys --incremental changes
+enum class rng_stream : uint32_t { normal = 0, uniform = 1, perturb = 2 };
+
+//! Four random words for element index of the given stream
+inline philox4x32 counter_rng(uint64_t index, rng_stream stream)
+{
+  auto const seed = rng_seed();
+  return philox(
+      {{static_cast<uint32_t>(index),
+        static_cast<uint32_t>(index >> 32),
+        static_cast<uint32_t>(stream),
+        0}},
+      static_cast<uint32_t>(seed),
+      static_cast<uint32_t>(seed >> 32));
+}
+
+//! 53-bit uniform in (0, 1) from two 32-bit words
+inline double to_unit(uint32_t hi, uint32_t lo)
+{
+  constexpr double scale = 1.0 / 9007199254740992.0;  // 2^-53
+  auto const bits = ((static_cast<uint64_t>(hi) << 32) | lo) >> 11;
+  return (static_cast<double>(bits) + 0.5) * scale;
+}
+
+//! Uniform in (0, 1) for element index
+inline double counter_uniform(uint64_t index)
+{
+  auto const r = counter_rng(index, rng_stream::uniform);
+  return to_unit(r.v[0], r.v[1]);
+}
+
+namespace detail {
+
+constexpr size_t NORMAL_BLOCK = 64;
+
+// Branch-free log and sincos for the Box-Muller transform. Unlike the libm
+// calls they inline and vectorize, the error is below 1e-11 which is plenty
+// for benchmark keys.
+
+//! log(x) for x in (0, 1]
+inline double fast_log(double x)
+{
+  constexpr double ln2     = 0.69314718055994530942;
+  constexpr double sqrt2   = 1.41421356237309504880;
+  constexpr uint64_t mmask = (uint64_t{1} << 52) - 1;
+  constexpr uint64_t one   = uint64_t{1023} << 52;
+
+  uint64_t bits;
+  std::memcpy(&bits, &x, sizeof(bits));
+  // x = 2^e * m with m in [1, 2)
+  auto   e = static_cast<double>(static_cast<int64_t>(bits >> 52) - 1023);
+  uint64_t const mbits = (bits & mmask) | one;
+  double         m;
+  std::memcpy(&m, &mbits, sizeof(m));
+  // move m to [sqrt(2)/2, sqrt(2)) such that |s| below is at most 0.172
+  bool const big = m >= sqrt2;
+  m              = big ? 0.5 * m : m;
+  e              = big ? e + 1.0 : e;
+
+  // log(m) = 2 atanh(s) with s = (m - 1) / (m + 1)
+  double const s  = (m - 1.0) / (m + 1.0);
+  double const s2 = s * s;
+  constexpr double a3 = 1.0 / 3, a5 = 1.0 / 5, a7 = 1.0 / 7, a9 = 1.0 / 9,
+                   a11 = 1.0 / 11, a13 = 1.0 / 13;
+
+  double const p =
+      1.0 +
+      s2 * (a3 + s2 * (a5 + s2 * (a7 + s2 * (a9 + s2 * (a11 + s2 * a13)))));
+  return e * ln2 + 2.0 * s * p;
+}
+
+//! sin and cos of 2 pi u for u in [0, 1)
+inline void fast_sincos_2pi(double u, double& sn, double& cs)
+{
+  constexpr double two_pi = 6.283185307179586476925286766559;
+
+  // round to nearest via the 2^52 + 2^51 trick, floor does not vectorize
+  // without -fno-trapping-math
+  constexpr double round_magic = 6755399441055744.0;
+
+  // quadrant q and x = 2 pi (u - q / 4) in [-pi / 4, pi / 4]
+  double const q4 = (4.0 * u + round_magic) - round_magic;
+  double const x  = two_pi * (u - 0.25 * q4);
+
+  // Taylor series, the terms beyond are below 1e-11 on [-pi / 4, pi / 4]
+  constexpr double s3 = -1.0 / 6, s5 = 1.0 / 120, s7 = -1.0 / 5040,
+                   s9 = 1.0 / 362880, s11 = -1.0 / 39916800;
+  constexpr double c2 = -1.0 / 2, c4 = 1.0 / 24, c6 = -1.0 / 720,
+                   c8 = 1.0 / 40320, c10 = -1.0 / 3628800,
+                   c12 = 1.0 / 479001600;
+
+  double const x2 = x * x;
+  double const s =
+      x + x * x2 * (s3 + x2 * (s5 + x2 * (s7 + x2 * (s9 + x2 * s11))));
+  double const c =
+      1.0 +
+      x2 * (c2 + x2 * (c4 + x2 * (c6 + x2 * (c8 + x2 * (c10 + x2 * c12)))));
+
+  // rotate by q4 in [0, 4] quarter turns, odd: q4 in {1, 3}, neg: q4 in
+  // {2, 3}. Written as plain compares such that the selects vectorize.
+  bool const   odd = std::fabs(q4 - 2.0) == 1.0;
+  bool const   neg = std::fabs(q4 - 2.5) < 1.0;
+  double const s1  = odd ? c : s;
+  double const c1  = odd ? -s : c;
+  sn               = neg ? -s1 : s1;
+  cs               = neg ? -c1 : c1;
+}
+
+//! Box-Muller over a block of consecutive pairs. Counter c yields the pair
+//! of elements (2c, 2c + 1). The loops are free of dependencies and
+//! branches, so they vectorize. The square root gets a loop of its own, with
+//! math errno enabled it cannot be vectorized.
+inline void normal_block(uint64_t first_pair, double* out)
+{
+  constexpr size_t npairs = NORMAL_BLOCK / 2;
+
+  double u1[npairs];
+  double u2[npairs];
+  double rad[npairs];
+
+#pragma omp simd
+  for (size_t p = 0; p < npairs; ++p) {
+    auto const r = counter_rng(first_pair + p, rng_stream::normal);
+    u1[p]        = to_unit(r.v[0], r.v[1]);
+    u2[p]        = to_unit(r.v[2], r.v[3]);
+  }
+
+#pragma omp simd
+  for (size_t p = 0; p < npairs; ++p) {
+    rad[p] = -2.0 * fast_log(u1[p]);
+  }
+
+  for (size_t p = 0; p < npairs; ++p) {
+    rad[p] = std::sqrt(rad[p]);
+  }
+
+#pragma omp simd
+  for (size_t p = 0; p < npairs; ++p) {
+    fast_sincos_2pi(u2[p], u1[p], u2[p]);
+  }
+
+  for (size_t p = 0; p < npairs; ++p) {
+    out[2 * p]     = rad[p] * u2[p];
+    out[2 * p + 1] = rad[p] * u1[p];
+  }
+}
+
+}  // namespace detail
+
+//! Standard normal for element index. Values are generated in blocks of
+//! NORMAL_BLOCK elements and cached per thread, sequential access (as in
+//! parallel_rand) costs one block kernel per NORMAL_BLOCK elements. The
+//! result only depends on (rng_seed(), index).
+inline double counter_normal(uint64_t index)
+{
+  struct cache_t {
+    uint64_t seed  = 0;
+    uint64_t first = ~uint64_t{0};
+    double   vals[detail::NORMAL_BLOCK];
+  };
+  static thread_local cache_t cache;
+
+  auto const first = index / detail::NORMAL_BLOCK * detail::NORMAL_BLOCK;
+
+  if (first != cache.first || cache.seed != rng_seed()) {
+    detail::normal_block(first / 2, cache.vals);
+    cache.first = first;
+    cache.seed  = rng_seed();
+  }
+
+  return cache.vals[index - first];
+}
 
 }  // namespace sortbench
 
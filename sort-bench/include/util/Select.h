@@ -0,0 +1,273 @@
+#ifndef SELECT_H__INCLUDED
+#define SELECT_H__INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+#include <mpi.h>
+#endif
+
+namespace sortbench {
+
+namespace select {
+
+// Top-k and selection (nth_element) over the local keys first[0, n) of all
+// ranks, for comparison with a full sort. The keys are not modified. Local
+// scans are parallelized by the caller's parallel_for(n, f), which calls
+// f(lo, hi) on disjoint static chunks covering [0, n); the distributed
+// backends combine the ranks with allreduce / allgather, i.e. without
+// exchanging the keys.
+
+//! Global sample per round of select
+constexpr size_t SAMPLES = size_t(1) << 16;
+//! Candidates select gathers on every rank to finish with nth_element
+constexpr size_t GATHER = size_t(1) << 18;
+
+//! Full scans over the local keys by the last topk or select
+inline unsigned& last_scans()
+{
+  static unsigned nscans = 0;
+  return nscans;
+}
+
+//! Bytes read by the last topk or select over n local keys
+template <typename T>
+inline double traffic(size_t n)
+{
+  return static_cast<double>(last_scans()) * n * sizeof(T);
+}
+
+//! Sum over all ranks
+inline size_t global_sum(size_t local)
+{
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  unsigned long long v = local;
+  MPI_Allreduce(
+      MPI_IN_PLACE, &v, 1, MPI_UNSIGNED_LONG_LONG, MPI_SUM, MPI_COMM_WORLD);
+  return static_cast<size_t>(v);
+#else
+  return local;
+#endif
+}
+
+//! Concatenation of the local vectors of all ranks in rank order
+template <typename T>
+inline std::vector<T> allgather(std::vector<T> const& local)
+{
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  int nranks;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+
+  int mine = static_cast<int>(local.size() * sizeof(T));
+  std::vector<int> bytes(nranks), displs(nranks, 0);
+  MPI_Allgather(&mine, 1, MPI_INT, bytes.data(), 1, MPI_INT, MPI_COMM_WORLD);
+  for (int rank = 1; rank < nranks; ++rank) {
+    displs[rank] = displs[rank - 1] + bytes[rank - 1];
+  }
+
+  std::vector<T> all((displs.back() + bytes.back()) / sizeof(T));
+  MPI_Allgatherv(
+      local.data(),
+      mine,
+      MPI_BYTE,
+      all.data(),
+      bytes.data(),
+      displs.data(),
+      MPI_BYTE,
+      MPI_COMM_WORLD);
+  return all;
+#else
+  return local;
+#endif
+}
+
+//! The k smallest keys of all ranks in ascending order, on every rank. Every
+//! chunk keeps a max-heap of its k smallest keys, i.e. a single scan in which
+//! most keys only cost a comparison with the heap top. The heaps of the
+//! chunks and then of the ranks are merged by a partial sort.
+template <typename T, typename Compare, typename ParallelFor>
+std::vector<T> topk(
+    T const* first, size_t n, size_t k, Compare cmp, ParallelFor pfor)
+{
+  std::vector<T> cand;
+  std::mutex     mutex;
+
+  pfor(n, [&](size_t lo, size_t hi) {
+    auto const     kc = std::min(k, hi - lo);
+    std::vector<T> heap(first + lo, first + lo + kc);
+    std::make_heap(heap.begin(), heap.end(), cmp);
+    if (kc > 0) {
+      for (size_t idx = lo + kc; idx < hi; ++idx) {
+        if (cmp(first[idx], heap.front())) {
+          std::pop_heap(heap.begin(), heap.end(), cmp);
+          heap.back() = first[idx];
+          std::push_heap(heap.begin(), heap.end(), cmp);
+        }
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    cand.insert(cand.end(), heap.begin(), heap.end());
+  });
+  last_scans() = 1;
+
+  auto const merge = [k, cmp](std::vector<T>& v) {
+    auto const kv = std::min(k, v.size());
+    std::partial_sort(v.begin(), v.begin() + kv, v.end(), cmp);
+    v.resize(kv);
+  };
+
+  merge(cand);
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  cand = allgather(cand);
+  merge(cand);
+#endif
+  return cand;
+}
+
+//! Global number of keys less than v and not greater than v
+template <typename T, typename Compare, typename ParallelFor>
+std::pair<size_t, size_t> rank_of(
+    T const* first, size_t n, T const& v, Compare cmp, ParallelFor pfor)
+{
+  size_t     less = 0, greater = 0;
+  std::mutex mutex;
+  pfor(n, [&](size_t lo, size_t hi) {
+    size_t l = 0, g = 0;
+    for (size_t idx = lo; idx < hi; ++idx) {
+      l += cmp(first[idx], v);
+      g += cmp(v, first[idx]);
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    less += l;
+    greater += g;
+  });
+  return {global_sum(less), global_sum(n - greater)};
+}
+
+//! The key of global rank `rank` (0-based) in the order of cmp, i.e. the key
+//! nth_element would place at position rank of the concatenated local keys of
+//! all ranks, on every rank. Every round samples the keys of the current
+//! bracket, takes two pivots around the expected position of rank in the
+//! sample and counts the bracket against them: rank either hits a pivot or
+//! continues in one of the three (exclusive) sub-brackets, which shrinks by
+//! about SAMPLES / sqrt(SAMPLES) per round. Brackets of at most GATHER keys
+//! are gathered and finished by nth_element.
+template <typename T, typename Compare, typename ParallelFor>
+T select(
+    T const* first, size_t n, size_t rank, Compare cmp, ParallelFor pfor)
+{
+  last_scans() = 0;
+
+  // exclusive bounds of the bracket
+  bool has_lo = false, has_hi = false;
+  T    lo{}, hi{};
+  auto inside = [&](T const& x) {
+    return (!has_lo || cmp(lo, x)) && (!has_hi || cmp(x, hi));
+  };
+
+  // keys in the bracket and rank relative to the bracket
+  auto nin = global_sum(n);
+  std::mutex mutex;
+
+  for (;;) {
+    if (nin <= GATHER) {
+      std::vector<T> local;
+      pfor(n, [&](size_t clo, size_t chi) {
+        std::vector<T> mine;
+        for (size_t idx = clo; idx < chi; ++idx) {
+          if (inside(first[idx])) mine.push_back(first[idx]);
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        local.insert(local.end(), mine.begin(), mine.end());
+      });
+      ++last_scans();
+      auto all = allgather(local);
+      std::nth_element(all.begin(), all.begin() + rank, all.end(), cmp);
+      return all[rank];
+    }
+
+    // every stride-th key of the bracket per chunk
+    auto const     stride = std::max<size_t>(1, nin / SAMPLES);
+    std::vector<T> local;
+    pfor(n, [&](size_t clo, size_t chi) {
+      std::vector<T> mine;
+      size_t         seen = 0;
+      for (size_t idx = clo; idx < chi; ++idx) {
+        if (inside(first[idx]) && seen++ % stride == 0) {
+          mine.push_back(first[idx]);
+        }
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      local.insert(local.end(), mine.begin(), mine.end());
+    });
+    ++last_scans();
+    auto samples = allgather(local);
+    std::sort(samples.begin(), samples.end(), cmp);
+
+    auto const m     = samples.size();
+    auto const pos   = static_cast<size_t>(
+        static_cast<double>(rank) / static_cast<double>(nin) * m);
+    auto const delta = static_cast<size_t>(2 * std::sqrt(double(m))) + 1;
+    T const    p1    = samples[pos > delta ? pos - delta : 0];
+    T const    p2    = samples[std::min(m - 1, pos + delta)];
+
+    // keys of the bracket less than / not greater than p1 and p2
+    size_t counts[4] = {};
+    pfor(n, [&](size_t clo, size_t chi) {
+      size_t c[4] = {};
+      for (size_t idx = clo; idx < chi; ++idx) {
+        auto const& x = first[idx];
+        if (!inside(x)) continue;
+        c[0] += cmp(x, p1);
+        c[1] += !cmp(p1, x);
+        c[2] += cmp(x, p2);
+        c[3] += !cmp(p2, x);
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      for (int i = 0; i < 4; ++i) counts[i] += c[i];
+    });
+    ++last_scans();
+    auto const lt1 = global_sum(counts[0]);
+    auto const le1 = global_sum(counts[1]);
+    auto const lt2 = global_sum(counts[2]);
+    auto const le2 = global_sum(counts[3]);
+
+    if (rank < lt1) {
+      has_hi = true;
+      hi     = p1;
+      nin    = lt1;
+    }
+    else if (rank < le1) {
+      return p1;
+    }
+    else if (rank < lt2) {
+      has_lo = true;
+      lo     = p1;
+      has_hi = true;
+      hi     = p2;
+      rank -= le1;
+      nin = lt2 - le1;
+    }
+    else if (rank < le2) {
+      return p2;
+    }
+    else {
+      has_lo = true;
+      lo     = p2;
+      rank -= le2;
+      nin -= le2;
+    }
+  }
+}
+
+}  // namespace select
+
+}  // namespace sortbench
+
+#endif
@@ -0,0 +1,107 @@
+#ifndef STATISTICS_H__INCLUDED
+#define STATISTICS_H__INCLUDED
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace sortbench {
+
+//! 97.5% quantile of Student's t distribution with df degrees of freedom,
+//! i.e. the multiplier of the standard error for a two-sided 95% confidence
+//! interval (as in benchmarks/plots/summary.R)
+inline double t_quantile_975(size_t df)
+{
+  static double const table[] = {0,      12.706, 4.303, 3.182, 2.776, 2.571,
+                                 2.447,  2.365,  2.306, 2.262, 2.228, 2.201,
+                                 2.179,  2.160,  2.145, 2.131, 2.120, 2.110,
+                                 2.101,  2.093,  2.086, 2.080, 2.074, 2.069,
+                                 2.064,  2.060,  2.056, 2.052, 2.048, 2.045,
+                                 2.042};
+  constexpr size_t ntable = sizeof(table) / sizeof(table[0]);
+  if (df == 0) return INFINITY;
+  if (df < ntable) return table[df];
+  // z + (z^3 + z) / (4 df), accurate to 1e-3 beyond the table
+  constexpr double z = 1.959964;
+  return z + (z * z * z + z) / (4.0 * static_cast<double>(df));
+}
+
+//! Quantile q in [0, 1] of sorted samples, linear interpolation between the
+//! closest ranks (R's default, type 7)
+inline double quantile(std::vector<double> const& sorted, double q)
+{
+  if (sorted.empty()) return 0;
+  auto const pos = q * static_cast<double>(sorted.size() - 1);
+  auto const lo  = static_cast<size_t>(pos);
+  auto const hi  = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] +
+         (pos - static_cast<double>(lo)) * (sorted[hi] - sorted[lo]);
+}
+
+//! Summary of the measured iterations of a test case
+struct Summary {
+  size_t n      = 0;
+  double mean   = 0;
+  double stddev = 0;
+  double median = 0;
+  double p5     = 0;
+  double p95    = 0;
+  //! coefficient of variation, stddev / mean
+  double cv = 0;
+  //! half width of the 95% confidence interval of the mean relative to the
+  //! mean, infinite below two samples
+  double rel_ci = INFINITY;
+  //! indices of the samples slower than median + 3 scaled MAD, typically
+  //! caused by OS noise
+  std::vector<size_t> outliers;
+};
+
+inline Summary summarize(std::vector<double> const& samples)
+{
+  Summary s;
+  s.n = samples.size();
+  if (s.n == 0) return s;
+
+  double sum = 0;
+  for (auto const x : samples) sum += x;
+  s.mean = sum / static_cast<double>(s.n);
+
+  if (s.n > 1) {
+    double sq = 0;
+    for (auto const x : samples) sq += (x - s.mean) * (x - s.mean);
+    s.stddev = std::sqrt(sq / static_cast<double>(s.n - 1));
+  }
+  if (s.mean > 0) {
+    s.cv = s.stddev / s.mean;
+    if (s.n > 1) {
+      s.rel_ci = t_quantile_975(s.n - 1) * s.stddev /
+                 std::sqrt(static_cast<double>(s.n)) / s.mean;
+    }
+  }
+
+  auto sorted = samples;
+  std::sort(sorted.begin(), sorted.end());
+  s.median = quantile(sorted, 0.5);
+  s.p5     = quantile(sorted, 0.05);
+  s.p95    = quantile(sorted, 0.95);
+
+  // median absolute deviation, scaled to estimate the standard deviation of
+  // normally distributed samples; robust against the outliers themselves
+  std::vector<double> dev(s.n);
+  for (size_t idx = 0; idx < s.n; ++idx) {
+    dev[idx] = std::abs(samples[idx] - s.median);
+  }
+  std::sort(dev.begin(), dev.end());
+  auto const mad = 1.4826 * quantile(dev, 0.5);
+  if (s.n > 2 && mad > 0) {
+    for (size_t idx = 0; idx < s.n; ++idx) {
+      if (samples[idx] > s.median + 3 * mad) s.outliers.push_back(idx);
+    }
+  }
+  return s;
+}
+
+}  // namespace sortbench
+
+#endif
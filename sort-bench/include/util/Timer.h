@@ -1,7 +1,15 @@
 #ifndef TIMERS_H
 #define TIMERS_H
 
+#include <algorithm>
 #include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+#include <mpi.h>
+#endif
 
 template <bool HighResIsSteady = std::chrono::high_resolution_clock::is_steady>
 struct ChooseSteadyClock {
@@ -23,4 +31,152 @@ inline double ChronoClockNow() {
   return duration_t(ClockType::now().time_since_epoch()).count();
 }
 
+namespace sortbench {
+
+//! Wall time per phase of the calling rank, accumulated over all scopes of
+//! the same name. Phases keep the order in which they are first entered.
+class PhaseTimer {
+public:
+  using phase_t = std::pair<std::string, double>;
+
+  static PhaseTimer& instance()
+  {
+    static PhaseTimer timer;
+    return timer;
+  }
+
+  void clear()
+  {
+    phases_.clear();
+  }
+
+  void add(std::string const& name, double seconds)
+  {
+    auto it = std::find_if(
+        phases_.begin(), phases_.end(), [&name](phase_t const& p) {
+          return p.first == name;
+        });
+    if (it == phases_.end()) {
+      phases_.emplace_back(name, seconds);
+    }
+    else {
+      it->second += seconds;
+    }
+  }
+
+  std::vector<phase_t> const& phases() const
+  {
+    return phases_;
+  }
+
+private:
+  std::vector<phase_t> phases_;
+};
+
+//! Adds the lifetime of the scope to a phase of PhaseTimer::instance()
+class ScopedPhase {
+public:
+  explicit ScopedPhase(char const* name)
+    : name_(name)
+    , start_(ChronoClockNow())
+  {
+  }
+
+  ScopedPhase(ScopedPhase const&) = delete;
+  ScopedPhase& operator=(ScopedPhase const&) = delete;
+
+  ~ScopedPhase()
+  {
+    PhaseTimer::instance().add(name_, ChronoClockNow() - start_);
+  }
+
+private:
+  char const* name_;
+  double      start_;
+};
+
+struct PhaseStats {
+  std::string name;
+  double      min;
+  double      max;
+  double      mean;
+};
+
+//! Min / max / mean of every phase across all ranks. Collective for the
+//! distributed backends: the ranks may record different phases (e.g. from
+//! their DASH traces), rank 0 broadcasts its phases and their order, every
+//! other rank reports its time for each of them, 0 if it did not record the
+//! phase. Phases only other ranks recorded are not reported.
+inline std::vector<PhaseStats> reduce_phases()
+{
+  auto const& phases = PhaseTimer::instance().phases();
+
+  std::vector<std::string> names;
+  for (auto const& p : phases) {
+    names.push_back(p.first);
+  }
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  int P, r;
+  MPI_Comm_size(MPI_COMM_WORLD, &P);
+  MPI_Comm_rank(MPI_COMM_WORLD, &r);
+
+  // the names of rank 0, separated by NUL
+  std::string joined;
+  for (auto const& name : names) {
+    joined += name;
+    joined += '\0';
+  }
+  unsigned long long len = joined.size();
+  MPI_Bcast(&len, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+  joined.resize(len);
+  MPI_Bcast(&joined[0], static_cast<int>(len), MPI_CHAR, 0, MPI_COMM_WORLD);
+  if (r != 0) {
+    names.clear();
+    for (size_t pos = 0; pos < joined.size();) {
+      auto const end = joined.find('\0', pos);
+      names.push_back(joined.substr(pos, end - pos));
+      pos = end + 1;
+    }
+  }
+#endif
+
+  auto const n = names.size();
+
+  std::vector<double> local(n, 0);
+  for (size_t idx = 0; idx < n; ++idx) {
+    auto it = std::find_if(
+        phases.begin(),
+        phases.end(),
+        [&names, idx](PhaseTimer::phase_t const& p) {
+          return p.first == names[idx];
+        });
+    if (it != phases.end()) {
+      local[idx] = it->second;
+    }
+  }
+
+  std::vector<double> lo(local), hi(local), sum(local);
+  double              nranks = 1;
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  nranks = P;
+  MPI_Allreduce(
+      local.data(), lo.data(), n, MPI_DOUBLE, MPI_MIN, MPI_COMM_WORLD);
+  MPI_Allreduce(
+      local.data(), hi.data(), n, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+  MPI_Allreduce(
+      local.data(), sum.data(), n, MPI_DOUBLE, MPI_SUM, MPI_COMM_WORLD);
+#endif
+
+  std::vector<PhaseStats> stats;
+  stats.reserve(n);
+  for (size_t idx = 0; idx < n; ++idx) {
+    stats.push_back({names[idx], lo[idx], hi[idx], sum[idx] / nranks});
+  }
+  return stats;
+}
+
+}  // namespace sortbench
+
 #endif
@@ -1,12 +1,27 @@
 #ifndef TRACE_H__INCLUDED
 #define TRACE_H__INCLUDED
 
-#include <vector>
+#include <string>
 
 namespace sortbench {
 
 void reset_trace(void);
-void flush_trace(std::vector<unsigned> const& samples, int myrank);
+//! Appends the DASH trace of the last sort to the binary trace file of this
+//! rank, <prefix>.<rank>.bin (see util/TraceFile.h), and clears the trace.
+//! Writes nothing if tracing is disabled (DASH_ENABLE_TRACE), no-op for all
+//! other backends.
+void flush_trace(
+    std::string const& prefix,
+    int                myrank,
+    int                nranks,
+    double             elapsed,
+    std::string const& test_case,
+    std::string const& type,
+    std::string const& dist);
+//! Adds the top-level states of the DASH trace of the last sort to the
+//! PhaseTimer, scaled to the measured wall time elapsed. No-op for all
+//! other backends.
+void trace_phases(double elapsed);
 
 }  // namespace sortbench
 #endif
@@ -0,0 +1,91 @@
+#ifndef TRACEFILE_H__INCLUDED
+#define TRACEFILE_H__INCLUDED
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <regex>
+#include <string>
+
+namespace sortbench {
+
+namespace trace {
+
+// Binary trace files of dash.x (--trace=<prefix>): every rank writes its
+// own file <prefix>.<rank>.bin, one block per test case, which holds the
+// DASH trace of the last iteration. A block is a BlockHeader followed by
+// nrecords fixed size Records. tools/trace-fold.cc merges the files into
+// folded stacks (flame graphs) and a per-state summary.
+
+//! Version of BlockHeader and Record, checked by the reader
+constexpr std::uint32_t VERSION = 1;
+
+//! Header of the trace of one test case on one rank
+struct BlockHeader {
+  //! "SBTRACE", NUL terminated
+  char          magic[8];
+  std::uint32_t version;
+  std::uint32_t rank;
+  std::uint32_t nranks;
+  std::uint32_t nrecords;
+  //! measured time of the traced sort in seconds
+  double        elapsed;
+  char          test_case[64];
+  char          type[16];
+  char          dist[32];
+};
+
+//! Span of a state on the rank of the block, the raw timestamps of the
+//! DASH timer copied from the TraceStore (exact up to 2^53 ticks). The
+//! top-level states span the traced sort, i.e. elapsed of the block converts
+//! them to seconds.
+struct Record {
+  double start;
+  double end;
+  char   state[48];
+};
+
+static_assert(sizeof(Record) == 64, "trace records are 64 bytes");
+
+constexpr char MAGIC[8] = "SBTRACE";
+
+//! File of rank in the trace with the given prefix
+inline std::string file_name(std::string const& prefix, int rank)
+{
+  return prefix + "." + std::to_string(rank) + ".bin";
+}
+
+//! Copies s into a fixed size field, truncated and NUL terminated
+template <size_t N>
+inline void set_name(char (&field)[N], std::string const& s)
+{
+  std::memset(field, 0, N);
+  std::memcpy(field, s.data(), std::min(s.size(), N - 1));
+}
+
+//! Contents of a fixed size field
+template <size_t N>
+inline std::string get_name(char const (&field)[N])
+{
+  return std::string(field, strnlen(field, N));
+}
+
+//! Sub-states (e.g. "4.1:...") are nested in their top-level state
+inline bool is_detail(std::string const& state)
+{
+  static std::regex const detail("[0-9]\\.[0-9].*");
+  return std::regex_match(state, detail);
+}
+
+//! Number of the top-level state of a state, e.g. "4" of "4.1:..."
+inline std::string phase_of(std::string const& state)
+{
+  return state.substr(0, state.find_first_of(".:"));
+}
+
+}  // namespace trace
+
+}  // namespace sortbench
+
+#endif
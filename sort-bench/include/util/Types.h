@@ -0,0 +1,203 @@
+#ifndef TYPES_H__INCLUDED
+#define TYPES_H__INCLUDED
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+namespace sortbench {
+
+//! Key-value record as found in production sorts: a 64-bit key followed by
+//! an opaque payload which is moved along with the key.
+template <size_t NPayload>
+struct Record {
+  uint64_t key;
+  char     payload[NPayload];
+};
+
+template <size_t NPayload>
+inline bool operator<(Record<NPayload> const& lhs, Record<NPayload> const& rhs)
+{
+  return lhs.key < rhs.key;
+}
+
+template <size_t NPayload>
+inline std::ostream& operator<<(std::ostream& os, Record<NPayload> const& rec)
+{
+  return os << rec.key;
+}
+
+//! Sort key of a value together with the value's position, sorted instead of
+//! the value itself by --argsort. Packed to 4 bytes, i.e. a 64-bit key with a
+//! 32-bit index takes 12 instead of 16 bytes.
+#pragma pack(push, 4)
+template <typename K, typename I>
+struct KeyIndex {
+  K key;
+  I index;
+};
+#pragma pack(pop)
+
+template <typename K, typename I>
+inline bool operator<(KeyIndex<K, I> const& lhs, KeyIndex<K, I> const& rhs)
+{
+  return lhs.key < rhs.key;
+}
+
+//! Access to the sort key of a value, i.e. the value itself for arithmetic
+//! types and the key field for records.
+template <typename T>
+struct record_traits {
+  static_assert(
+      std::is_arithmetic<T>::value, "keys have to be arithmetic types");
+
+  using key_type = T;
+
+  static constexpr bool is_record = false;
+
+  static key_type key(T const& v)
+  {
+    return v;
+  }
+
+  static T make(key_type k, size_t /* index */)
+  {
+    return k;
+  }
+};
+
+template <size_t NPayload>
+struct record_traits<Record<NPayload>> {
+  using key_type = uint64_t;
+
+  static constexpr bool is_record = true;
+
+  static key_type key(Record<NPayload> const& v)
+  {
+    return v.key;
+  }
+
+  //! The payload is filled with the global index such that the bytes are
+  //! written (and faulted in) by the generator.
+  static Record<NPayload> make(key_type k, size_t index)
+  {
+    Record<NPayload> rec;
+    rec.key = k;
+    for (size_t b = 0; b < NPayload; ++b) {
+      rec.payload[b] = static_cast<char>(index >> ((b % sizeof(index)) * 8));
+    }
+    return rec;
+  }
+};
+
+//! Converts a generated value to the key type. Unsigned keys are shifted to
+//! the middle of their range, such that distributions centered at zero do
+//! not wrap around.
+template <typename K>
+inline typename std::enable_if<std::is_floating_point<K>::value, K>::type
+to_key(double v)
+{
+  return static_cast<K>(v);
+}
+
+template <typename K>
+inline typename std::enable_if<
+    std::is_integral<K>::value && std::is_signed<K>::value,
+    K>::type
+to_key(double v)
+{
+  return static_cast<K>(std::llround(v));
+}
+
+template <typename K>
+inline typename std::enable_if<
+    std::is_integral<K>::value && std::is_unsigned<K>::value,
+    K>::type
+to_key(double v)
+{
+  constexpr K center = std::numeric_limits<K>::max() / 2 + 1;
+  // modular arithmetic, negative offsets end up below center
+  return static_cast<K>(center + static_cast<K>(std::llround(v)));
+}
+
+//! Short name used for --type and in the CSV output
+template <typename T>
+struct type_name;
+
+#define SORTBENCH_TYPE_NAME(type, name)      \
+  template <>                                \
+  struct type_name<type> {                   \
+    static char const* get()                 \
+    {                                        \
+      return name;                           \
+    }                                        \
+  }
+
+SORTBENCH_TYPE_NAME(int32_t, "int32");
+SORTBENCH_TYPE_NAME(uint64_t, "uint64");
+SORTBENCH_TYPE_NAME(float, "float");
+SORTBENCH_TYPE_NAME(double, "double");
+SORTBENCH_TYPE_NAME(Record<8>, "rec16");
+SORTBENCH_TYPE_NAME(Record<24>, "rec32");
+SORTBENCH_TYPE_NAME(Record<56>, "rec64");
+
+#undef SORTBENCH_TYPE_NAME
+
+template <typename... Ts>
+struct type_list {
+};
+
+template <typename T>
+struct type_tag {
+  using type = T;
+};
+
+//! All types Test() is instantiated for
+using key_types = type_list<
+    int32_t,
+    uint64_t,
+    float,
+    double,
+    Record<8>,
+    Record<24>,
+    Record<56>>;
+
+//! Calls f(type_tag<T>{}) for the type T named name, returns false if no
+//! type in the list matches.
+template <typename F>
+inline bool for_type(std::string const&, type_list<>, F&&)
+{
+  return false;
+}
+
+template <typename T, typename... Ts, typename F>
+inline bool for_type(std::string const& name, type_list<T, Ts...>, F&& f)
+{
+  if (name == type_name<T>::get()) {
+    f(type_tag<T>{});
+    return true;
+  }
+  return for_type(name, type_list<Ts...>{}, std::forward<F>(f));
+}
+
+//! Comma separated names of all types in the list
+inline std::string type_names(type_list<>)
+{
+  return {};
+}
+
+template <typename T, typename... Ts>
+inline std::string type_names(type_list<T, Ts...>)
+{
+  auto const tail = type_names(type_list<Ts...>{});
+  return std::string(type_name<T>::get()) + (tail.empty() ? "" : ",") + tail;
+}
+
+}  // namespace sortbench
+
+#endif
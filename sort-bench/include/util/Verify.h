@@ -0,0 +1,236 @@
+#ifndef VERIFY_H__INCLUDED
+#define VERIFY_H__INCLUDED
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <util/Logging.h>
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+#include <mpi.h>
+#endif
+
+namespace sortbench {
+
+//! What Test() checks after every sort
+enum class Verify {
+  // nothing, keeps verification off the critical path of large runs
+  none,
+  // global sort order
+  order,
+  // sort order and the multiset fingerprint of the keys before and after
+  full
+};
+
+inline bool parse_verify(std::string const& name, Verify& verify)
+{
+  if (name == "none") {
+    verify = Verify::none;
+  }
+  else if (name == "order") {
+    verify = Verify::order;
+  }
+  else if (name == "full") {
+    verify = Verify::full;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+//! Order independent hash of a multiset of values: the sum of a 64-bit hash
+//! of every value plus the number of values. Lost, duplicated or corrupted
+//! values (payload included) change it with high probability, a permutation
+//! does not.
+struct Fingerprint {
+  uint64_t count = 0;
+  uint64_t sum   = 0;
+
+  Fingerprint& operator+=(Fingerprint const& other)
+  {
+    count += other.count;
+    sum += other.sum;
+    return *this;
+  }
+
+  bool operator==(Fingerprint const& other) const
+  {
+    return count == other.count && sum == other.sum;
+  }
+
+  bool operator!=(Fingerprint const& other) const
+  {
+    return !(*this == other);
+  }
+};
+
+namespace detail {
+
+//! splitmix64 finalizer
+inline uint64_t mix64(uint64_t z)
+{
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+}  // namespace detail
+
+//! Hash over all bytes of a value
+template <typename T>
+inline uint64_t fingerprint_hash(T const& v)
+{
+  constexpr size_t nwords = (sizeof(T) + sizeof(uint64_t) - 1) / 8;
+
+  uint64_t words[nwords] = {};
+  std::memcpy(words, &v, sizeof(T));
+
+  uint64_t h = sizeof(T);
+  for (size_t w = 0; w < nwords; ++w) {
+    h = detail::mix64(h + words[w]);
+  }
+  return h;
+}
+
+template <typename T>
+inline Fingerprint fingerprint(T const* first, size_t lo, size_t hi)
+{
+  Fingerprint fp;
+  fp.count = hi - lo;
+  for (size_t idx = lo; idx < hi; ++idx) {
+    fp.sum += fingerprint_hash(first[idx]);
+  }
+  return fp;
+}
+
+//! Elements checked between two polls of the early exit flag
+constexpr size_t VERIFY_BLOCK = 4096;
+
+//! Checks first[lo, hi) and the boundary to first[lo - 1] (if lo > 0) block
+//! wise. The comparisons of a block are counted branch free so the loop
+//! vectorizes; a violation raises failed, which makes all other chunks stop
+//! after their current block. Returns the number of violations found.
+template <typename T, typename Compare>
+inline size_t verify_chunk(
+    T const*           first,
+    size_t             lo,
+    size_t             hi,
+    Compare            cmp,
+    std::atomic<bool>& failed)
+{
+  size_t nerror = 0;
+
+  for (size_t blo = std::max<size_t>(lo, 1); blo < hi; blo += VERIFY_BLOCK) {
+    if (failed.load(std::memory_order_relaxed)) break;
+
+    auto const bhi = std::min(hi, blo + VERIFY_BLOCK);
+
+    size_t nblock = 0;
+    for (size_t idx = blo; idx < bhi; ++idx) {
+      nblock += cmp(first[idx], first[idx - 1]);
+    }
+
+    if (nblock) {
+      failed.store(true, std::memory_order_relaxed);
+      // slow path, report the first violation of the block only
+      for (size_t idx = blo; idx < bhi; ++idx) {
+        if (cmp(first[idx], first[idx - 1])) {
+          LOG("Failed sort order: {prev: " << first[idx - 1]
+                                           << ", cur: " << first[idx] << "}");
+          break;
+        }
+      }
+      nerror += nblock;
+    }
+  }
+
+  return nerror;
+}
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+
+//! Checks the boundaries between the local ranges of all ranks in rank
+//! order: every rank contributes its first and last element to a single
+//! allgather and compares its first element with the last element of the
+//! closest preceding non-empty rank. Collective, returns the global number
+//! of violations found by the local check (nlocal_errors) and at the
+//! boundaries.
+template <typename T, typename Compare>
+inline size_t verify_boundaries(
+    T const* first, size_t n, Compare cmp, size_t nlocal_errors)
+{
+  struct edge_t {
+    uint64_t nerror;
+    uint64_t nonempty;
+    T        front;
+    T        back;
+  };
+
+  int nranks, myrank;
+  MPI_Comm_size(MPI_COMM_WORLD, &nranks);
+  MPI_Comm_rank(MPI_COMM_WORLD, &myrank);
+
+  edge_t mine;
+  std::memset(&mine, 0, sizeof(mine));
+  mine.nerror   = nlocal_errors;
+  mine.nonempty = n > 0;
+  if (n > 0) {
+    mine.front = first[0];
+    mine.back  = first[n - 1];
+  }
+
+  std::vector<edge_t> edges(nranks);
+  MPI_Allgather(
+      &mine,
+      sizeof(edge_t),
+      MPI_BYTE,
+      edges.data(),
+      sizeof(edge_t),
+      MPI_BYTE,
+      MPI_COMM_WORLD);
+
+  // every rank evaluates all boundaries, so the result is the same
+  // everywhere without another collective
+  size_t        nerror = 0;
+  edge_t const* prev   = nullptr;
+  for (int rank = 0; rank < nranks; ++rank) {
+    auto const& cur = edges[rank];
+    nerror += cur.nerror;
+    if (!cur.nonempty) continue;
+    if (prev && cmp(cur.front, prev->back)) {
+      if (rank == myrank) {
+        LOG("Failed global order: {prev: " << prev->back
+                                           << ", cur: " << cur.front << "}");
+      }
+      ++nerror;
+    }
+    prev = &cur;
+  }
+
+  return nerror;
+}
+
+//! Sum of the local fingerprints of all ranks
+inline Fingerprint allreduce(Fingerprint const& local)
+{
+  uint64_t in[2] = {local.count, local.sum};
+  uint64_t out[2];
+  // unsigned sums wrap around identically on all ranks
+  MPI_Allreduce(in, out, 2, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+  Fingerprint global;
+  global.count = out[0];
+  global.sum   = out[1];
+  return global;
+}
+
+#endif
+
+}  // namespace sortbench
+
+#endif
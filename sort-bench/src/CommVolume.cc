@@ -0,0 +1,874 @@
+#include <map>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+#include <util/CommVolume.h>
+#include <util/Timer.h>
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+
+#include <mpi.h>
+
+namespace {
+
+// counting between sortbench::comm::start() and stop()
+bool enabled = false;
+// bytes this rank sent to every rank and got from every rank by one-sided
+// gets, indexed by the rank in MPI_COMM_WORLD
+std::vector<unsigned long long> sent;
+std::vector<unsigned long long> got;
+// ranks in MPI_COMM_WORLD of the members of every communicator and window
+// seen so far, dropped when the handle is freed (MPI_Comm_free, MPI_Win_free)
+std::map<MPI_Comm, std::vector<int>> comm_ranks;
+std::map<MPI_Win, std::vector<int>>  win_ranks;
+
+// timing between sortbench::comm::start_timer() and stop_timer(), the wall
+// time this rank spent inside the intercepted calls
+bool   timing   = false;
+double mpi_time = 0;
+
+//! Adds the lifetime of the scope, i.e. an intercepted call, to mpi_time
+class CallTimer {
+public:
+  CallTimer()
+    : start_(timing ? ChronoClockNow() : 0)
+  {
+  }
+
+  CallTimer(CallTimer const&) = delete;
+  CallTimer& operator=(CallTimer const&) = delete;
+
+  ~CallTimer()
+  {
+    if (timing) mpi_time += ChronoClockNow() - start_;
+  }
+
+private:
+  double start_;
+};
+
+template <typename Count>
+unsigned long long type_bytes(MPI_Datatype type, Count count)
+{
+  int size = 0;
+  PMPI_Type_size(type, &size);
+  return count > 0 ? static_cast<unsigned long long>(count) * size : 0;
+}
+
+//! Ranks of the members of group in MPI_COMM_WORLD
+std::vector<int> world_ranks(MPI_Group group)
+{
+  int n;
+  PMPI_Group_size(group, &n);
+  std::vector<int> local(n), world(n);
+  std::iota(local.begin(), local.end(), 0);
+
+  MPI_Group world_group;
+  PMPI_Comm_group(MPI_COMM_WORLD, &world_group);
+  PMPI_Group_translate_ranks(
+      group, n, local.data(), world_group, world.data());
+  PMPI_Group_free(&world_group);
+  return world;
+}
+
+//! Ranks of the members of comm in MPI_COMM_WORLD, translated on the first
+//! call for comm
+std::vector<int> const& world_ranks(MPI_Comm comm)
+{
+  auto it = comm_ranks.find(comm);
+  if (it != comm_ranks.end()) return it->second;
+
+  std::vector<int> world;
+  if (comm == MPI_COMM_WORLD) {
+    int n;
+    PMPI_Comm_size(comm, &n);
+    world.resize(n);
+    std::iota(world.begin(), world.end(), 0);
+  }
+  else {
+    MPI_Group group;
+    PMPI_Comm_group(comm, &group);
+    world = world_ranks(group);
+    PMPI_Group_free(&group);
+  }
+  return comm_ranks.emplace(comm, std::move(world)).first->second;
+}
+
+//! Ranks of the members of the window in MPI_COMM_WORLD, translated on the
+//! first call for win
+std::vector<int> const& world_ranks(MPI_Win win)
+{
+  auto it = win_ranks.find(win);
+  if (it != win_ranks.end()) return it->second;
+
+  MPI_Group group;
+  PMPI_Win_get_group(win, &group);
+  auto world = world_ranks(group);
+  PMPI_Group_free(&group);
+  return win_ranks.emplace(win, std::move(world)).first->second;
+}
+
+int my_rank(MPI_Comm comm)
+{
+  int me;
+  PMPI_Comm_rank(comm, &me);
+  return me;
+}
+
+//! Point-to-point send of count elements to rank dest of comm
+void count_send(MPI_Comm comm, int dest, MPI_Datatype type, int count)
+{
+  if (!enabled || dest == MPI_PROC_NULL) return;
+  auto const to = comm == MPI_COMM_WORLD ? dest : world_ranks(comm)[dest];
+  sent[to] += type_bytes(type, count);
+}
+
+//! Collective sending counts[i] (or count if counts is null) elements to
+//! every rank i of comm
+template <typename Count = int>
+void count_all(
+    MPI_Comm     comm,
+    MPI_Datatype type,
+    Count        count,
+    Count const* counts = nullptr)
+{
+  if (!enabled) return;
+  auto const& world = world_ranks(comm);
+  for (size_t rank = 0; rank < world.size(); ++rank) {
+    sent[world[rank]] += type_bytes(type, counts ? counts[rank] : count);
+  }
+}
+
+//! One-sided transfer of count elements between this rank and rank target
+//! of the window, put: origin to target, get: target to origin
+void count_rma(MPI_Win win, int target, MPI_Datatype type, int count, bool put)
+{
+  if (!enabled || target == MPI_PROC_NULL) return;
+  auto const peer = world_ranks(win)[target];
+  (put ? sent : got)[peer] += type_bytes(type, count);
+}
+
+}  // namespace
+
+namespace sortbench {
+
+namespace comm {
+
+void start()
+{
+  int P;
+  PMPI_Comm_size(MPI_COMM_WORLD, &P);
+  sent.assign(P, 0);
+  got.assign(P, 0);
+  enabled = true;
+}
+
+void stop()
+{
+  enabled = false;
+}
+
+void start_timer()
+{
+  mpi_time = 0;
+  timing   = true;
+}
+
+double stop_timer()
+{
+  timing = false;
+  return mpi_time;
+}
+
+std::vector<unsigned long long> gather_matrix()
+{
+  int P, me;
+  PMPI_Comm_size(MPI_COMM_WORLD, &P);
+  PMPI_Comm_rank(MPI_COMM_WORLD, &me);
+
+  auto const                      nall = me == 0 ? P * P : 0;
+  std::vector<unsigned long long> sent_all(nall), got_all(nall);
+  PMPI_Gather(
+      sent.data(),
+      P,
+      MPI_UNSIGNED_LONG_LONG,
+      sent_all.data(),
+      P,
+      MPI_UNSIGNED_LONG_LONG,
+      0,
+      MPI_COMM_WORLD);
+  PMPI_Gather(
+      got.data(),
+      P,
+      MPI_UNSIGNED_LONG_LONG,
+      got_all.data(),
+      P,
+      MPI_UNSIGNED_LONG_LONG,
+      0,
+      MPI_COMM_WORLD);
+
+  // rank j got got_all[j * P + i] bytes from rank i
+  for (int from = 0; from < P && me == 0; ++from) {
+    for (int to = 0; to < P; ++to) {
+      sent_all[from * P + to] += got_all[to * P + from];
+    }
+  }
+  return sent_all;
+}
+
+}  // namespace comm
+
+}  // namespace sortbench
+
+// PMPI interposition: the MPI functions defined here take precedence over
+// the ones of the MPI library, count and forward to the PMPI entry points.
+// Reductions (MPI_Reduce, MPI_Allreduce, ...) are deliberately not counted:
+// the bytes they move depend on the reduction algorithm of the MPI library,
+// and the sorts only reduce counts and splitters, not keys. They are timed
+// like every other call below, together with the receives, waits and
+// barriers which move no bytes of their own.
+
+int MPI_Comm_free(MPI_Comm* comm)
+{
+  comm_ranks.erase(*comm);
+  return PMPI_Comm_free(comm);
+}
+
+int MPI_Win_free(MPI_Win* win)
+{
+  win_ranks.erase(*win);
+  return PMPI_Win_free(win);
+}
+
+int MPI_Send(
+    void const*  buf,
+    int          count,
+    MPI_Datatype type,
+    int          dest,
+    int          tag,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  count_send(comm, dest, type, count);
+  return PMPI_Send(buf, count, type, dest, tag, comm);
+}
+
+int MPI_Ssend(
+    void const*  buf,
+    int          count,
+    MPI_Datatype type,
+    int          dest,
+    int          tag,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  count_send(comm, dest, type, count);
+  return PMPI_Ssend(buf, count, type, dest, tag, comm);
+}
+
+int MPI_Isend(
+    void const*  buf,
+    int          count,
+    MPI_Datatype type,
+    int          dest,
+    int          tag,
+    MPI_Comm     comm,
+    MPI_Request* request)
+{
+  CallTimer const timer;
+  count_send(comm, dest, type, count);
+  return PMPI_Isend(buf, count, type, dest, tag, comm, request);
+}
+
+int MPI_Issend(
+    void const*  buf,
+    int          count,
+    MPI_Datatype type,
+    int          dest,
+    int          tag,
+    MPI_Comm     comm,
+    MPI_Request* request)
+{
+  CallTimer const timer;
+  count_send(comm, dest, type, count);
+  return PMPI_Issend(buf, count, type, dest, tag, comm, request);
+}
+
+int MPI_Sendrecv(
+    void const*  sendbuf,
+    int          sendcount,
+    MPI_Datatype sendtype,
+    int          dest,
+    int          sendtag,
+    void*        recvbuf,
+    int          recvcount,
+    MPI_Datatype recvtype,
+    int          source,
+    int          recvtag,
+    MPI_Comm     comm,
+    MPI_Status*  status)
+{
+  CallTimer const timer;
+  count_send(comm, dest, sendtype, sendcount);
+  return PMPI_Sendrecv(
+      sendbuf,
+      sendcount,
+      sendtype,
+      dest,
+      sendtag,
+      recvbuf,
+      recvcount,
+      recvtype,
+      source,
+      recvtag,
+      comm,
+      status);
+}
+
+int MPI_Sendrecv_replace(
+    void*        buf,
+    int          count,
+    MPI_Datatype type,
+    int          dest,
+    int          sendtag,
+    int          source,
+    int          recvtag,
+    MPI_Comm     comm,
+    MPI_Status*  status)
+{
+  CallTimer const timer;
+  count_send(comm, dest, type, count);
+  return PMPI_Sendrecv_replace(
+      buf, count, type, dest, sendtag, source, recvtag, comm, status);
+}
+
+int MPI_Alltoall(
+    void const*  sendbuf,
+    int          sendcount,
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int          recvcount,
+    MPI_Datatype recvtype,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  if (sendbuf == MPI_IN_PLACE) {
+    count_all(comm, recvtype, recvcount);
+  }
+  else {
+    count_all(comm, sendtype, sendcount);
+  }
+  return PMPI_Alltoall(
+      sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+}
+
+int MPI_Alltoallv(
+    void const*  sendbuf,
+    int const    sendcounts[],
+    int const    sdispls[],
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int const    recvcounts[],
+    int const    rdispls[],
+    MPI_Datatype recvtype,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  if (sendbuf == MPI_IN_PLACE) {
+    count_all(comm, recvtype, 0, recvcounts);
+  }
+  else {
+    count_all(comm, sendtype, 0, sendcounts);
+  }
+  return PMPI_Alltoallv(
+      sendbuf,
+      sendcounts,
+      sdispls,
+      sendtype,
+      recvbuf,
+      recvcounts,
+      rdispls,
+      recvtype,
+      comm);
+}
+
+#if MPI_VERSION >= 4
+int MPI_Alltoallv_c(
+    void const*     sendbuf,
+    MPI_Count const sendcounts[],
+    MPI_Aint const  sdispls[],
+    MPI_Datatype    sendtype,
+    void*           recvbuf,
+    MPI_Count const recvcounts[],
+    MPI_Aint const  rdispls[],
+    MPI_Datatype    recvtype,
+    MPI_Comm        comm)
+{
+  CallTimer const timer;
+  if (sendbuf == MPI_IN_PLACE) {
+    count_all<MPI_Count>(comm, recvtype, 0, recvcounts);
+  }
+  else {
+    count_all<MPI_Count>(comm, sendtype, 0, sendcounts);
+  }
+  return PMPI_Alltoallv_c(
+      sendbuf,
+      sendcounts,
+      sdispls,
+      sendtype,
+      recvbuf,
+      recvcounts,
+      rdispls,
+      recvtype,
+      comm);
+}
+#endif
+
+int MPI_Ialltoallv(
+    void const*  sendbuf,
+    int const    sendcounts[],
+    int const    sdispls[],
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int const    recvcounts[],
+    int const    rdispls[],
+    MPI_Datatype recvtype,
+    MPI_Comm     comm,
+    MPI_Request* request)
+{
+  CallTimer const timer;
+  if (sendbuf == MPI_IN_PLACE) {
+    count_all(comm, recvtype, 0, recvcounts);
+  }
+  else {
+    count_all(comm, sendtype, 0, sendcounts);
+  }
+  return PMPI_Ialltoallv(
+      sendbuf,
+      sendcounts,
+      sdispls,
+      sendtype,
+      recvbuf,
+      recvcounts,
+      rdispls,
+      recvtype,
+      comm,
+      request);
+}
+
+int MPI_Allgather(
+    void const*  sendbuf,
+    int          sendcount,
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int          recvcount,
+    MPI_Datatype recvtype,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  if (sendbuf == MPI_IN_PLACE) {
+    count_all(comm, recvtype, recvcount);
+  }
+  else {
+    count_all(comm, sendtype, sendcount);
+  }
+  return PMPI_Allgather(
+      sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, comm);
+}
+
+int MPI_Allgatherv(
+    void const*  sendbuf,
+    int          sendcount,
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int const    recvcounts[],
+    int const    displs[],
+    MPI_Datatype recvtype,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  if (sendbuf == MPI_IN_PLACE) {
+    count_all(comm, recvtype, recvcounts[my_rank(comm)]);
+  }
+  else {
+    count_all(comm, sendtype, sendcount);
+  }
+  return PMPI_Allgatherv(
+      sendbuf,
+      sendcount,
+      sendtype,
+      recvbuf,
+      recvcounts,
+      displs,
+      recvtype,
+      comm);
+}
+
+int MPI_Gather(
+    void const*  sendbuf,
+    int          sendcount,
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int          recvcount,
+    MPI_Datatype recvtype,
+    int          root,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  if (sendbuf != MPI_IN_PLACE) {
+    count_send(comm, root, sendtype, sendcount);
+  }
+  return PMPI_Gather(
+      sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+}
+
+int MPI_Gatherv(
+    void const*  sendbuf,
+    int          sendcount,
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int const    recvcounts[],
+    int const    displs[],
+    MPI_Datatype recvtype,
+    int          root,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  if (sendbuf != MPI_IN_PLACE) {
+    count_send(comm, root, sendtype, sendcount);
+  }
+  return PMPI_Gatherv(
+      sendbuf,
+      sendcount,
+      sendtype,
+      recvbuf,
+      recvcounts,
+      displs,
+      recvtype,
+      root,
+      comm);
+}
+
+int MPI_Scatter(
+    void const*  sendbuf,
+    int          sendcount,
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int          recvcount,
+    MPI_Datatype recvtype,
+    int          root,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  if (my_rank(comm) == root) {
+    count_all(comm, sendtype, sendcount);
+  }
+  return PMPI_Scatter(
+      sendbuf, sendcount, sendtype, recvbuf, recvcount, recvtype, root, comm);
+}
+
+int MPI_Scatterv(
+    void const*  sendbuf,
+    int const    sendcounts[],
+    int const    displs[],
+    MPI_Datatype sendtype,
+    void*        recvbuf,
+    int          recvcount,
+    MPI_Datatype recvtype,
+    int          root,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  if (my_rank(comm) == root) {
+    count_all(comm, sendtype, 0, sendcounts);
+  }
+  return PMPI_Scatterv(
+      sendbuf,
+      sendcounts,
+      displs,
+      sendtype,
+      recvbuf,
+      recvcount,
+      recvtype,
+      root,
+      comm);
+}
+
+int MPI_Bcast(void* buf, int count, MPI_Datatype type, int root, MPI_Comm comm)
+{
+  CallTimer const timer;
+  if (my_rank(comm) == root) {
+    count_all(comm, type, count);
+  }
+  return PMPI_Bcast(buf, count, type, root, comm);
+}
+
+int MPI_Put(
+    void const*  origin,
+    int          origin_count,
+    MPI_Datatype origin_type,
+    int          target,
+    MPI_Aint     target_disp,
+    int          target_count,
+    MPI_Datatype target_type,
+    MPI_Win      win)
+{
+  CallTimer const timer;
+  count_rma(win, target, origin_type, origin_count, true);
+  return PMPI_Put(
+      origin,
+      origin_count,
+      origin_type,
+      target,
+      target_disp,
+      target_count,
+      target_type,
+      win);
+}
+
+int MPI_Rput(
+    void const*  origin,
+    int          origin_count,
+    MPI_Datatype origin_type,
+    int          target,
+    MPI_Aint     target_disp,
+    int          target_count,
+    MPI_Datatype target_type,
+    MPI_Win      win,
+    MPI_Request* request)
+{
+  CallTimer const timer;
+  count_rma(win, target, origin_type, origin_count, true);
+  return PMPI_Rput(
+      origin,
+      origin_count,
+      origin_type,
+      target,
+      target_disp,
+      target_count,
+      target_type,
+      win,
+      request);
+}
+
+int MPI_Accumulate(
+    void const*  origin,
+    int          origin_count,
+    MPI_Datatype origin_type,
+    int          target,
+    MPI_Aint     target_disp,
+    int          target_count,
+    MPI_Datatype target_type,
+    MPI_Op       op,
+    MPI_Win      win)
+{
+  CallTimer const timer;
+  count_rma(win, target, origin_type, origin_count, true);
+  return PMPI_Accumulate(
+      origin,
+      origin_count,
+      origin_type,
+      target,
+      target_disp,
+      target_count,
+      target_type,
+      op,
+      win);
+}
+
+int MPI_Get(
+    void*        origin,
+    int          origin_count,
+    MPI_Datatype origin_type,
+    int          target,
+    MPI_Aint     target_disp,
+    int          target_count,
+    MPI_Datatype target_type,
+    MPI_Win      win)
+{
+  CallTimer const timer;
+  count_rma(win, target, origin_type, origin_count, false);
+  return PMPI_Get(
+      origin,
+      origin_count,
+      origin_type,
+      target,
+      target_disp,
+      target_count,
+      target_type,
+      win);
+}
+
+int MPI_Rget(
+    void*        origin,
+    int          origin_count,
+    MPI_Datatype origin_type,
+    int          target,
+    MPI_Aint     target_disp,
+    int          target_count,
+    MPI_Datatype target_type,
+    MPI_Win      win,
+    MPI_Request* request)
+{
+  CallTimer const timer;
+  count_rma(win, target, origin_type, origin_count, false);
+  return PMPI_Rget(
+      origin,
+      origin_count,
+      origin_type,
+      target,
+      target_disp,
+      target_count,
+      target_type,
+      win,
+      request);
+}
+
+// Timed only: receives, completion, synchronization and reductions
+
+int MPI_Recv(
+    void*        buf,
+    int          count,
+    MPI_Datatype type,
+    int          source,
+    int          tag,
+    MPI_Comm     comm,
+    MPI_Status*  status)
+{
+  CallTimer const timer;
+  return PMPI_Recv(buf, count, type, source, tag, comm, status);
+}
+
+int MPI_Irecv(
+    void*        buf,
+    int          count,
+    MPI_Datatype type,
+    int          source,
+    int          tag,
+    MPI_Comm     comm,
+    MPI_Request* request)
+{
+  CallTimer const timer;
+  return PMPI_Irecv(buf, count, type, source, tag, comm, request);
+}
+
+int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status* status)
+{
+  CallTimer const timer;
+  return PMPI_Probe(source, tag, comm, status);
+}
+
+int MPI_Wait(MPI_Request* request, MPI_Status* status)
+{
+  CallTimer const timer;
+  return PMPI_Wait(request, status);
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[])
+{
+  CallTimer const timer;
+  return PMPI_Waitall(count, requests, statuses);
+}
+
+int MPI_Waitany(
+    int count, MPI_Request requests[], int* index, MPI_Status* status)
+{
+  CallTimer const timer;
+  return PMPI_Waitany(count, requests, index, status);
+}
+
+int MPI_Barrier(MPI_Comm comm)
+{
+  CallTimer const timer;
+  return PMPI_Barrier(comm);
+}
+
+int MPI_Allreduce(
+    void const*  sendbuf,
+    void*        recvbuf,
+    int          count,
+    MPI_Datatype type,
+    MPI_Op       op,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  return PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+}
+
+int MPI_Reduce(
+    void const*  sendbuf,
+    void*        recvbuf,
+    int          count,
+    MPI_Datatype type,
+    MPI_Op       op,
+    int          root,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  return PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm);
+}
+
+int MPI_Scan(
+    void const*  sendbuf,
+    void*        recvbuf,
+    int          count,
+    MPI_Datatype type,
+    MPI_Op       op,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  return PMPI_Scan(sendbuf, recvbuf, count, type, op, comm);
+}
+
+int MPI_Exscan(
+    void const*  sendbuf,
+    void*        recvbuf,
+    int          count,
+    MPI_Datatype type,
+    MPI_Op       op,
+    MPI_Comm     comm)
+{
+  CallTimer const timer;
+  return PMPI_Exscan(sendbuf, recvbuf, count, type, op, comm);
+}
+
+int MPI_Win_fence(int assert_, MPI_Win win)
+{
+  CallTimer const timer;
+  return PMPI_Win_fence(assert_, win);
+}
+
+#else
+
+namespace sortbench {
+
+namespace comm {
+
+void start()
+{
+}
+
+void stop()
+{
+}
+
+void start_timer()
+{
+}
+
+double stop_timer()
+{
+  return 0;
+}
+
+std::vector<unsigned long long> gather_matrix()
+{
+  return {};
+}
+
+}  // namespace comm
+
+}  // namespace sortbench
+
+#endif
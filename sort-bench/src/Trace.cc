@@ -1,24 +1,98 @@
 #include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
 
+#include <util/Timer.h>
 #include <util/Trace.h>
+#include <util/TraceFile.h>
 
 #ifdef USE_DASH
 #include <dash/util/Trace.h>
+
+// trace context of dash::sort
+#ifndef SORTBENCH_DASH_TRACE_CONTEXT
+#define SORTBENCH_DASH_TRACE_CONTEXT "Sort"
+#endif
 #endif
 
 namespace sortbench {
 
-void flush_trace(std::vector<unsigned> const& samples, int myrank)
-{
+namespace {
+
 #ifdef USE_DASH
-  // if the id of this task is included in samples
-  if (std::find(std::begin(samples), std::end(samples), myrank) !=
-      std::end(samples)) {
-    dash::util::TraceStore::write(std::cout, false);
+//! Calls f(state, start, end) for every state span dash::sort recorded on
+//! this unit, with the raw timestamps of the DASH timer
+template <typename F>
+void for_each_span(F f)
+{
+  auto const& spans =
+      dash::util::TraceStore::context_trace(SORTBENCH_DASH_TRACE_CONTEXT);
+  for (auto const& span : spans) {
+    f(span.state,
+      static_cast<double>(span.start),
+      static_cast<double>(span.end));
   }
+}
+#endif
+
+}  // namespace
+
+void flush_trace(
+    std::string const& prefix,
+    int                myrank,
+    int                nranks,
+    double             elapsed,
+    std::string const& test_case,
+    std::string const& type,
+    std::string const& dist)
+{
+#ifdef USE_DASH
+  std::vector<trace::Record> records;
+  for_each_span([&records](
+                    std::string const& state, double start, double end) {
+    trace::Record rec;
+    rec.start = start;
+    rec.end   = end;
+    trace::set_name(rec.state, state);
+    records.push_back(rec);
+  });
 
   dash::util::TraceStore::off();
   dash::util::TraceStore::clear();
+
+  // tracing disabled (DASH_ENABLE_TRACE)
+  if (records.empty()) return;
+
+  trace::BlockHeader header{};
+  trace::set_name(header.magic, trace::MAGIC);
+  header.version  = trace::VERSION;
+  header.rank     = static_cast<std::uint32_t>(myrank);
+  header.nranks   = static_cast<std::uint32_t>(nranks);
+  header.nrecords = static_cast<std::uint32_t>(records.size());
+  header.elapsed  = elapsed;
+  trace::set_name(header.test_case, test_case);
+  trace::set_name(header.type, type);
+  trace::set_name(header.dist, dist);
+
+  // the first block of this process starts a new file
+  static bool first = true;
+  auto const  path  = trace::file_name(prefix, myrank);
+  std::ofstream out(
+      path,
+      std::ios::binary | (first ? std::ios::trunc : std::ios::app));
+  out.write(reinterpret_cast<char const*>(&header), sizeof(header));
+  out.write(
+      reinterpret_cast<char const*>(records.data()),
+      records.size() * sizeof(trace::Record));
+  if (!out) {
+    std::cerr << "cannot write " << path << "\n";
+  }
+  first = false;
 #endif
 }
 
@@ -30,4 +104,52 @@ void reset_trace()
 #endif
 }
 
+void trace_phases(double elapsed)
+{
+#ifdef USE_DASH
+  struct state_t {
+    std::string name;
+    double      first;
+    double      total;
+  };
+  std::vector<state_t> states;
+
+  double lo = std::numeric_limits<double>::max();
+  double hi = std::numeric_limits<double>::lowest();
+
+  for_each_span([&](std::string const& state, double start, double end) {
+    if (trace::is_detail(state)) return;
+
+    lo = std::min(lo, start);
+    hi = std::max(hi, end);
+
+    auto it = std::find_if(
+        states.begin(), states.end(), [&state](state_t const& s) {
+          return s.name == state;
+        });
+    if (it == states.end()) {
+      states.push_back({state, start, end - start});
+    }
+    else {
+      it->first = std::min(it->first, start);
+      it->total += end - start;
+    }
+  });
+
+  if (states.empty() || !(hi > lo)) return;
+
+  std::stable_sort(
+      states.begin(), states.end(), [](state_t const& a, state_t const& b) {
+        return a.first < b.first;
+      });
+
+  // The trace span covers the timed sort, which saves us from knowing the
+  // timestamp unit of the DASH timer.
+  auto const scale = elapsed / (hi - lo);
+  for (auto const& s : states) {
+    PhaseTimer::instance().add(s.name, s.total * scale);
+  }
+#endif
+}
+
 }  // namespace sortbench
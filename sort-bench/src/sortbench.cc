@@ -1,16 +1,30 @@
+#include <cerrno>
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <map>
+#include <memory>
+#include <random>
 #include <thread>
 #include <vector>
 #include <algorithm>
+#include <sstream>
+#include <string>
+#include <system_error>
 
 #if defined(USE_TBB_HIGHLEVEL) || defined(USE_TBB_LOWLEVEL)
 #include <tbb/sortbench.h>
 #include <tbb/task_scheduler_init.h>
 #elif defined(USE_OPENMP)
 #include <openmp/sortbench.h>
+#elif defined(USE_RADIX)
+#include <radix/sortbench.h>
+#elif defined(USE_INPLACE)
+#include <inplace/sortbench.h>
 #elif defined(USE_DASH)
 #ifdef DASH_ENABLE_PSTL
 #include <tbb/task_scheduler_init.h>
@@ -26,11 +40,24 @@
 
 #include <intel/IndexedValue.h>
 
+#include <util/Argsort.h>
+#include <util/Bandwidth.h>
+#include <util/CommVolume.h>
+#include <util/CommandLine.h>
+#include <util/Cutoffs.h>
+#include <util/External.h>
 #include <util/Generators.h>
 #include <util/Logging.h>
+#include <util/Memory.h>
+#include <util/Numa.h>
+#include <util/PerfCounters.h>
 #include <util/Random.h>
+#include <util/Select.h>
+#include <util/Statistics.h>
 #include <util/Timer.h>
 #include <util/Trace.h>
+#include <util/Types.h>
+#include <util/Verify.h>
 
 #define GB (1 << 30)
 #define MB (1 << 20)
@@ -51,62 +78,452 @@ void trace_histo(RandomIt begin, RandomIt end)
 #endif
 }
 
-static constexpr size_t BURN_IN = 1;
-static constexpr size_t NITER   = 10;
+#if defined(USE_TBB_HIGHLEVEL) || defined(USE_TBB_LOWLEVEL) || \
+    defined(USE_OPENMP) || defined(USE_RADIX)
+#define SORTBENCH_SCRATCH_ARENA
+#endif
+
+#if defined(USE_TBB_HIGHLEVEL) || defined(USE_TBB_LOWLEVEL) || \
+    defined(USE_OPENMP)
+#define SORTBENCH_MULTIWAY_MERGE
+#define SORTBENCH_PSS_CUTOFFS
+#endif
+
+//! Runtime configuration from command line flags
+struct Params {
+  // fresh: every sort allocates its scratch buffer
+  // reuse: a pre-faulted scratch arena is shared across all iterations
+  // both:  run both variants to expose the first-touch cost
+  std::string scratch = "fresh";
+  // page placement of the keys, applied before generation
+  sortbench::numa::Placement placement =
+      sortbench::numa::Placement::firsttouch;
+  // page size backing the keys and the scratch buffers
+  sortbench::Pages pages = sortbench::Pages::base;
+  // key types to benchmark, see sortbench::key_types
+  std::vector<std::string> types{"double"};
+  // seed of the counter-based generators, "random" draws one on rank 0
+  std::string seed = "default";
+  // key distributions to benchmark, see sortbench::distributions
+  std::vector<std::string> dists{"normal"};
+  // print a phase breakdown (min / max / mean across ranks) per iteration
+  bool phases = false;
+  // binary trace files <trace>.<rank>.bin of the DASH trace
+  // (DASH_ENABLE_TRACE), defaults to <app>-trace
+  std::string trace;
+  // hardware counters of the sort per result row, see sortbench::perf
+  bool perf = false;
+  // binary: PSS merge tree
+  // multiway: per-thread runs and a single multiway merge (PSS backends)
+  std::string merge = "binary";
+  // one rank per node or NUMA domain sorting with threads (mpi.x)
+  bool hybrid = false;
+  // threads per rank, the second positional argument
+  int threads = 1;
+  // strong: nbytes is the size of the whole problem, weak: nbytes per rank
+  // (thread for the shared memory backends); empty keeps the meaning of the
+  // backend and skips the baseline of the parallel efficiency
+  std::string scaling;
+  // best time of a single thread or rank for the current distribution
+  double baseline = 0;
+  // checks after every sort, see sortbench::Verify
+  sortbench::Verify verify = sortbench::Verify::order;
+  // unreported iterations before the measured ones
+  size_t burn_in = 1;
+  // measured iterations, the maximum if ci > 0
+  size_t iterations = 10;
+  // measured iterations before the confidence interval may stop the loop
+  size_t min_iterations = 5;
+  // stop once the 95% confidence interval of the mean time is within
+  // +/- ci of the mean, 0 runs a fixed number of iterations
+  double ci = 0;
+  // working set of the STREAM probe at startup per node, split across the
+  // ranks of a node, 0 disables the probe
+  size_t stream_mb = 256;
+  // STREAM bandwidth of the job, measured at startup
+  sortbench::StreamBandwidth bandwidth;
+  // calibrated PSS cut-offs, loaded at startup and written by --calibrate
+  std::string cutoffs = "sortbench.cutoffs";
+  // sweep the PSS cut-offs per key type instead of benchmarking
+  bool calibrate = false;
+  // input file of the external sort, empty for the in-memory benchmark
+  std::string external;
+  // sorted output of the external sort, defaults to <external>.sorted
+  std::string output;
+  // smallest size of the sweep in bytes, 0 for a single size
+  size_t sweep = 0;
+  // growth of the sweep sizes up to the nbytes argument
+  double sweep_factor = 2;
+  // thread counts of the sweep, defaults to the nthreads argument
+  std::vector<int> sweep_threads;
+  // measured times of the sweep, defaults to <app>-sweep.csv
+  std::string csv;
+  // off: sort the records
+  // on: sort key / index pairs and gather the records (shared memory)
+  // both: run both and report the crossover record width
+  std::string argsort = "off";
+  // k of the additional top-k test case, 0 disables it
+  size_t topk = 0;
+  // quantile in [0, 1] of the additional selection test case, < 0 disables it
+  double nth = -1;
+  // fraction of the keys changed between the iterations of the incremental
+  // re-sort test cases (dash.x), 0 disables them
+  double incremental = 0;
+  // bytes the ranks send each other during the sort (distributed backends)
+  bool comm = false;
+  // P x P matrices of --comm per iteration, defaults to <app>-comm.csv
+  std::string comm_csv;
+  // kernel of the current test case: sort, topk, nth, or the full (resort)
+  // and incremental re-sort of changed keys
+  std::string op = "sort";
+};
+
+template <class Container, class Cmp>
+inline void sort_keys(
+    Container&                     c,
+    Cmp                            cmp,
+    sortbench::ScratchArena const* arena,
+    Params const&                  params)
+{
+#if defined(USE_MPI)
+  if (params.hybrid) {
+    sortbench::parallel_sort_hybrid(c, cmp);
+    return;
+  }
+#endif
+#ifdef SORTBENCH_MULTIWAY_MERGE
+  if (params.merge == "multiway") {
+    if (arena) {
+      sortbench::parallel_sort_multiway(
+          c, cmp, pss::scratch_arena(arena->get(), arena->size()));
+    }
+    else {
+      sortbench::parallel_sort_multiway(c, cmp);
+    }
+    return;
+  }
+#endif
+#ifdef SORTBENCH_SCRATCH_ARENA
+  if (arena) {
+    sortbench::parallel_sort(
+        c, cmp, pss::scratch_arena(arena->get(), arena->size()));
+    return;
+  }
+#endif
+  sortbench::parallel_sort(c, cmp);
+}
+
+#if !defined(USE_DASH) && !defined(USE_MPI) && !defined(USE_USORT)
+//! --argsort with index type I: sorts the key / index pairs of c with the
+//! backend (same paths as sort_keys) and gathers the records in sorted order
+//! through a buffer. Returns the bytes the pair sort moved.
+template <typename I, class Container>
+double argsort_keys_as(
+    Container&                     c,
+    sortbench::ScratchArena const* arena,
+    Params const&                  params)
+{
+  namespace as  = sortbench::argsort;
+  using key_t   = typename Container::value_type;
+  using pair_t  = as::pair_t<key_t, I>;
+  using alloc_t = sortbench::default_init_allocator<key_t,
+      sortbench::page_allocator<key_t>>;
+
+  auto const n    = static_cast<size_t>(c.size());
+  auto* const data = c.data();
+  auto const pfor = [](size_t len, auto f) {
+    sortbench::parallel_for_static(len, f);
+  };
+
+  std::vector<pair_t, sortbench::default_init_allocator<pair_t,
+      sortbench::page_allocator<pair_t>>>
+      pairs(n);
+  as::extract<key_t, I>(data, pairs.data(), n, pfor);
+
+  // the backends use the arena if it can hold the pairs, i.e. for records
+  sort_keys(pairs, std::less<pair_t>(), arena, params);
+  auto const pair_bytes = sortbench::sort_traffic<pair_t>(n);
+
+  std::vector<key_t, alloc_t> buf(n);
+  as::gather<key_t, I>(data, pairs.data(), buf.data(), n, pfor);
+  as::copy(buf.data(), data, n, pfor);
+
+  return sortbench::traffic::argsort(
+      n, sizeof(key_t), sizeof(pair_t), pair_bytes);
+}
+
+//! Argsort of c with 32-bit indices if they suffice, returns the bytes moved
+template <class Container>
+double argsort_keys(
+    Container&                     c,
+    sortbench::ScratchArena const* arena,
+    Params const&                  params)
+{
+  return sortbench::argsort::index32(c.size())
+             ? argsort_keys_as<uint32_t>(c, arena, params)
+             : argsort_keys_as<uint64_t>(c, arena, params);
+}
+#endif
 
-void print_header(std::string const& app, double mb, int P)
+template <typename key_t>
+void print_header(
+    std::string const&         app,
+    double                     mb,
+    int                        P,
+    Params const&              params,
+    std::vector<size_t> const& node_pages,
+    std::string const&         key_pages)
 {
   std::cout << "+++++++++++++++++++++++++++++++++++++++++++++++++\n";
   std::cout << "++              Sort Bench                     ++\n";
   std::cout << "+++++++++++++++++++++++++++++++++++++++++++++++++\n";
   std::cout << std::setw(20) << "NTasks: " << P << "\n";
+  // process x thread decomposition
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  std::cout << std::setw(20) << "Ranks x Threads: " << P << " x "
+            << params.threads << (params.hybrid ? " (hybrid)" : "") << "\n";
+#else
+  std::cout << std::setw(20) << "Ranks x Threads: "
+            << "1 x " << P << "\n";
+#endif
   std::cout << std::setw(20) << "Size: " << std::fixed << std::setprecision(2)
             << mb << "\n";
+#if defined(USE_DASH)
+  // source of the Exchanged (MB) column
+  if (params.incremental > 0) {
+    std::cout << std::setw(20) << "Exchanged: "
+              << (params.comm ? "measured (--comm)"
+                              : "+resort lower bound (keys changing unit)")
+              << "\n";
+  }
+#endif
+  if (!params.scaling.empty()) {
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+    std::string const worker = "rank";
+#else
+    std::string const worker = "thread";
+#endif
+    std::cout << std::setw(20) << "Scaling: " << params.scaling
+              << " (baseline: 1 " << worker << ", "
+              << (params.scaling == "strong" ? "all keys"
+                                             : "keys per " + worker)
+              << ")\n";
+  }
 #if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
   std::cout << std::setw(20) << "Size per Unit (MB): " << std::fixed
-            << std::setprecision(2) << mb / P;
+            << std::setprecision(2) << mb / P << "\n";
 #endif
-  std::cout << "\n\n";
+  std::cout << std::setw(20) << "Type: " << sortbench::type_name<key_t>::get()
+            << " (" << sizeof(key_t) << " bytes)\n";
+  std::cout << std::setw(20) << "Seed: " << sortbench::rng_seed() << "\n";
+#ifdef SORTBENCH_PSS_CUTOFFS
+  auto const& cut = pss::cut_offs_for<key_t>();
+  std::cout << std::setw(20) << "Cut-offs: "
+            << "sort " << cut.sort << ", merge " << cut.merge << "\n";
+  // Record types and builds without SIMD_MERGE take the scalar merge
+  std::cout << std::setw(20) << "SIMD Merge: "
+            << (pss::internal::simd_merge_traits<key_t>::enabled
+                    ? pss::internal::simd_merge_isa()
+                    : "scalar")
+            << "\n";
+#endif
+  std::cout << std::setw(20) << "Placement: "
+            << sortbench::numa::to_string(params.placement) << "\n";
+  // Pages of the (local) keys per NUMA node, after generation
+  std::cout << std::setw(20) << "Pages per Node: ";
+  if (node_pages.empty()) {
+    std::cout << "n/a";
+  }
+  for (size_t node = 0; node < node_pages.size(); ++node) {
+    std::cout << (node ? ", " : "") << node << ":" << node_pages[node];
+  }
+  std::cout << "\n";
+  // Requested page size and the backing the (local) keys actually got
+  std::cout << std::setw(20) << "Pages: " << sortbench::to_string(params.pages)
+            << " (keys: " << key_pages << ")\n";
+  // STREAM bandwidth summed over all nodes
+  auto const& bw = params.bandwidth;
+  std::cout << std::setw(20) << "Nodes: " << bw.nnodes << "\n";
+  if (bw.triad > 0) {
+    std::cout << std::setw(20) << "Copy (GB/s): " << std::fixed
+              << std::setprecision(2) << bw.copy / GB << "\n";
+    std::cout << std::setw(20) << "Triad (GB/s): " << std::fixed
+              << std::setprecision(2) << bw.triad / GB << "\n";
+  }
+  else {
+    std::cout << std::setw(20) << "Triad (GB/s): "
+              << "n/a\n";
+  }
+  std::cout << std::setw(20) << "Iterations: ";
+  if (params.ci > 0) {
+    std::cout << params.min_iterations << " to " << params.iterations
+              << " until the 95% CI is within " << std::setprecision(1)
+              << 100 * params.ci << "%";
+  }
+  else {
+    std::cout << params.iterations;
+  }
+  std::cout << " (+" << params.burn_in << " burn-in)\n";
+  if (params.incremental > 0) {
+    std::cout << std::setw(20) << "Incremental: " << std::setprecision(2)
+              << 100 * params.incremental << "% of the keys change\n";
+  }
+  if (params.perf) {
+    // probe once, the sort counts with the same fallbacks
+    sortbench::perf::Counters probe;
+    auto const                available = probe.start();
+    probe.stop();
+    std::cout << std::setw(20) << "Perf Counters: "
+              << (!available ? "n/a"
+                             : probe.user_only() ? "user space" : "all")
+              << "\n";
+  }
+  std::cout << "\n";
   // Print the header
   std::cout << std::setw(4) << "#,";
   std::cout << std::setw(10) << "NTasks,";
   std::cout << std::setw(10) << "Size (MB),";
+  std::cout << std::setw(8) << "Type,";
+  std::cout << std::setw(10) << "Bytes/Rec,";
+  std::cout << std::setw(25) << "Dist,";
   std::cout << std::setw(20) << "Time,";
+  std::cout << std::setw(12) << "MKeys/s,";
+  std::cout << std::setw(12) << "Moved (MB),";
+  std::cout << std::setw(11) << "GB/s/Core,";
+  std::cout << std::setw(9) << "% Triad,";
+  if (!params.scaling.empty()) {
+    std::cout << std::setw(12) << "Efficiency,";
+  }
+  std::cout << std::setw(16) << "Path,";
+  std::cout << std::setw(15) << "Peak RSS (MB),";
+  if (params.pages != sortbench::Pages::base) {
+    std::cout << std::setw(15) << "Scratch Pages,";
+  }
+  if (params.incremental > 0) {
+    std::cout << std::setw(16) << "Exchanged (MB),";
+  }
+  if (params.comm) {
+    std::cout << std::setw(11) << "Sent (MB),";
+    std::cout << std::setw(10) << "Send Imb,";
+    std::cout << std::setw(10) << "Recv Imb,";
+  }
+  if (params.perf) {
+    std::cout << std::setw(10) << "GCycles,";
+    std::cout << std::setw(7) << "IPC,";
+    std::cout << std::setw(14) << "LLC Miss/Key,";
+    std::cout << std::setw(15) << "dTLB Miss/Key,";
+    std::cout << std::setw(13) << "Br Miss/Key,";
+  }
   std::cout << std::setw(20) << "Test Case";
   std::cout << "\n";
 }
 
-constexpr size_t max_samples = 250;
-auto             sample_units(size_t P)
+//! Per-phase block of one iteration, reduced across all ranks
+void print_phases(
+    size_t iter, std::vector<sortbench::PhaseStats> const& stats)
 {
-  // The DASH Trace does not really scale, so we select at most nSamples units
-  auto nSamples = std::min(P, max_samples);
+  std::ostringstream os;
+  os << std::setw(4) << "#,";
+  os << std::setw(10) << "Phase,";
+  os << std::setw(36) << "Name,";
+  os << std::setw(20) << "Min,";
+  os << std::setw(20) << "Max,";
+  os << std::setw(20) << "Mean";
+  os << "\n";
+  for (auto const& s : stats) {
+    os << std::setw(3) << iter << ",";
+    os << std::setw(9) << "phase" << ",";
+    os << std::setw(35) << s.name << ",";
+    os << std::setw(19) << std::fixed << std::setprecision(8) << s.min << ",";
+    os << std::setw(19) << s.max << ",";
+    os << std::setw(20) << s.mean;
+    os << "\n";
+  }
+  std::cout << os.str();
+}
 
-  std::vector<unsigned> trace_unit_samples(nSamples);
-  int                   id_stride = P / nSamples;
-  if (id_stride < 2) {
-    std::iota(
-        std::begin(trace_unit_samples), std::end(trace_unit_samples), 0);
+//! Distribution of the measured times of a test case, outliers are listed by
+//! iteration
+void print_summary(
+    sortbench::Summary const& s, size_t burn_in, std::string const& test_case)
+{
+  std::ostringstream os;
+  os << std::setw(4) << "#,";
+  os << std::setw(10) << "Summary,";
+  os << std::setw(7) << "Iters,";
+  os << std::setw(20) << "Median,";
+  os << std::setw(20) << "P5,";
+  os << std::setw(20) << "P95,";
+  os << std::setw(20) << "Mean,";
+  os << std::setw(20) << "Stddev,";
+  os << std::setw(8) << "CV (%),";
+  os << std::setw(10) << "CI95 (%),";
+  os << std::setw(20) << "Outliers,";
+  os << std::setw(20) << "Test Case";
+  os << "\n";
+  os << std::setw(4) << "-,";
+  os << std::setw(9) << "summary" << ",";
+  os << std::setw(6) << s.n << ",";
+  os << std::setw(19) << std::fixed << std::setprecision(8) << s.median
+     << ",";
+  os << std::setw(19) << s.p5 << ",";
+  os << std::setw(19) << s.p95 << ",";
+  os << std::setw(19) << s.mean << ",";
+  os << std::setw(19) << s.stddev << ",";
+  os << std::setw(7) << std::setprecision(2) << 100 * s.cv << ",";
+  if (std::isfinite(s.rel_ci)) {
+    os << std::setw(9) << 100 * s.rel_ci << ",";
   }
   else {
-    unsigned v_init{0};
-    std::generate(
-        std::begin(trace_unit_samples),
-        std::end(trace_unit_samples),
-        [&v_init, id_stride]() {
-          auto val = v_init;
-          v_init += id_stride;
-          return val;
-        });
+    os << std::setw(9) << "n/a" << ",";
   }
+  // iterations as numbered in the result rows, separated by spaces
+  std::string outliers;
+  for (auto const idx : s.outliers) {
+    outliers += (outliers.empty() ? "" : " ") + std::to_string(idx + burn_in);
+  }
+  os << std::setw(19) << (outliers.empty() ? "-" : outliers) << ",";
+  os << std::setw(20) << test_case;
+  os << "\n";
+  std::cout << os.str();
+}
 
-  return trace_unit_samples;
+#if defined(USE_DASH)
+//! Number of keys in both sorted ranges a[0, na) and b[0, nb), equal keys
+//! counted as often as they occur in both
+template <typename T, typename Cmp>
+size_t common_keys(T const* a, size_t na, T const* b, size_t nb, Cmp cmp)
+{
+  size_t common = 0;
+  size_t ia = 0, ib = 0;
+  while (ia < na && ib < nb) {
+    if (cmp(a[ia], b[ib])) {
+      ++ia;
+    }
+    else if (cmp(b[ib], a[ia])) {
+      ++ib;
+    }
+    else {
+      ++common;
+      ++ia;
+      ++ib;
+    }
+  }
+  return common;
 }
+#endif
 
-//! Test sort for n items
+//! Test sort for n items, returns the measured times of rank 0
 template <class Container>
-void Test(
-    Container& c, size_t N, int r, size_t P, std::string const& test_case)
+std::vector<double> Test(
+    Container&          c,
+    size_t              N,
+    int                 r,
+    size_t              P,
+    sortbench::Distribution<typename Container::value_type> const& dist,
+    std::string const&  test_case,
+    Params const&       params,
+    sortbench::ScratchArena const* arena = nullptr)
 {
   LOG("N :" << N);
 
@@ -114,32 +531,289 @@ void Test(
 
   auto const mb = N * sizeof(key_t) / MB;
 
-  auto trace_unit_samples = sample_units(P);
+  auto const phases = params.phases;
+#if defined(USE_MPI) || defined(USE_USORT)
+  // the libraries record no phases, the hybrid sort of mpi.x does
+  auto const mpi_phases = !params.hybrid;
+#else
+  auto const mpi_phases = false;
+#endif
+
+  // Bytes the sort moves through memory according to the model of the
+  // backend, scratch passes included
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  auto const moved = [N, P, &params]() {
+    if (params.op == "topk" || params.op == "nth") {
+      return P * sortbench::select::traffic<key_t>(N / P);
+    }
+#if defined(USE_DASH)
+    if (params.op == "incremental") {
+      return P * sortbench::resort_traffic<key_t>(N / P);
+    }
+#endif
+    return P * sortbench::sort_traffic<key_t>(N / P);
+  };
+#else
+  // argsort: the model of the last iteration, it depends on the pair sort
+  double     argsort_moved = 0;
+  auto const moved         = [N, &params, &argsort_moved]() {
+    if (params.op == "topk" || params.op == "nth") {
+      return sortbench::select::traffic<key_t>(N);
+    }
+    return params.argsort == "on" ? argsort_moved
+                                  : sortbench::sort_traffic<key_t>(N);
+  };
+#endif
+
+  // top-k, selection and the re-sort read the local keys in place
+#if defined(USE_DASH)
+  key_t const* const lkeys  = c.lbegin();
+  auto const         nlocal = static_cast<size_t>(c.lsize());
+#else
+  key_t const* const lkeys  = c.data();
+  auto const         nlocal = static_cast<size_t>(c.size());
+#endif
+  auto const pfor = [](size_t len, auto f) {
+    sortbench::parallel_for_static(len, f);
+  };
+  auto const k    = std::min(params.topk, N);
+  auto const rank = std::min(
+      N - 1, static_cast<size_t>(params.nth * static_cast<double>(N)));
+  // result of the last iteration
+  std::vector<key_t> topk;
+  key_t              nth{};
+
+#if defined(USE_DASH)
+  // re-sort: the keys are generated and sorted once, every iteration changes
+  // some of them (dirty) and sorts them again
+  auto const resort = params.op == "resort" || params.op == "incremental";
+  std::vector<key_t>  split;
+  std::vector<size_t> dirty;
+  if (resort) {
+    sortbench::parallel_rand(c.begin(), c.end(), dist.gen);
+    sort_keys(c, std::less<key_t>(), arena, params);
+    split = sortbench::splitters(c);
+  }
+  // local keys before the full re-sort, to count the keys changing units
+  std::vector<key_t> before;
+#endif
+
+  sortbench::perf::Counters counters;
+
+  // measured times of rank 0, which decides when to stop
+  std::vector<double> durations;
+  // time of the last iteration on this rank, the one the trace holds
+  double traced = 0;
 
-  for (size_t iter = 0; iter < NITER + BURN_IN; ++iter) {
+  for (size_t iter = 0;; ++iter) {
     sortbench::reset_trace();
 
-    sortbench::parallel_rand(c.begin(), c.end(), sortbench::normal<key_t>);
+#if defined(USE_DASH)
+    if (resort) {
+      dirty = sortbench::parallel_perturb(
+          c, dist.gen, params.incremental, iter);
+      if (params.op == "resort") {
+        before.assign(lkeys, lkeys + nlocal);
+      }
+    }
+    else
+#endif
+    {
+      sortbench::parallel_rand(c.begin(), c.end(), dist.gen);
+    }
+
+    sortbench::Fingerprint input_fp;
+    if (params.verify == sortbench::Verify::full) {
+      // collective
+      input_fp = sortbench::parallel_fingerprint(c.begin(), c.end());
+    }
+
+    sortbench::PhaseTimer::instance().clear();
+
+    // the peak then covers the keys and everything the sort allocates
+    sortbench::reset_peak_rss();
+
+    // large buffers the sort maps, i.e. whether it allocated scratch
+    auto const mappings = sortbench::page_mappings();
+
+    // all threads of the process count during the sort only
+    if (params.perf) counters.start();
+    if (params.comm) sortbench::comm::start();
+    // MP-sort and usort are split into local_sort and exchange by the time
+    // spent inside MPI calls
+    bool const split_mpi = phases && mpi_phases && params.op == "sort";
+    if (split_mpi) sortbench::comm::start_timer();
 
     auto const start = ChronoClockNow();
 
-    sortbench::parallel_sort(c, std::less<key_t>());
+    if (params.op == "topk") {
+      topk = sortbench::select::topk(
+          lkeys, nlocal, k, std::less<key_t>(), pfor);
+    }
+    else if (params.op == "nth") {
+      nth = sortbench::select::select(
+          lkeys, nlocal, rank, std::less<key_t>(), pfor);
+    }
+    else
+#if defined(USE_DASH)
+    if (params.op == "incremental") {
+      sortbench::parallel_resort(c, std::less<key_t>(), split, dirty);
+    }
+    else
+#endif
+#if !defined(USE_DASH) && !defined(USE_MPI) && !defined(USE_USORT)
+    if (params.argsort == "on") {
+      argsort_moved = argsort_keys(c, arena, params);
+    }
+    else
+#endif
+    {
+      sort_keys(c, std::less<key_t>(), arena, params);
+    }
 
     auto const duration = ChronoClockNow() - start;
+    traced              = duration;
 
-    auto const ret =
-        sortbench::parallel_verify(c.begin(), c.end(), std::less<key_t>());
+    if (params.comm) sortbench::comm::stop();
+    auto const mpi_time = split_mpi ? sortbench::comm::stop_timer() : 0.0;
 
-    if (!ret) {
-      std::cerr << "validation failed! (n = " << N << ")\n";
+    sortbench::perf::Counts counts;
+    if (params.perf) {
+      counts = counters.stop();
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+      // collective, summed over all ranks
+      counts = sortbench::perf::allreduce(counts);
+#endif
     }
 
-    // c.begin().pattern().team().barrier();
-    if (iter == (NITER + BURN_IN - 1)) {
-      sortbench::flush_trace(trace_unit_samples, r);
+    std::string path = sortbench::sort_path();
+    if (params.op == "topk") {
+      path = "topk";
+    }
+    else if (params.op == "nth") {
+      path = "select";
+    }
+    // backing of the scratch buffer, "-" if the sort mapped none
+    std::string scratch_pages = "-";
+    if (arena) {
+      scratch_pages = sortbench::to_string(arena->backing());
     }
+    else if (sortbench::page_mappings() != mappings) {
+      scratch_pages = sortbench::to_string(sortbench::last_page_backing());
+    }
+    // bytes sent to other units summed over all units. With --comm both
+    // rows report the measured bytes instead (below). Otherwise the full
+    // re-sort counts the keys which changed their unit, a lower bound of
+    // what dash::sort sends.
+    unsigned long long exchanged = 0;
+#if defined(USE_DASH)
+    if (params.op == "incremental") {
+      exchanged = sortbench::incremental::last_exchanged();
+    }
+    else if (params.op == "resort" && !params.comm) {
+      std::sort(before.begin(), before.end(), std::less<key_t>());
+      exchanged = (nlocal - common_keys(before.data(),
+                                        before.size(),
+                                        lkeys,
+                                        nlocal,
+                                        std::less<key_t>())) *
+                  sizeof(key_t);
+    }
+    if (params.incremental > 0) {
+      // collective
+      MPI_Allreduce(
+          MPI_IN_PLACE,
+          &exchanged,
+          1,
+          MPI_UNSIGNED_LONG_LONG,
+          MPI_SUM,
+          MPI_COMM_WORLD);
+    }
+#endif
+    // bytes the ranks sent each other during the sort, on rank 0
+    std::vector<unsigned long long> comm_matrix;
+    if (params.comm) {
+      // collective
+      comm_matrix = sortbench::comm::gather_matrix();
+    }
+    // maximum over all ranks
+    unsigned long long rss = sortbench::peak_rss();
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+    MPI_Allreduce(
+        MPI_IN_PLACE, &rss, 1, MPI_UNSIGNED_LONG_LONG, MPI_MAX, MPI_COMM_WORLD);
+#endif
+
+    std::vector<sortbench::PhaseStats> phase_stats;
+    if (phases) {
+      sortbench::trace_phases(duration);
+      auto& timer = sortbench::PhaseTimer::instance();
+      if (timer.phases().empty() && split_mpi) {
+        timer.add("local_sort", std::max(0.0, duration - mpi_time));
+        timer.add("exchange", mpi_time);
+      }
+      else if (timer.phases().empty()) {
+        timer.add("sort", duration);
+      }
+      // collective
+      phase_stats = sortbench::reduce_phases();
+    }
+
+    if (params.verify != sortbench::Verify::none &&
+        (params.op == "topk" || params.op == "nth")) {
+      // collective for the distributed backends: the global ranks of the
+      // result, i.e. whether the k-th smallest key and the keys below it are
+      // in the top-k and whether rank falls onto the selected key
+      auto const less = std::less<key_t>();
+      bool       ret  = true;
+      if (params.op == "topk") {
+        ret = topk.size() == k && std::is_sorted(topk.begin(), topk.end());
+        if (k > 0) {
+          auto const t  = topk.back();
+          auto const lt = sortbench::select::rank_of(
+              lkeys, nlocal, t, less, pfor);
+          auto const below = static_cast<size_t>(std::count_if(
+              topk.begin(), topk.end(), [&](key_t const& x) {
+                return less(x, t);
+              }));
+          ret = ret && lt.first < k && k <= lt.second && below == lt.first;
+        }
+      }
+      else {
+        auto const lt =
+            sortbench::select::rank_of(lkeys, nlocal, nth, less, pfor);
+        ret = lt.first <= rank && rank < lt.second;
+      }
 
-    if (iter >= BURN_IN && r == 0) {
+      if (!ret && r == 0) {
+        std::cerr << "validation failed! (n = " << N << ", " << params.op
+                  << ")\n";
+      }
+    }
+    else if (params.verify != sortbench::Verify::none) {
+      // collective for the distributed backends
+      auto const ret = sortbench::parallel_verify(
+          c.begin(), c.end(), std::less<key_t>());
+
+      if (!ret && r == 0) {
+        std::cerr << "validation failed! (n = " << N << ")\n";
+      }
+    }
+
+    if (params.verify == sortbench::Verify::full) {
+      auto const output_fp =
+          sortbench::parallel_fingerprint(c.begin(), c.end());
+
+      if (output_fp != input_fp && r == 0) {
+        std::cerr << "validation failed, keys lost or duplicated! (n = "
+                  << N << ", keys after sort: " << output_fp.count << ")\n";
+      }
+    }
+
+    if (iter >= params.burn_in) {
+      durations.push_back(duration);
+    }
+
+    if (iter >= params.burn_in && r == 0) {
       std::ostringstream os;
       // Iteration
       os << std::setw(3) << iter << ",";
@@ -148,106 +822,1391 @@ void Test(
       // Size
       os << std::setw(9) << std::fixed << std::setprecision(2) << mb;
       os << ",";
+      // Type
+      os << std::setw(7) << sortbench::type_name<key_t>::get() << ",";
+      // Bytes per record
+      os << std::setw(9) << sizeof(key_t) << ",";
+      // Distribution
+      os << std::setw(24) << dist.name << ",";
       // Time (s)
       os << std::setw(19) << std::fixed << std::setprecision(8);
       os << duration << ",";
+      // Throughput and bandwidth relative to STREAM triad
+      auto const bytes = moved();
+      auto const bps   = bytes / duration;
+      auto const triad = params.bandwidth.triad;
+      os << std::setw(11) << std::setprecision(2) << N / duration / 1e6;
+      os << ",";
+      os << std::setw(11) << bytes / MB << ",";
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+      // cores: the threads of each rank
+      auto const cores = static_cast<double>(P) * params.threads;
+#else
+      auto const cores = static_cast<double>(P);
+#endif
+      os << std::setw(10) << std::setprecision(3) << bps / GB / cores << ",";
+      os << std::setw(8) << std::setprecision(1)
+         << (triad > 0 ? 100 * bps / triad : 0.0) << ",";
+      // Parallel efficiency against the baseline of a single thread or rank
+      if (!params.scaling.empty()) {
+        if (params.op == "sort" && params.argsort != "on" &&
+            params.baseline > 0) {
+          auto const workers = params.scaling == "strong" ? P : 1;
+          os << std::setw(11) << std::setprecision(3)
+             << params.baseline / (workers * duration) << ",";
+        }
+        else {
+          os << std::setw(11) << "-" << ",";
+        }
+      }
+      // Path taken by the sort, e.g. a serial fallback
+      os << std::setw(15) << path << ",";
+      // Peak RSS of the sort (max over ranks)
+      os << std::setw(14) << std::setprecision(2)
+         << static_cast<double>(rss) / MB << ",";
+      if (params.pages != sortbench::Pages::base) {
+        // rank 0, the backing is the same on all ranks unless a pool runs dry
+        os << std::setw(14) << scratch_pages << ",";
+      }
+      if (params.incremental > 0) {
+        if (params.op == "resort" || params.op == "incremental") {
+          // measured without copies to self, as the models count
+          auto const bytes =
+              params.comm ? sortbench::comm::volume(comm_matrix, P).total
+                          : exchanged;
+          os << std::setw(15) << std::setprecision(2)
+             << static_cast<double>(bytes) / MB << ",";
+        }
+        else {
+          os << std::setw(15) << "-" << ",";
+        }
+      }
+      if (params.comm) {
+        // without copies to self, imbalance as max / mean over the ranks
+        auto const v = sortbench::comm::volume(comm_matrix, P);
+        os << std::setw(10) << std::setprecision(2)
+           << static_cast<double>(v.total) / MB << ",";
+        if (v.total > 0) {
+          os << std::setw(9) << v.send_imbalance << ",";
+          os << std::setw(9) << v.recv_imbalance << ",";
+        }
+        else {
+          os << std::setw(9) << "n/a" << ",";
+          os << std::setw(9) << "n/a" << ",";
+        }
+        std::ofstream csv(params.comm_csv, std::ios::app);
+        sortbench::comm::write_csv(
+            csv,
+            comm_matrix,
+            P,
+            test_case,
+            sortbench::type_name<key_t>::get(),
+            dist.name,
+            iter);
+      }
+      if (params.perf) {
+        // hardware counters summed over all threads and ranks
+        namespace perf = sortbench::perf;
+        auto const per_key = [&](perf::Event e, int width) {
+          if (counts.valid[e]) {
+            os << std::setw(width) << std::setprecision(3)
+               << counts.value[e] / N << ",";
+          }
+          else {
+            os << std::setw(width) << "n/a" << ",";
+          }
+        };
+        if (counts.valid[perf::cycles]) {
+          os << std::setw(9) << std::setprecision(2)
+             << counts.value[perf::cycles] / 1e9 << ",";
+        }
+        else {
+          os << std::setw(9) << "n/a" << ",";
+        }
+        if (counts.valid[perf::cycles] && counts.valid[perf::instructions] &&
+            counts.value[perf::cycles] > 0) {
+          os << std::setw(6) << std::setprecision(2)
+             << counts.value[perf::instructions] /
+                    counts.value[perf::cycles]
+             << ",";
+        }
+        else {
+          os << std::setw(6) << "n/a" << ",";
+        }
+        per_key(perf::llc_misses, 13);
+        per_key(perf::dtlb_misses, 14);
+        per_key(perf::branch_misses, 12);
+      }
       // Test Case
       os << std::setw(20) << test_case;
       os << "\n";
       std::cout << os.str();
+
+      if (phases) {
+        print_phases(iter, phase_stats);
+      }
+    }
+
+    int done = durations.size() >= params.iterations;
+    if (!done && params.ci > 0 && durations.size() >= params.min_iterations) {
+      done = sortbench::summarize(durations).rel_ci <= params.ci;
+    }
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+    // the times differ across ranks, all follow the decision of rank 0
+    MPI_Bcast(&done, 1, MPI_INT, 0, MPI_COMM_WORLD);
+#endif
+    if (done) break;
+  }
+
+  // c.begin().pattern().team().barrier();
+  // the trace holds the last iteration
+  sortbench::flush_trace(
+      params.trace,
+      r,
+      static_cast<int>(P),
+      traced,
+      test_case,
+      sortbench::type_name<key_t>::get(),
+      dist.name);
+
+  if (r == 0) {
+    print_summary(sortbench::summarize(durations), params.burn_in, test_case);
+  }
+
+  return durations;
+}
+
+//! Measured times of a test case
+struct CaseTimes {
+  std::string         test_case;
+  bool                argsort;
+  std::vector<double> times;
+  // sort, topk or nth
+  std::string op = "sort";
+};
+
+//! Runs the test cases of one distribution: fresh and / or arena scratch
+//! (--scratch), sorting the records and / or argsort (--argsort), then top-k
+//! (--topk) and selection (--nth) on the same keys, and the full and
+//! incremental re-sort of changed keys (--incremental)
+template <class Container>
+std::vector<CaseTimes> TestCases(
+    Container&                     c,
+    size_t                         N,
+    int                            r,
+    size_t                         P,
+    sortbench::Distribution<typename Container::value_type> const& dist,
+    std::string const&             app,
+    Params const&                  params,
+    sortbench::ScratchArena const* arena)
+{
+  std::vector<CaseTimes> cases;
+  for (bool const argsort : {false, true}) {
+    if (params.argsort == (argsort ? "off" : "on")) continue;
+
+    auto p         = params;
+    p.argsort      = argsort ? "on" : "off";
+    auto const tc  = app + (argsort ? "+argsort" : "");
+
+    if (params.scratch != "reuse") {
+      cases.push_back({tc, argsort, Test(c, N, r, P, dist, tc, p)});
+    }
+    if (params.scratch != "fresh") {
+      cases.push_back({tc + "+arena",
+                       argsort,
+                       Test(c, N, r, P, dist, tc + "+arena", p, arena)});
+    }
+  }
+  for (std::string const op : {"topk", "nth"}) {
+    if (op == "topk" ? params.topk == 0 : params.nth < 0) continue;
+
+    // neither allocates scratch
+    auto p        = params;
+    p.argsort     = "off";
+    p.op          = op;
+    auto const tc = app + "+" + op;
+    cases.push_back({tc, false, Test(c, N, r, P, dist, tc, p), op});
+  }
+  for (std::string const op : {"resort", "incremental"}) {
+    if (params.incremental <= 0) continue;
+
+    auto p        = params;
+    p.argsort     = "off";
+    p.op          = op;
+    auto const tc = app + "+" + op;
+    cases.push_back({tc, false, Test(c, N, r, P, dist, tc, p), op});
+  }
+  return cases;
+}
+
+//! Median times of sorting the records and of argsort for one type and
+//! distribution, see --argsort=both
+struct ArgsortPoint {
+  std::string type;
+  size_t      bytes;
+  std::string dist;
+  double      direct;
+  double      argsort;
+};
+
+//! Adds the first direct and argsort test case of cases to points
+template <typename key_t>
+void add_argsort_point(
+    std::vector<CaseTimes> const& cases,
+    std::string const&            dist,
+    std::vector<ArgsortPoint>&    points)
+{
+  auto const median = [&](bool argsort) {
+    for (auto const& tc : cases) {
+      if (tc.op == "sort" && tc.argsort == argsort) {
+        return sortbench::summarize(tc.times).median;
+      }
+    }
+    return 0.0;
+  };
+  points.push_back({sortbench::type_name<key_t>::get(),
+                    sizeof(key_t),
+                    dist,
+                    median(false),
+                    median(true)});
+}
+
+//! Direct sort against argsort per record width and the width from which on
+//! argsort is faster, per distribution
+void print_argsort_crossover(std::vector<ArgsortPoint> points)
+{
+  std::stable_sort(
+      points.begin(), points.end(), [](auto const& a, auto const& b) {
+        return a.bytes < b.bytes;
+      });
+
+  std::ostringstream os;
+  os << "Argsort Crossover\n";
+  os << std::setw(8) << "Type,";
+  os << std::setw(10) << "Bytes/Rec,";
+  os << std::setw(25) << "Dist,";
+  os << std::setw(20) << "Direct,";
+  os << std::setw(20) << "Argsort,";
+  os << std::setw(10) << "Speedup";
+  os << "\n";
+  for (auto const& p : points) {
+    os << std::setw(7) << p.type << ",";
+    os << std::setw(9) << p.bytes << ",";
+    os << std::setw(24) << p.dist << ",";
+    os << std::setw(19) << std::fixed << std::setprecision(8) << p.direct
+       << ",";
+    os << std::setw(19) << p.argsort << ",";
+    os << std::setw(10) << std::setprecision(2)
+       << (p.argsort > 0 ? p.direct / p.argsort : 0.0);
+    os << "\n";
+  }
+
+  std::vector<std::string> dists;
+  for (auto const& p : points) {
+    if (std::find(dists.begin(), dists.end(), p.dist) == dists.end()) {
+      dists.push_back(p.dist);
+    }
+  }
+  for (auto const& dist : dists) {
+    // smallest width from which on argsort wins for all measured widths
+    size_t crossover = 0;
+    for (auto const& p : points) {
+      if (p.dist != dist) continue;
+      if (p.argsort < p.direct) {
+        if (!crossover) crossover = p.bytes;
+      }
+      else {
+        crossover = 0;
+      }
+    }
+    os << "Crossover (" << dist << "): ";
+    if (crossover) {
+      os << crossover << " bytes/record\n";
+    }
+    else {
+      os << "not reached\n";
+    }
+  }
+  std::cout << os.str();
+}
+
+//! Best time of a single thread (rank) sorting the keys of dist after the
+//! burn-in: all N keys for strong scaling, N / P keys for weak scaling.
+//! Measured on rank 0 while the other ranks wait, i.e. rank 0 needs memory
+//! for all keys with --scaling=strong.
+template <typename key_t>
+double Baseline(
+    Params const&                         params,
+    size_t                                N,
+    size_t                                P,
+    int                                   r,
+    sortbench::Distribution<key_t> const& dist)
+{
+  // best of a few, the baseline is slow
+  size_t const runs = 3;
+
+  double best = 0;
+  if (r == 0) {
+    auto const         n = params.scaling == "strong" ? N : N / P;
+    std::vector<key_t> keys(n);
+    key_t* const       first = keys.data();
+
+    best = std::numeric_limits<double>::max();
+    for (size_t iter = 0; iter < params.burn_in + runs; ++iter) {
+      sortbench::parallel_for_static(n, [=](size_t lo, size_t hi) {
+        for (size_t idx = lo; idx < hi; ++idx) {
+          first[idx] = dist.gen(n, idx);
+        }
+      });
+      auto const start = ChronoClockNow();
+      sortbench::baseline_sort(keys, std::less<key_t>());
+      auto const duration = ChronoClockNow() - start;
+      if (iter >= params.burn_in) {
+        best = std::min(best, duration);
+      }
+    }
+  }
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  return best;
+}
+
+//! Allocate, place and generate the keys and run all test cases for key_t
+template <typename key_t>
+void Bench(
+    Params                     params,
+    size_t                     mysize,
+    size_t                     P,
+    int                        r,
+    std::string const&         base_filename,
+    std::vector<ArgsortPoint>& argsort_points)
+{
+  // Number of local elements
+  auto const nl = mysize / sizeof(key_t);
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  auto const gsize_bytes = mysize * P;
+  auto const N           = nl * P;
+#else
+  auto const gsize_bytes = mysize;
+  auto const N           = nl;
+#endif
+
+  double mb = (gsize_bytes / MB);
+
+#if defined(USE_DASH)
+  dash::Array<key_t> keys(N);
+#elif defined(USE_MPI)
+  std::vector<key_t, sortbench::page_allocator<key_t>> keys(nl);
+#elif defined(USE_USORT)
+  std::vector<key_t> keys(nl);
+#else
+  // leave the pages untouched until placement and generation
+  std::vector<
+      key_t,
+      sortbench::default_init_allocator<key_t, sortbench::page_allocator<key_t>>>
+      keys(nl);
+#endif
+
+  // backing of the key array, i.e. whether it was mapped with huge pages
+  std::string key_pages = "n/a";
+#if !defined(USE_DASH) && !defined(USE_USORT)
+  key_pages = sortbench::to_string(
+      sortbench::page_mapped(nl * sizeof(key_t))
+          ? sortbench::last_page_backing()
+          : sortbench::Pages::base);
+#endif
+
+  sortbench::parallel_place(keys.begin(), keys.end(), params.placement);
+  // first touch by the generator threads
+  sortbench::parallel_rand(keys.begin(), keys.end(), sortbench::normal<key_t>);
+
+#if defined(USE_DASH)
+  auto const node_pages = sortbench::numa::page_distribution(
+      keys.lbegin(), keys.lsize() * sizeof(key_t));
+#else
+  auto const node_pages =
+      sortbench::numa::page_distribution(keys.data(), nl * sizeof(key_t));
+  if (params.pages != sortbench::Pages::base) {
+    // transparent huge pages are only known after the first touch
+    std::ostringstream os;
+    os << key_pages << ", " << std::fixed << std::setprecision(2)
+       << static_cast<double>(
+              sortbench::huge_page_bytes(keys.data(), nl * sizeof(key_t))) /
+              MB
+       << " of " << static_cast<double>(nl * sizeof(key_t)) / MB
+       << " MB huge";
+    key_pages = os.str();
+  }
+#endif
+
+  if (r == 0) {
+#if defined(USE_DASH)
+    dash::util::BenchmarkParams bench_params("bench.dash.sort");
+    bench_params.set_output_width(72);
+    bench_params.print_header();
+    if (dash::size() < 200) {
+      bench_params.print_pinning();
+    }
+#endif
+    print_header<key_t>(base_filename, mb, P, params, node_pages, key_pages);
+  }
+
+  std::unique_ptr<sortbench::ScratchArena const> arena;
+  if (params.scratch != "fresh") {
+    arena.reset(new sortbench::ScratchArena(N * sizeof(key_t)));
+  }
+
+  for (auto const& name : params.dists) {
+    sortbench::Distribution<key_t> const dist{
+        name.c_str(), sortbench::find_distribution<key_t>(name)};
+
+    if (!params.scaling.empty()) {
+      params.baseline = Baseline(params, N, P, r, dist);
+    }
+
+    auto const cases =
+        TestCases(keys, N, r, P, dist, base_filename, params, arena.get());
+    if (params.argsort == "both") {
+      add_argsort_point<key_t>(cases, name, argsort_points);
+    }
+  }
+
+  if (r == 0) {
+    std::cout << "\n";
+  }
+}
+
+#ifdef SORTBENCH_PSS_CUTOFFS
+//! Sets the cut-offs of all key types to the entries calibrated for this
+//! backend and thread count, the defaults for the types without one
+void apply_cutoffs(
+    Params const& params, std::string const& app, size_t threads)
+{
+  std::vector<sortbench::CutoffEntry> entries;
+  if (params.cutoffs != "none") {
+    entries = sortbench::load_cutoffs(params.cutoffs);
+  }
+  for (auto const& name : params.types) {
+    sortbench::for_type(name, sortbench::key_types{}, [&](auto tag) {
+      using key_t = typename decltype(tag)::type;
+      auto& cut   = pss::cut_offs_for<key_t>();
+      cut         = pss::cut_offs{pss::cut_off_traits<key_t>::sort,
+                          pss::cut_off_traits<key_t>::merge};
+      if (auto const* e =
+              sortbench::find_cutoffs(entries, app, name, threads)) {
+        cut = pss::cut_offs{std::max<size_t>(1, e->sort_cut_off),
+                            std::max<size_t>(1, e->merge_cut_off)};
+      }
+    });
+  }
+}
+#endif
+
+#if !defined(USE_DASH) && !defined(USE_MPI) && !defined(USE_USORT)
+
+//! Prefix of the key array of a sweep, sorted in place like the vector of
+//! a single size
+template <typename T>
+struct KeyView {
+  using value_type = T;
+
+  T*     ptr;
+  size_t n;
+
+  T* data() const
+  {
+    return ptr;
+  }
+
+  size_t size() const
+  {
+    return n;
+  }
+
+  T* begin() const
+  {
+    return ptr;
+  }
+
+  T* end() const
+  {
+    return ptr + n;
+  }
+};
+
+//! Sizes of a sweep from min_bytes growing by factor, max_bytes included
+std::vector<size_t> sweep_sizes(
+    size_t min_bytes, size_t max_bytes, double factor)
+{
+  std::vector<size_t> sizes;
+  for (double bytes = static_cast<double>(min_bytes);
+       bytes < static_cast<double>(max_bytes);
+       bytes *= factor) {
+    sizes.push_back(static_cast<size_t>(bytes));
+  }
+  sizes.push_back(max_bytes);
+  return sizes;
+}
+
+//! Header of the sweep CSV, the schema of benchmarks/summary/shared-memory
+void print_sweep_header(std::ostream& csv)
+{
+  csv << std::setw(7) << "Iter,";
+  csv << std::setw(10) << "NTasks,";
+  csv << "Size,";
+  csv << std::setw(20) << "Time,";
+  csv << "\t\tTest Case\n";
+}
+
+//! Runs every size of the sweep for every thread count in this process. The
+//! keys of the largest size are allocated, placed and faulted once, smaller
+//! sizes sort a prefix. set_threads(P) resizes the thread pool between the
+//! thread counts. Appends the measured times to csv.
+template <typename key_t, typename SetThreads>
+void Sweep(
+    Params             params,
+    size_t             max_bytes,
+    SetThreads const&  set_threads,
+    std::string const& app,
+    std::ostream&      csv)
+{
+  auto const nmax = max_bytes / sizeof(key_t);
+
+  set_threads(params.sweep_threads.front());
+
+  std::vector<
+      key_t,
+      sortbench::default_init_allocator<key_t, sortbench::page_allocator<key_t>>>
+      keys(nmax);
+
+  auto const key_pages = sortbench::to_string(
+      sortbench::page_mapped(nmax * sizeof(key_t))
+          ? sortbench::last_page_backing()
+          : sortbench::Pages::base);
+
+  sortbench::parallel_place(keys.begin(), keys.end(), params.placement);
+  sortbench::parallel_rand(keys.begin(), keys.end(), sortbench::normal<key_t>);
+
+  std::unique_ptr<sortbench::ScratchArena const> arena;
+  if (params.scratch != "fresh") {
+    arena.reset(new sortbench::ScratchArena(nmax * sizeof(key_t)));
+  }
+
+  auto const sizes =
+      sweep_sizes(params.sweep, max_bytes, params.sweep_factor);
+
+  for (auto const P : params.sweep_threads) {
+    set_threads(P);
+    params.threads                    = P;
+    sortbench::dist_params().nblocks = static_cast<size_t>(P);
+    if (params.placement == sortbench::numa::Placement::bind) {
+      sortbench::pin_threads();
+    }
+#ifdef SORTBENCH_PSS_CUTOFFS
+    apply_cutoffs(params, app, static_cast<size_t>(P));
+#endif
+    if (params.stream_mb > 0) {
+      // % Triad relates to the bandwidth of this thread count
+      params.bandwidth = sortbench::stream_probe(
+          params.stream_mb * MB, [](size_t n, auto f) {
+            sortbench::parallel_for_static(n, f);
+          });
+    }
+
+    for (auto const bytes : sizes) {
+      auto const n  = bytes / sizeof(key_t);
+      auto const mb = n * sizeof(key_t) / MB;
+
+      KeyView<key_t> view{keys.data(), n};
+
+      auto const node_pages =
+          sortbench::numa::page_distribution(keys.data(), n * sizeof(key_t));
+      print_header<key_t>(app, mb, P, params, node_pages, key_pages);
+
+      for (auto const& name : params.dists) {
+        sortbench::Distribution<key_t> const dist{
+            name.c_str(), sortbench::find_distribution<key_t>(name)};
+
+        // test cases only name the type and distribution if they vary
+        std::string test_case = app;
+        if (params.types.size() > 1) {
+          test_case += std::string("+") + sortbench::type_name<key_t>::get();
+        }
+        if (params.dists.size() > 1) {
+          test_case += "+" + name;
+        }
+
+        auto const cases = TestCases(
+            view,
+            n,
+            0,
+            static_cast<size_t>(P),
+            dist,
+            test_case,
+            params,
+            arena.get());
+        for (auto const& tc : cases) {
+          for (size_t idx = 0; idx < tc.times.size(); ++idx) {
+            csv << std::setw(3) << idx + params.burn_in << ",";
+            csv << std::setw(9) << P << ",";
+            csv << std::setw(9) << mb << ",";
+            csv << std::setw(20) << std::fixed << std::setprecision(8)
+                << tc.times[idx] << ",";
+            csv << "\t\t" << tc.test_case << "\n";
+          }
+        }
+        csv << std::flush;
+      }
+      std::cout << "\n";
+    }
+  }
+}
+
+#endif
+
+//! External sort of the file params.external in runs of run_bytes, prints
+//! the throughput of the read, sort, merge and write phases. Throws
+//! std::system_error on I/O errors.
+template <typename key_t>
+void External(
+    Params const& params, size_t run_bytes, size_t P, std::string const& app)
+{
+  namespace ext = sortbench::external;
+
+  // run buffers of the merge readers and writers
+  constexpr size_t block_bytes = 1 << 20;
+
+  auto const run_elems   = std::max<size_t>(1, run_bytes / sizeof(key_t));
+  auto const block_elems = std::max<size_t>(1, block_bytes / sizeof(key_t));
+
+  // runs are sorted with the in-memory kernel of the backend
+  auto const st = ext::external_sort<key_t>(
+      params.external,
+      params.output,
+      run_elems,
+      P,
+      block_elems,
+      [&](std::vector<key_t, sortbench::default_init_allocator<key_t>>& c) {
+        sort_keys(c, std::less<key_t>(), nullptr, params);
+      },
+      std::less<key_t>());
+
+  auto const gb = static_cast<double>(st.bytes) / GB;
+
+  std::cout << "+++++++++++++++++++++++++++++++++++++++++++++++++\n";
+  std::cout << "++              Sort Bench (external)          ++\n";
+  std::cout << "+++++++++++++++++++++++++++++++++++++++++++++++++\n";
+  std::cout << std::setw(20) << "NTasks: " << P << "\n";
+  std::cout << std::setw(20) << "Input: " << params.external << "\n";
+  std::cout << std::setw(20) << "Output: " << params.output << "\n";
+  std::cout << std::setw(20) << "Size: " << std::fixed << std::setprecision(2)
+            << static_cast<double>(st.bytes) / MB << "\n";
+  std::cout << std::setw(20) << "Run Size (MB): " << std::fixed
+            << std::setprecision(2)
+            << static_cast<double>(run_elems * sizeof(key_t)) / MB << "\n";
+  std::cout << std::setw(20) << "Runs: " << st.nruns << "\n";
+  std::cout << std::setw(20) << "Type: " << sortbench::type_name<key_t>::get()
+            << " (" << sizeof(key_t) << " bytes)\n";
+  std::cout << "\n";
+
+  // I/O phases overlap with sort and merge, their time is the time spent in
+  // I/O calls (summed over the merge threads)
+  struct phase_t {
+    char const* name;
+    double      seconds;
+    double      bytes;
+  };
+  phase_t const rows[] = {
+      {"read", st.run_read, gb},
+      {"sort", st.run_sort, gb},
+      {"write runs", st.run_write, gb},
+      {"runs (total)", st.runs, gb},
+      {"merge read", st.merge_read, gb},
+      {"merge write", st.merge_write, gb},
+      {"merge (total)", st.merge, gb},
+      {"total", st.runs + st.merge, gb},
+  };
+
+  std::cout << std::setw(16) << "Phase,";
+  std::cout << std::setw(20) << "Time,";
+  std::cout << std::setw(12) << "GB/s,";
+  std::cout << std::setw(20) << "Test Case";
+  std::cout << "\n";
+  for (auto const& row : rows) {
+    std::ostringstream os;
+    os << std::setw(15) << row.name << ",";
+    os << std::setw(19) << std::fixed << std::setprecision(8) << row.seconds
+       << ",";
+    os << std::setw(11) << std::setprecision(3)
+       << (row.seconds > 0 ? row.bytes / row.seconds : 0.0) << ",";
+    os << std::setw(20) << app;
+    os << "\n";
+    std::cout << os.str();
+  }
+
+  if (params.verify != sortbench::Verify::none) {
+    sortbench::Fingerprint input_fp, output_fp;
+    auto const nerror = ext::verify_file<key_t>(
+        params.output, block_elems, std::less<key_t>(), output_fp);
+    if (nerror) {
+      std::cerr << "validation failed! (n = " << output_fp.count << ")\n";
+    }
+    if (params.verify == sortbench::Verify::full) {
+      // the order check of the input is meaningless, only its fingerprint
+      ext::verify_file<key_t>(
+          params.external,
+          block_elems,
+          [](key_t const&, key_t const&) { return false; },
+          input_fp);
+      if (output_fp != input_fp) {
+        std::cerr << "validation failed, keys lost or duplicated! (n = "
+                  << input_fp.count << ", keys after sort: " << output_fp.count
+                  << ")\n";
+      }
     }
   }
+
+  std::cout << "\n";
 }
 
+#ifdef SORTBENCH_PSS_CUTOFFS
+// Candidates of the cut-off calibration
+static constexpr size_t sort_cut_offs[] = {
+    64, 128, 256, 500, 1024, 2048, 4096, 8192, 16384};
+static constexpr size_t merge_cut_offs[] = {
+    500, 1000, 2000, 4000, 8000, 16000, 32000, 65536, 131072};
+// Sorts per candidate, the minimum time counts
+static constexpr size_t CALIBRATION_RUNS = 3;
+
+//! Sweeps the PSS cut-offs for key_t at the thread count of the run on
+//! nbytes of normal distributed keys: first the sort cut-off with the
+//! default merge cut-off, then the merge cut-off with the best sort cut-off.
+//! Leaves the best values in pss::cut_offs_for<key_t>().
+template <typename key_t>
+sortbench::CutoffEntry Calibrate(
+    Params const& params, size_t nbytes, size_t P, std::string const& app)
+{
+  auto const nl = nbytes / sizeof(key_t);
+
+  std::vector<key_t, sortbench::default_init_allocator<key_t>> keys(nl);
+
+  auto& cut = pss::cut_offs_for<key_t>();
+  cut.sort  = pss::cut_off_traits<key_t>::sort;
+  cut.merge = pss::cut_off_traits<key_t>::merge;
+
+  auto const measure = [&]() {
+    double best = std::numeric_limits<double>::max();
+    for (size_t run = 0; run < CALIBRATION_RUNS; ++run) {
+      sortbench::parallel_rand(
+          keys.begin(), keys.end(), sortbench::normal<key_t>);
+      auto const start = ChronoClockNow();
+      sort_keys(keys, std::less<key_t>(), nullptr, params);
+      best = std::min(best, ChronoClockNow() - start);
+    }
+    std::ostringstream os;
+    os << std::setw(7) << sortbench::type_name<key_t>::get() << ",";
+    os << std::setw(9) << P << ",";
+    os << std::setw(10) << cut.sort << ",";
+    os << std::setw(10) << cut.merge << ",";
+    os << std::setw(19) << std::fixed << std::setprecision(8) << best << ",";
+    os << std::setw(20) << app;
+    os << "\n";
+    std::cout << os.str();
+    return best;
+  };
+
+  // coordinate descent, one parameter at a time
+  double best      = std::numeric_limits<double>::max();
+  size_t best_sort = cut.sort;
+  for (auto const c : sort_cut_offs) {
+    cut.sort       = c;
+    auto const sec = measure();
+    if (sec < best) {
+      best      = sec;
+      best_sort = c;
+    }
+  }
+  cut.sort = best_sort;
+
+  best              = std::numeric_limits<double>::max();
+  size_t best_merge = cut.merge;
+  for (auto const c : merge_cut_offs) {
+    cut.merge      = c;
+    auto const sec = measure();
+    if (sec < best) {
+      best       = sec;
+      best_merge = c;
+    }
+  }
+  cut.merge = best_merge;
+
+  return sortbench::CutoffEntry{
+      app, sortbench::type_name<key_t>::get(), P, cut.sort, cut.merge};
+}
+#endif
+
 int main(int argc, char* argv[])
 {
-  using key_t = double;
+  sortbench::CommandLine const cmdline(argc, argv);
+  auto const&                  args = cmdline.positional();
 
-  if (argc < 2) {
+  if (args.empty()) {
     std::cout << std::string(argv[0])
 #if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
-              << " [nbytes per rank]\n";
+              << " [nbytes per rank]"
 #else
-              << " [nbytes]\n";
+              << " [nbytes]"
+#endif
+              << " [nthreads] [--scaling=strong|weak]"
+              << " [--scratch=fresh|reuse|both]"
+              << " [--placement=firsttouch|interleave|node0|bind]"
+              << " [--pages=4k|thp|hugetlb]"
+              << " [--type=all|"
+              << sortbench::type_names(sortbench::key_types{})
+              << "[,...]] [--seed=<n>|random]"
+              << " [--dist=all|<name>[,...]] [--zipf-s=<s>]"
+              << " [--unique=<n>] [--phases] [--perf] [--stream-mb=<n>]"
+              << " [--verify=none|order|full]"
+              << " [--iterations=<n>] [--burn-in=<n>] [--ci=<r>]"
+              << " [--min-iterations=<n>] [--topk=<k>] [--nth=<q>]"
+#if defined(SORTBENCH_MULTIWAY_MERGE)
+              << " [--merge=binary|multiway]"
+#endif
+#if defined(SORTBENCH_PSS_CUTOFFS)
+              << " [--cutoffs=<file>|none] [--calibrate]"
+#endif
+#if defined(USE_MPI)
+              << " [--hybrid]"
 #endif
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+              << " [--comm [--comm-csv=<file>]]"
+#endif
+#if defined(USE_DASH)
+              << " [--incremental=<fraction>] [--trace=<prefix>]"
+#endif
+#if !defined(USE_DASH) && !defined(USE_MPI) && !defined(USE_USORT)
+              << " [--external=<file> [--output=<file>]]"
+              << " [--argsort=off|on|both]"
+              << " [--sweep=<min nbytes> [--sweep-factor=<f>]"
+              << " [--sweep-threads=<n>[,...]] [--csv=<file>]]"
+#endif
+              << "\n";
     return 1;
   }
 
-  // Size in Bytes
-  auto const mysize = static_cast<size_t>(atoll(argv[1]));
-  // Number of local elements
-  auto const nl = mysize / sizeof(key_t);
+  Params params;
+  params.scratch = cmdline.get("scratch", params.scratch);
+
+  if (params.scratch != "fresh" && params.scratch != "reuse" &&
+      params.scratch != "both") {
+    std::cerr << "invalid --scratch=" << params.scratch << "\n";
+    return 1;
+  }
+
+  if (!sortbench::numa::parse_placement(
+          cmdline.get("placement", std::string("firsttouch")),
+          params.placement)) {
+    std::cerr << "invalid --placement=" << cmdline.get("placement", "")
+              << "\n";
+    return 1;
+  }
+
+  if (!sortbench::parse_pages(
+          cmdline.get("pages", std::string("4k")), params.pages)) {
+    std::cerr << "invalid --pages=" << cmdline.get("pages", "") << "\n";
+    return 1;
+  }
+
+  {
+    auto const types = cmdline.get("type", std::string("double"));
+    params.types.clear();
+    std::istringstream is(types == "all" ? sortbench::type_names(
+                                               sortbench::key_types{})
+                                         : types);
+    for (std::string name; std::getline(is, name, ',');) {
+      bool const known = sortbench::for_type(
+          name, sortbench::key_types{}, [](auto) {});
+      if (!known) {
+        std::cerr << "invalid --type=" << name << "\n";
+        return 1;
+      }
+      params.types.push_back(name);
+    }
+  }
+
+  if (!sortbench::parse_verify(
+          cmdline.get("verify", std::string("order")), params.verify)) {
+    std::cerr << "invalid --verify=" << cmdline.get("verify", "") << "\n";
+    return 1;
+  }
+
+  params.merge = cmdline.get("merge", params.merge);
+  if (params.merge != "binary" && params.merge != "multiway") {
+    std::cerr << "invalid --merge=" << params.merge << "\n";
+    return 1;
+  }
+
+  params.cutoffs   = cmdline.get("cutoffs", params.cutoffs);
+  params.calibrate = cmdline.has("calibrate");
+  if (params.calibrate && params.cutoffs == "none") {
+    std::cerr << "--calibrate requires a --cutoffs file\n";
+    return 1;
+  }
+
+  {
+    auto const burn_in        = cmdline.get("burn-in", 1LL);
+    auto const iterations     = cmdline.get("iterations", 10LL);
+    auto const min_iterations = cmdline.get("min-iterations", 5LL);
+    params.ci                 = cmdline.get("ci", params.ci);
+    if (burn_in < 0 || iterations < 1 || min_iterations < 2 ||
+        params.ci < 0) {
+      std::cerr << "invalid --burn-in, --iterations, --min-iterations or "
+                   "--ci\n";
+      return 1;
+    }
+    params.burn_in        = static_cast<size_t>(burn_in);
+    params.iterations     = static_cast<size_t>(iterations);
+    params.min_iterations = std::min(
+        static_cast<size_t>(min_iterations), params.iterations);
+  }
+
+  params.seed   = cmdline.get("seed", params.seed);
+  if (params.seed != "default" && params.seed != "random") {
+    // a decimal 64-bit seed, strtoull alone would accept signs and wrap
+    auto const& s = params.seed;
+    errno         = 0;
+    std::strtoull(s.c_str(), nullptr, 10);
+    if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos ||
+        errno == ERANGE) {
+      std::cerr << "invalid --seed=" << s << "\n";
+      return 1;
+    }
+  }
+  params.phases = cmdline.has("phases");
+  params.perf   = cmdline.has("perf");
+  params.hybrid = cmdline.has("hybrid");
+  params.trace  = cmdline.get("trace", params.trace);
+  {
+    auto const stream_mb = cmdline.get("stream-mb", 256LL);
+    if (stream_mb < 0) {
+      std::cerr << "invalid --stream-mb=" << stream_mb << "\n";
+      return 1;
+    }
+    params.stream_mb = static_cast<size_t>(stream_mb);
+  }
+
+  {
+    std::string all;
+    for (auto const& d : sortbench::distributions<double>()) {
+      all += (all.empty() ? "" : ",") + std::string(d.name);
+    }
+    auto const dists = cmdline.get("dist", std::string("normal"));
+    params.dists.clear();
+    std::istringstream is(dists == "all" ? all : dists);
+    for (std::string name; std::getline(is, name, ',');) {
+      if (!sortbench::find_distribution<double>(name)) {
+        std::cerr << "invalid --dist=" << name << "\n";
+        return 1;
+      }
+      params.dists.push_back(name);
+    }
+  }
+
+  params.external = cmdline.get("external", params.external);
+  params.output =
+      cmdline.get("output", params.external + std::string(".sorted"));
+  if (!params.external.empty() && params.types.size() != 1) {
+    std::cerr << "--external requires a single --type\n";
+    return 1;
+  }
+  params.argsort = cmdline.get("argsort", params.argsort);
+  if (params.argsort != "off" && params.argsort != "on" &&
+      params.argsort != "both") {
+    std::cerr << "invalid --argsort=" << params.argsort << "\n";
+    return 1;
+  }
+  {
+    auto const topk = cmdline.get("topk", 0LL);
+    params.nth      = cmdline.get("nth", params.nth);
+    if (topk < 0 || params.nth > 1 ||
+        (cmdline.has("nth") && params.nth < 0)) {
+      std::cerr << "invalid --topk or --nth\n";
+      return 1;
+    }
+    params.topk = static_cast<size_t>(topk);
+  }
+  params.comm        = cmdline.has("comm");
+  params.comm_csv    = cmdline.get("comm-csv", params.comm_csv);
+  params.incremental = cmdline.get("incremental", params.incremental);
+  if (params.incremental < 0 || params.incremental > 1) {
+    std::cerr << "invalid --incremental=" << params.incremental << "\n";
+    return 1;
+  }
+
+  {
+    auto const sweep  = cmdline.get("sweep", 0LL);
+    params.sweep_factor = cmdline.get("sweep-factor", params.sweep_factor);
+    params.csv          = cmdline.get("csv", params.csv);
+    if (sweep < 0 || params.sweep_factor <= 1) {
+      std::cerr << "invalid --sweep or --sweep-factor\n";
+      return 1;
+    }
+    params.sweep = static_cast<size_t>(sweep);
+    std::istringstream is(cmdline.get("sweep-threads", std::string()));
+    for (std::string t; std::getline(is, t, ',');) {
+      auto const nthreads = atoi(t.c_str());
+      if (nthreads <= 0) {
+        std::cerr << "invalid --sweep-threads=" << t << "\n";
+        return 1;
+      }
+      params.sweep_threads.push_back(nthreads);
+    }
+  }
+  params.scaling = cmdline.get("scaling", params.scaling);
+  if (cmdline.has("scaling") && params.scaling != "strong" &&
+      params.scaling != "weak") {
+    std::cerr << "invalid --scaling=" << params.scaling << "\n";
+    return 1;
+  }
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  if (params.sweep > 0) {
+    std::cerr << "--sweep is only supported by the shared memory backends\n";
+    return 1;
+  }
+  if (!params.external.empty()) {
+    std::cerr << "--external is only supported by the shared memory "
+                 "backends\n";
+    return 1;
+  }
+#endif
+
+  auto& dist_params  = sortbench::dist_params();
+  dist_params.zipf_s = cmdline.get("zipf-s", dist_params.zipf_s);
+  dist_params.nunique =
+      static_cast<size_t>(cmdline.get("unique", 16LL));
+  if (dist_params.nunique == 0) {
+    std::cerr << "invalid --unique=0\n";
+    return 1;
+  }
+
+  // Size in Bytes, per rank or in total, see --scaling
+  auto const nbytes = static_cast<size_t>(atoll(args[0].c_str()));
   // Number of threads
-  auto const T = (argc == 3) ? atoi(argv[2]) : 0;
+  auto const T = (args.size() > 1) ? atoi(args[1].c_str()) : 0;
 
 #if defined(USE_DASH)
   dash::init(&argc, &argv);
 
-  auto const P           = dash::size();
-  auto const gsize_bytes = mysize * P;
-  auto const N           = nl * P;
-  auto const r           = dash::myid();
+  auto const P = dash::size();
+  auto const r = dash::myid();
 #elif defined(USE_MPI) || defined(USE_USORT)
-  MPI_Init(&argc, &argv);
+  // threads never call MPI
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
   int P;
   MPI_Comm_size(MPI_COMM_WORLD, &P);
-  auto const gsize_bytes = mysize * P;
-  auto const N = nl * P;
   int r;
   MPI_Comm_rank(MPI_COMM_WORLD, &r);
 #else
   auto const P = T ? T : std::thread::hardware_concurrency();
   assert(P > 0);
-  auto const gsize_bytes = mysize;
-  auto const N           = nl;
-  auto const r           = 0;
+  auto const r = 0;
+#endif
+
+  // bytes of the keys per rank for the distributed backends, of all keys
+  // for the shared memory backends (the sweep sizes are always totals)
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  auto const mysize = params.scaling == "strong" ? nbytes / P : nbytes;
+#else
+  if (params.sweep > 0 && !params.scaling.empty()) {
+    std::cerr << "--scaling is not supported by --sweep, ignored\n";
+    params.scaling.clear();
+  }
+  auto const mysize = params.scaling == "weak" ? nbytes * P : nbytes;
 #endif
 
 #if defined(USE_TBB_HIGHLEVEL) || defined(USE_TBB_LOWLEVEL)
   tbb::task_scheduler_init init{static_cast<int>(P)};
-#elif defined(USE_OPENMP)
+#elif defined(USE_OPENMP) || defined(USE_RADIX) || defined(USE_INPLACE)
   omp_set_num_threads(P);
-#elif defined(USE_USORT)
+#elif defined(USE_MPI)
+  // MP-sort is single threaded and launched one rank per core, i.e. T = 1
+  // without --hybrid. With --hybrid the T threads of a rank also generate,
+  // place, verify and scan the keys and run the STREAM probe.
+  if (!params.hybrid) {
+    if (T > 1 && r == 0) {
+      std::cerr << "nthreads needs --hybrid for mpi.x, running 1 thread "
+                   "per rank\n";
+    }
+    omp_set_num_threads(1);
+  }
+  else if (T) {
+    omp_set_num_threads(T);
+  }
+#elif defined(USE_USORT) || defined(USE_DASH)
+  // threads per rank for the node local sort
   if (T) {
     omp_set_num_threads(T);
   }
+#if defined(USE_DASH) && defined(DASH_ENABLE_PSTL)
+  tbb::task_scheduler_init init{
+      T ? T : tbb::task_scheduler_init::automatic};
+#endif
 #endif
 
-  double mb = (gsize_bytes / MB);
+#if defined(USE_DASH) || defined(USE_USORT)
+  params.threads = omp_get_max_threads();
+#elif defined(USE_MPI)
+  params.threads = omp_get_max_threads();
+#else
+  params.threads = static_cast<int>(P);
+#endif
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  if (params.argsort != "off" && r == 0) {
+    std::cerr << "--argsort is only supported by the shared memory "
+                 "backends, ignored\n";
+  }
+  params.argsort = "off";
+#endif
+
+#if !defined(USE_DASH) && !defined(USE_MPI) && !defined(USE_USORT)
+  if (params.comm && r == 0) {
+    std::cerr << "--comm is only supported by the distributed backends, "
+                 "ignored\n";
+  }
+  params.comm = false;
+#endif
+
+#if !defined(USE_DASH)
+  if (params.incremental > 0 && r == 0) {
+    std::cerr << "--incremental is only supported by dash.x, ignored\n";
+  }
+  params.incremental = 0;
+  if (!params.trace.empty() && r == 0) {
+    std::cerr << "--trace is only supported by dash.x, ignored\n";
+  }
+#else
+  // the phases of dash.x come from the DASH trace
+  auto const* const dash_trace = std::getenv("DASH_ENABLE_TRACE");
+  if (params.phases && r == 0 &&
+      (dash_trace == nullptr || std::string(dash_trace) == "0")) {
+    std::cerr << "--phases needs DASH_ENABLE_TRACE=1, reporting the sort "
+                 "as a single phase\n";
+  }
+#endif
+
+#ifndef USE_MPI
+  if (params.hybrid && r == 0) {
+    std::cerr << "--hybrid is only supported by mpi.x, ignored\n";
+  }
+  params.hybrid = false;
+#endif
+
+#if defined(USE_DASH) || defined(USE_USORT)
+  if (params.pages != sortbench::Pages::base && r == 0) {
+    std::cerr << "--pages is not supported by this backend, ignored\n";
+  }
+  params.pages = sortbench::Pages::base;
+#endif
+  // before the first allocation, the scratch buffers of the PSS merge sort
+  // are mapped with the same pages as the keys
+  sortbench::page_mode() = params.pages;
+#if defined(SORTBENCH_SCRATCH_ARENA) || defined(USE_MPI)
+  pss::internal::raw_buffer_allocator() = {
+      &sortbench::page_allocate, &sortbench::page_deallocate};
+#endif
+
+  // blocks of the rank / thread local distributions
+  dist_params.nblocks = P;
+
+  if (params.seed == "random") {
+    unsigned long long seed = 0;
+    if (r == 0) {
+      std::random_device rd;
+      seed = (static_cast<unsigned long long>(rd()) << 32) | rd();
+    }
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+    MPI_Bcast(&seed, 1, MPI_UNSIGNED_LONG_LONG, 0, MPI_COMM_WORLD);
+#endif
+    sortbench::rng_seed() = seed;
+  }
+  else if (params.seed != "default") {
+    sortbench::rng_seed() = std::stoull(params.seed);
+  }
 
   std::string const executable(argv[0]);
   auto const        base_filename =
       executable.substr(executable.find_last_of("/\\") + 1);
 
-#if defined(USE_DASH)
-  dash::Array<key_t> keys(N);
+  if (params.trace.empty()) {
+    params.trace = base_filename + "-trace";
+  }
+
+  if (params.placement == sortbench::numa::Placement::bind) {
+    sortbench::pin_threads();
+  }
+
+#ifdef SORTBENCH_PSS_CUTOFFS
+  if (params.calibrate) {
+    std::vector<sortbench::CutoffEntry> tuned;
+    std::cout << std::setw(8) << "Type,";
+    std::cout << std::setw(10) << "NTasks,";
+    std::cout << std::setw(11) << "Sort Cut,";
+    std::cout << std::setw(11) << "Merge Cut,";
+    std::cout << std::setw(20) << "Time,";
+    std::cout << std::setw(20) << "Test Case";
+    std::cout << "\n";
+    for (auto const& name : params.types) {
+      sortbench::for_type(name, sortbench::key_types{}, [&](auto tag) {
+        using key_t = typename decltype(tag)::type;
+        tuned.push_back(Calibrate<key_t>(params, mysize, P, base_filename));
+      });
+    }
+    if (!sortbench::save_cutoffs(params.cutoffs, tuned)) {
+      std::cerr << "cannot write " << params.cutoffs << "\n";
+      return 1;
+    }
+    for (auto const& e : tuned) {
+      std::cout << "\n"
+                << e.type << ": sort cut-off " << e.sort_cut_off
+                << ", merge cut-off " << e.merge_cut_off << " -> "
+                << params.cutoffs << "\n";
+    }
+    return 0;
+  }
+
+  // entries calibrated for this backend and thread count
+  apply_cutoffs(params, base_filename, P);
 #else
-  std::vector<key_t> keys(nl);
+  if (params.calibrate && r == 0) {
+    std::cerr << "--calibrate is only supported by the PSS backends, "
+                 "ignored\n";
+  }
 #endif
 
-  if (r == 0) {
-#if defined(USE_DASH)
-    dash::util::BenchmarkParams bench_params("bench.dash.sort");
-    bench_params.set_output_width(72);
-    bench_params.print_header();
-    if (dash::size() < 200) {
-      bench_params.print_pinning();
+#if !defined(USE_DASH) && !defined(USE_MPI) && !defined(USE_USORT)
+  if (!params.external.empty()) {
+    // the first positional argument is the size of a sorted run
+    try {
+      sortbench::for_type(
+          params.types.front(), sortbench::key_types{}, [&](auto tag) {
+            using key_t = typename decltype(tag)::type;
+            External<key_t>(params, mysize, P, base_filename);
+          });
+    }
+    catch (std::system_error const& e) {
+      std::cerr << "external sort failed: " << e.what() << "\n";
+      return 1;
     }
+    return 0;
+  }
 #endif
-    print_header(base_filename, mb, P);
+
+  // a sweep probes per thread count
+  if (params.stream_mb > 0 && params.sweep == 0) {
+    // collective, with the thread layout of the sort
+    params.bandwidth = sortbench::stream_probe(
+        params.stream_mb * MB, [](size_t n, auto f) {
+          sortbench::parallel_for_static(n, f);
+        });
   }
 
-  Test(keys, N, r, P, base_filename);
+#ifndef SORTBENCH_MULTIWAY_MERGE
+  if (params.merge != "binary" && r == 0) {
+    std::cerr << "--merge=" << params.merge
+              << " is only supported by the PSS backends, ignored\n";
+  }
+  params.merge = "binary";
+#endif
 
+#ifndef SORTBENCH_SCRATCH_ARENA
+  if (params.scratch != "fresh" && r == 0) {
+    std::cerr << "--scratch=" << params.scratch
+              << " is not supported by this backend, using fresh buffers\n";
+  }
+  params.scratch = "fresh";
+#endif
+
+#if !defined(USE_DASH) && !defined(USE_MPI) && !defined(USE_USORT)
+  if (params.sweep > 0) {
+    if (params.sweep_threads.empty()) {
+      params.sweep_threads.push_back(static_cast<int>(P));
+    }
+    if (params.csv.empty()) {
+      params.csv = base_filename + "-sweep.csv";
+    }
+    std::ofstream csv(params.csv, std::ios::trunc);
+    if (!csv) {
+      std::cerr << "cannot write " << params.csv << "\n";
+      return 1;
+    }
+    print_sweep_header(csv);
+
+    auto const set_threads = [&](int nthreads) {
+#if defined(USE_TBB_HIGHLEVEL) || defined(USE_TBB_LOWLEVEL)
+      init.terminate();
+      init.initialize(nthreads);
+#else
+      omp_set_num_threads(nthreads);
+#endif
+    };
+
+    for (auto const& name : params.types) {
+      sortbench::for_type(name, sortbench::key_types{}, [&](auto tag) {
+        using key_t = typename decltype(tag)::type;
+        Sweep<key_t>(params, mysize, set_threads, base_filename, csv);
+      });
+    }
+    std::cout << "sweep: " << params.csv << "\n";
+    return 0;
+  }
+#endif
+
+#if defined(USE_DASH) || defined(USE_MPI) || defined(USE_USORT)
+  if (params.comm) {
+    if (params.comm_csv.empty()) {
+      params.comm_csv = base_filename + "-comm.csv";
+    }
+    // rank 0 writes the matrices, all ranks stop if it cannot
+    int ok = 1;
+    if (r == 0) {
+      std::ofstream csv(params.comm_csv, std::ios::trunc);
+      sortbench::comm::write_csv_header(csv, P);
+      ok = static_cast<bool>(csv);
+      if (!ok) {
+        std::cerr << "cannot write " << params.comm_csv << "\n";
+      }
+    }
+    MPI_Bcast(&ok, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (!ok) {
 #if defined(USE_DASH)
-  dash::finalize();
+      dash::finalize();
 #elif defined(USE_MPI) || defined(USE_USORT)
-  MPI_Finalize();
+      MPI_Finalize();
+#endif
+      return 1;
+    }
+  }
 #endif
 
-  if (r == 0) {
-    std::cout << "\n";
+  std::vector<ArgsortPoint> argsort_points;
+  for (auto const& name : params.types) {
+    sortbench::for_type(name, sortbench::key_types{}, [&](auto tag) {
+      using key_t = typename decltype(tag)::type;
+      Bench<key_t>(params, mysize, P, r, base_filename, argsort_points);
+    });
   }
+  if (!argsort_points.empty() && r == 0) {
+    print_argsort_crossover(argsort_points);
+  }
+
+#if defined(USE_DASH)
+  dash::finalize();
+#elif defined(USE_MPI) || defined(USE_USORT)
+  MPI_Finalize();
+#endif
 
   return 0;
 }
@@ -0,0 +1,152 @@
+// Writes the input file of the external sort (sortbench --external=<file>)
+// with the key distributions of the in-memory benchmark. The keys only depend
+// on (seed, total, index), i.e. the file matches the keys an in-memory run of
+// the same size generates.
+
+#include <algorithm>
+#include <future>
+#include <iostream>
+#include <random>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <fcntl.h>
+
+#include <omp.h>
+
+#include <util/CommandLine.h>
+#include <util/External.h>
+#include <util/Generators.h>
+#include <util/Memory.h>
+#include <util/Random.h>
+#include <util/Timer.h>
+#include <util/Types.h>
+
+#define MB (1 << 20)
+
+//! Generates blocks of block_bytes in parallel and writes them in order, the
+//! write of a block overlaps with the generation of the next one
+template <typename key_t>
+void generate(
+    std::string const& path,
+    size_t             nbytes,
+    size_t             block_bytes,
+    key_t (*gen)(size_t, size_t))
+{
+  namespace ext = sortbench::external;
+
+  auto const n     = nbytes / sizeof(key_t);
+  auto const block = std::max<size_t>(1, block_bytes / sizeof(key_t));
+
+  ext::File const out(path, O_WRONLY | O_CREAT | O_TRUNC);
+  out.truncate(n * sizeof(key_t));
+
+  using buffer_t = std::vector<key_t, sortbench::default_init_allocator<key_t>>;
+  buffer_t buf[2];
+
+  std::future<void> pending[2];
+
+  auto const start = ChronoClockNow();
+
+  for (size_t lo = 0, b = 0; lo < n; lo += block, b = 1 - b) {
+    auto const len = std::min(block, n - lo);
+    if (pending[b].valid()) pending[b].get();
+    buf[b].resize(len);
+    auto* const data = buf[b].data();
+
+#pragma omp parallel for schedule(static)
+    for (size_t idx = 0; idx < len; ++idx) {
+      data[idx] = gen(n, lo + idx);
+    }
+
+    pending[b] = std::async(std::launch::async, [&out, data, len, lo] {
+      ext::write_values(out, data, len, lo);
+    });
+  }
+  for (auto& p : pending) {
+    if (p.valid()) p.get();
+  }
+
+  auto const duration = ChronoClockNow() - start;
+
+  std::cout << path << ": " << n << " x " << sortbench::type_name<key_t>::get()
+            << " (" << static_cast<double>(n * sizeof(key_t)) / MB
+            << " MB) in " << duration << " s\n";
+}
+
+int main(int argc, char* argv[])
+{
+  sortbench::CommandLine const cmdline(argc, argv);
+  auto const&                  args = cmdline.positional();
+
+  if (args.size() < 2) {
+    std::cout << std::string(argv[0]) << " <file> <nbytes>"
+              << " [--type="
+              << sortbench::type_names(sortbench::key_types{}) << "]"
+              << " [--dist=<name>] [--seed=<n>|random] [--zipf-s=<s>]"
+              << " [--unique=<n>] [--blocks=<n>] [--block-mb=<n>]\n";
+    return 1;
+  }
+
+  auto const type = cmdline.get("type", std::string("double"));
+  auto const dist = cmdline.get("dist", std::string("normal"));
+  auto const seed = cmdline.get("seed", std::string("default"));
+
+  if (!sortbench::find_distribution<double>(dist)) {
+    std::cerr << "invalid --dist=" << dist << "\n";
+    return 1;
+  }
+
+  auto& dist_params  = sortbench::dist_params();
+  dist_params.zipf_s = cmdline.get("zipf-s", dist_params.zipf_s);
+  dist_params.nunique =
+      static_cast<size_t>(cmdline.get("unique", 16LL));
+  // blocks of ranksorted, staggered and bucket
+  dist_params.nblocks = static_cast<size_t>(
+      cmdline.get("blocks", static_cast<long long>(omp_get_max_threads())));
+  if (dist_params.nunique == 0 || dist_params.nblocks == 0) {
+    std::cerr << "invalid --unique or --blocks\n";
+    return 1;
+  }
+
+  if (seed == "random") {
+    std::random_device rd;
+    sortbench::rng_seed() =
+        (static_cast<unsigned long long>(rd()) << 32) | rd();
+  }
+  else if (seed != "default") {
+    sortbench::rng_seed() = std::stoull(seed);
+  }
+
+  auto const nbytes   = static_cast<size_t>(atoll(args[1].c_str()));
+  auto const block_mb = cmdline.get("block-mb", 64LL);
+  if (block_mb <= 0) {
+    std::cerr << "invalid --block-mb=" << block_mb << "\n";
+    return 1;
+  }
+
+  try {
+    bool const known =
+        sortbench::for_type(type, sortbench::key_types{}, [&](auto tag) {
+          using key_t = typename decltype(tag)::type;
+          generate<key_t>(
+              args[0],
+              nbytes,
+              static_cast<size_t>(block_mb) * MB,
+              sortbench::find_distribution<key_t>(dist));
+        });
+    if (!known) {
+      std::cerr << "invalid --type=" << type << "\n";
+      return 1;
+    }
+  }
+  catch (std::system_error const& e) {
+    std::cerr << "writing " << args[0] << " failed: " << e.what() << "\n";
+    return 1;
+  }
+
+  std::cout << "seed: " << sortbench::rng_seed() << "\n";
+
+  return 0;
+}
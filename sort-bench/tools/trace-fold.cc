@@ -0,0 +1,241 @@
+// Merges the binary trace files of dash.x (--trace=<prefix>, one file per
+// rank) into folded stacks, the input of flame graph tools (flamegraph.pl,
+// speedscope, ...), and a per-state summary across the ranks. The files are
+// read one block at a time, i.e. the memory only depends on the number of
+// distinct states, not on the number of ranks.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <util/CommandLine.h>
+#include <util/TraceFile.h>
+
+namespace trace = sortbench::trace;
+
+//! Time of a state per rank in seconds, over all ranks
+struct StateStats {
+  size_t n     = 0;
+  double sum   = 0;
+  double sumsq = 0;
+  double min   = std::numeric_limits<double>::max();
+  double max   = 0;
+
+  void add(double t)
+  {
+    ++n;
+    sum += t;
+    sumsq += t * t;
+    min = std::min(min, t);
+    max = std::max(max, t);
+  }
+
+  double mean() const
+  {
+    return sum / n;
+  }
+
+  //! Sample standard deviation, 0 for a single rank
+  double sd() const
+  {
+    if (n < 2) return 0;
+    auto const var = (sumsq - sum * sum / n) / (n - 1);
+    return std::sqrt(std::max(0.0, var));
+  }
+};
+
+//! Folded stacks and state statistics of all blocks read so far
+struct Aggregate {
+  // microseconds per stack, summed over the ranks
+  std::map<std::string, double> stacks;
+  // (test case, type, dist) in the order of the first block
+  std::vector<std::string> labels;
+  // states per label in the order they first start
+  std::map<std::string, std::vector<std::string>> states;
+  std::map<std::pair<std::string, std::string>, StateStats> stats;
+};
+
+//! Adds one block (one test case on one rank) to the aggregate. Sub-states
+//! are stacked on their top-level state, which keeps the time not covered
+//! by its sub-states. The span of the top-level states is the measured time
+//! of the sort, which converts the timestamps to seconds.
+void add_block(
+    trace::BlockHeader const&         header,
+    std::vector<trace::Record> const& records,
+    bool                              per_rank,
+    Aggregate&                        agg)
+{
+  auto const label = trace::get_name(header.test_case) + ";" +
+                     trace::get_name(header.type) + ";" +
+                     trace::get_name(header.dist);
+
+  double lo = std::numeric_limits<double>::max();
+  double hi = std::numeric_limits<double>::lowest();
+
+  // top-level states with their first start and total time, sub-states per
+  // top-level phase number
+  std::vector<std::string>                             order;
+  std::map<std::string, std::pair<double, double>>     totals;
+  std::map<std::string, std::map<std::string, double>> details;
+
+  for (auto const& rec : records) {
+    auto const state = trace::get_name(rec.state);
+    if (trace::is_detail(state)) {
+      details[trace::phase_of(state)][state] += rec.end - rec.start;
+      continue;
+    }
+    lo = std::min(lo, rec.start);
+    hi = std::max(hi, rec.end);
+
+    auto it = totals.find(state);
+    if (it == totals.end()) {
+      order.push_back(state);
+      totals[state] = {rec.start, rec.end - rec.start};
+    }
+    else {
+      it->second.first = std::min(it->second.first, rec.start);
+      it->second.second += rec.end - rec.start;
+    }
+  }
+  if (order.empty() || !(hi > lo)) return;
+
+  std::stable_sort(
+      order.begin(),
+      order.end(),
+      [&totals](std::string const& a, std::string const& b) {
+        return totals[a].first < totals[b].first;
+      });
+
+  auto const scale = header.elapsed / (hi - lo);
+
+  if (agg.states.find(label) == agg.states.end()) {
+    agg.labels.push_back(label);
+  }
+  auto& known = agg.states[label];
+
+  auto const prefix =
+      per_rank ? label + ";rank " + std::to_string(header.rank) : label;
+
+  for (auto const& state : order) {
+    auto const total  = totals[state].second;
+    double     nested = 0;
+    for (auto const& d : details[trace::phase_of(state)]) {
+      agg.stacks[prefix + ";" + state + ";" + d.first] +=
+          d.second * scale * 1e6;
+      nested += d.second;
+    }
+    // sub-states of a phase are attributed once, to its first state
+    details.erase(trace::phase_of(state));
+
+    agg.stacks[prefix + ";" + state] +=
+        std::max(0.0, total - nested) * scale * 1e6;
+
+    if (std::find(known.begin(), known.end(), state) == known.end()) {
+      known.push_back(state);
+    }
+    agg.stats[{label, state}].add(total * scale);
+  }
+}
+
+//! Reads all blocks of a trace file, false if it is not one
+bool read_file(std::string const& path, bool per_rank, Aggregate& agg)
+{
+  std::ifstream in(path, std::ios::binary);
+  if (!in) {
+    std::cerr << "cannot read " << path << "\n";
+    return false;
+  }
+
+  trace::BlockHeader         header;
+  std::vector<trace::Record> records;
+  while (in.read(reinterpret_cast<char*>(&header), sizeof(header))) {
+    if (trace::get_name(header.magic) != trace::MAGIC ||
+        header.version != trace::VERSION) {
+      std::cerr << path << " is not a trace file of version "
+                << trace::VERSION << "\n";
+      return false;
+    }
+    records.resize(header.nrecords);
+    if (!in.read(
+            reinterpret_cast<char*>(records.data()),
+            records.size() * sizeof(trace::Record))) {
+      std::cerr << path << " is truncated\n";
+      return false;
+    }
+    add_block(header, records, per_rank, agg);
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  sortbench::CommandLine const cmdline(argc, argv);
+  auto const&                  files = cmdline.positional();
+
+  if (files.empty()) {
+    std::cout << std::string(argv[0]) << " <trace file>..."
+              << " [--folded=<file>] [--summary=<file>] [--ranks]\n";
+    return 1;
+  }
+
+  auto const folded = cmdline.get("folded", std::string("trace.folded"));
+  auto const summary =
+      cmdline.get("summary", std::string("trace-summary.csv"));
+  auto const per_rank = cmdline.has("ranks");
+
+  Aggregate agg;
+  for (auto const& path : files) {
+    if (!read_file(path, per_rank, agg)) return 1;
+  }
+
+  std::ofstream fout(folded, std::ios::trunc);
+  for (auto const& s : agg.stacks) {
+    auto const us = std::llround(s.second);
+    if (us > 0) {
+      fout << s.first << " " << us << "\n";
+    }
+  }
+  if (!fout) {
+    std::cerr << "cannot write " << folded << "\n";
+    return 1;
+  }
+
+  // slowest states first per test case
+  std::ofstream sout(summary, std::ios::trunc);
+  sout << "Test Case,Type,Dist,State,N,Mean (s),Sd (s),Min (s),Max (s),"
+          "Max/Mean\n";
+  for (auto const& label : agg.labels) {
+    auto states = agg.states[label];
+    std::stable_sort(
+        states.begin(),
+        states.end(),
+        [&agg, &label](std::string const& a, std::string const& b) {
+          return agg.stats[{label, a}].mean() > agg.stats[{label, b}].mean();
+        });
+    auto csv_label = label;
+    std::replace(csv_label.begin(), csv_label.end(), ';', ',');
+    for (auto const& state : states) {
+      auto const& st = agg.stats[{label, state}];
+      sout << csv_label << "," << state << "," << st.n << "," << std::fixed
+           << std::setprecision(6) << st.mean() << "," << st.sd() << ","
+           << st.min << "," << st.max << "," << std::setprecision(2)
+           << (st.mean() > 0 ? st.max / st.mean() : 0.0) << "\n";
+    }
+  }
+  if (!sout) {
+    std::cerr << "cannot write " << summary << "\n";
+    return 1;
+  }
+
+  std::cout << files.size() << " files, " << agg.labels.size()
+            << " test cases: " << folded << ", " << summary << "\n";
+  return 0;
+}